@@ -0,0 +1,37 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+
+	Counts heap allocations by interposing the allocator entry points
+	ahead of libc. Allocations made inside shared libraries, such as
+	jansson, are counted too.
+*/
+
+#include <stddef.h>
+
+#include "allocCount.h"
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+unsigned long bench_allocs;
+
+void *malloc(size_t size)
+{
+	bench_allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	bench_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	bench_allocs++;
+	return __libc_realloc(ptr, size);
+}
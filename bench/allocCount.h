@@ -0,0 +1,21 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+*/
+
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of malloc, calloc and realloc calls made by this process */
+extern unsigned long bench_allocs;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ALLOC_COUNT_H */
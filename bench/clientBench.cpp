@@ -0,0 +1,382 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+
+	End to end benchmark of the client stack: the configd_* C API,
+	CfgClient, Cstore and cli-shell-api, all talking over a real Unix
+	socket to mockConfigd.
+
+	For every operation it reports throughput, median and 99th
+	percentile latency, request plus response bytes on the wire and heap
+	allocations made by the client, each per call.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <vyatta-util/map.h>
+#include <vyatta-util/vector.h>
+
+#include "auth.h"
+#include "callrpc.h"
+#include "connect.h"
+#include "error.h"
+#include "file.h"
+#include "node.h"
+#include "session.h"
+#include "template.h"
+#include "transaction.h"
+#include "CfgClient.hpp"
+#include "../src/compat/cstore-compat.hpp"
+
+#include "allocCount.h"
+#include "mockConfigd.h"
+
+#ifndef CLI_SHELL_API
+#define CLI_SHELL_API "../src/my_cli_shell_api"
+#endif
+
+extern char **environ;
+
+struct bench_op {
+	const char *api;
+	const char *name;
+	std::function<void()> fn;
+	bool spawns;		/* each call runs a separate process */
+};
+
+static const char cpath[] = "/interfaces/dataplane/dp0p1s1/address";
+static const char *spath[] = {
+	"interfaces", "dataplane", "dp0p1s1", "address",
+};
+
+static struct configd_conn conn;
+static struct configd_error err;
+static int null_fd;		/* output of the *_to_fd calls */
+static std::string config_body;	/* a configuration of string-bytes */
+
+/* Wrap a C API call, freeing whatever it returns */
+#define C_OP(name, call, release)				\
+	{ "C", name, []() {					\
+		auto r = call;					\
+		release(r);					\
+		configd_error_free(&err);			\
+	}, false }
+
+static void release_int(int) {}
+static void release_str(char *s) { free(s); }
+static void release_vec(struct vector *v) { vector_free(v); }
+static void release_map(struct map *m) { map_free(m); }
+
+static void spawn_cli_shell_api(const std::vector<const char *> &args)
+{
+	std::vector<char *> argv;
+	posix_spawn_file_actions_t fa;
+	pid_t pid;
+	int status;
+
+	argv.push_back((char *)"cli-shell-api");
+	for (size_t i = 0; i < args.size(); i++)
+		argv.push_back((char *)args[i]);
+	argv.push_back(NULL);
+
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+	if (posix_spawn(&pid, CLI_SHELL_API, &fa, NULL, argv.data(), environ) == 0)
+		waitpid(pid, &status, 0);
+	posix_spawn_file_actions_destroy(&fa);
+}
+
+#define SHELL_OP(name, ...)						\
+	{ "cli-shell-api", name, []() {					\
+		spawn_cli_shell_api({ name, __VA_ARGS__ });		\
+	}, true }
+
+static std::vector<bench_op> make_ops(CfgClient &client, cstore::Cstore &cstore)
+{
+	std::vector<std::string> path(spath, spath + 4);
+	StringVector svpath(spath, spath + 4);
+
+	std::vector<bench_op> ops = {
+		C_OP("configd_node_exists",
+		     configd_node_exists(&conn, RUNNING, cpath, &err), release_int),
+		C_OP("configd_node_is_default",
+		     configd_node_is_default(&conn, RUNNING, cpath, &err), release_int),
+		C_OP("configd_node_get",
+		     configd_node_get(&conn, RUNNING, cpath, &err), release_vec),
+		C_OP("configd_node_get_status",
+		     configd_node_get_status(&conn, CANDIDATE, cpath, &err), release_int),
+		C_OP("configd_node_get_type",
+		     configd_node_get_type(&conn, cpath, &err), release_int),
+		C_OP("configd_node_get_comment",
+		     configd_node_get_comment(&conn, RUNNING, cpath, &err), release_str),
+		C_OP("configd_tree_get",
+		     configd_tree_get(&conn, RUNNING, cpath, &err), release_str),
+		C_OP("configd_tree_get_to_fd",
+		     configd_tree_get_to_fd(&conn, RUNNING, cpath, null_fd, &err),
+		     release_int),
+		C_OP("configd_tree_get_full",
+		     configd_tree_get_full(&conn, RUNNING, cpath, &err), release_str),
+		C_OP("configd_sess_exists",
+		     configd_sess_exists(&conn, &err), release_int),
+		C_OP("configd_sess_changed",
+		     configd_sess_changed(&conn, &err), release_int),
+		C_OP("configd_sess_locked",
+		     configd_sess_locked(&conn, &err), release_int),
+		C_OP("configd_get_help",
+		     configd_get_help(&conn, 0, cpath, &err), release_map),
+		C_OP("configd_tmpl_get",
+		     configd_tmpl_get(&conn, cpath, &err), release_map),
+		C_OP("configd_tmpl_get_children",
+		     configd_tmpl_get_children(&conn, cpath, &err), release_vec),
+		C_OP("configd_tmpl_get_allowed",
+		     configd_tmpl_get_allowed(&conn, cpath, &err), release_vec),
+		C_OP("configd_tmpl_validate_path",
+		     configd_tmpl_validate_path(&conn, cpath, &err), release_int),
+		C_OP("configd_tmpl_validate_values",
+		     configd_tmpl_validate_values(&conn, cpath, &err), release_int),
+		C_OP("configd_get_schemas",
+		     configd_get_schemas(&conn, &err), release_str),
+		C_OP("configd_get_features",
+		     configd_get_features(&conn, &err), release_map),
+		C_OP("configd_auth_authorized",
+		     configd_auth_authorized(&conn, cpath, 0, &err), release_int),
+		C_OP("configd_auth_getperms",
+		     configd_auth_getperms(&conn, &err), release_map),
+		C_OP("configd_set",
+		     configd_set(&conn, cpath, &err), release_str),
+		C_OP("configd_delete",
+		     configd_delete(&conn, cpath, &err), release_str),
+		C_OP("configd_validate_path",
+		     configd_validate_path(&conn, cpath, &err), release_str),
+		C_OP("configd_show",
+		     configd_show(&conn, RUNNING, cpath, "@ACTIVE", "@WORKING", 0, &err),
+		     release_str),
+		C_OP("configd_show_to_fd",
+		     configd_show_to_fd(&conn, RUNNING, cpath, "@ACTIVE", "@WORKING", 0,
+					null_fd, &err),
+		     release_int),
+		C_OP("configd_edit_config_xml",
+		     configd_edit_config_xml(&conn, "candidate", "merge", "set",
+					     "stop-on-error", config_body.c_str(), &err),
+		     release_str),
+		C_OP("configd_validate",
+		     configd_validate(&conn, &err), release_str),
+		C_OP("configd_commit",
+		     configd_commit(&conn, "bench", &err), release_str),
+		C_OP("configd_discard",
+		     configd_discard(&conn, &err), release_str),
+		C_OP("configd_file_read",
+		     configd_file_read(&conn, "/config/config.boot", &err), release_str),
+		C_OP("configd_call_rpc",
+		     configd_call_rpc(&conn, "urn:vyatta.com:mgmt:bench", "ping", "{}", &err),
+		     release_str),
+
+		{ "CfgClient", "NodeExists",
+		  [&client, path]() { client.NodeExists(CfgClient::RUNNING, path); }, false },
+		{ "CfgClient", "NodeGet",
+		  [&client, path]() { client.NodeGet(CfgClient::RUNNING, path); }, false },
+		{ "CfgClient", "NodeGetStatus",
+		  [&client, path]() { client.NodeGetStatus(CfgClient::CANDIDATE, path); }, false },
+		{ "CfgClient", "TreeGet",
+		  [&client, path]() { client.TreeGet(CfgClient::RUNNING, path); }, false },
+		{ "CfgClient", "TemplateGet",
+		  [&client, path]() { client.TemplateGet(path); }, false },
+		{ "CfgClient", "TemplateGetChildren",
+		  [&client, path]() { client.TemplateGetChildren(path); }, false },
+		{ "CfgClient", "Set",
+		  [&client, path]() { client.Set(path); }, false },
+		{ "CfgClient", "SessionChanged",
+		  [&client]() { client.SessionChanged(); }, false },
+
+		{ "Cstore", "cfgPathExists",
+		  [&cstore, svpath]() mutable { cstore.cfgPathExists(svpath, true); }, false },
+		{ "Cstore", "cfgPathGetValues",
+		  [&cstore, svpath]() mutable {
+			StringVector r;
+			cstore.cfgPathGetValues(svpath, r, true);
+		  }, false },
+		{ "Cstore", "cfgPathGetChildNodes",
+		  [&cstore, svpath]() mutable {
+			StringVector r;
+			cstore.cfgPathGetChildNodes(svpath, r, true);
+		  }, false },
+		{ "Cstore", "cfgPathStatus",
+		  [&cstore, svpath]() mutable {
+			std::string r;
+			cstore.cfgPathStatus(svpath, r);
+		  }, false },
+		{ "Cstore", "getParsedTmpl",
+		  [&cstore, svpath]() mutable {
+			StringMap r;
+			cstore.getParsedTmpl(svpath, r, true);
+		  }, false },
+		{ "Cstore", "tmplGetChildNodes",
+		  [&cstore, svpath]() mutable {
+			StringVector r;
+			cstore.tmplGetChildNodes(svpath, r);
+		  }, false },
+
+		SHELL_OP("existsActive", "interfaces", "dataplane", "dp0p1s1"),
+		SHELL_OP("returnActiveValues", "interfaces", "dataplane", "dp0p1s1", "address"),
+		SHELL_OP("listActiveNodes", "interfaces", "dataplane"),
+		SHELL_OP("getNodeType", "interfaces", "dataplane"),
+		SHELL_OP("showConfig", "interfaces"),
+	};
+	return ops;
+}
+
+static void run_op(const bench_op &op, long iterations, const struct mock_configd *m)
+{
+	typedef std::chrono::steady_clock clock;
+	std::vector<double> lat(iterations);
+	unsigned long long bytes;
+	unsigned long allocs;
+
+	op.fn(); /* warm up */
+	bytes = m->stats->bytes_in + m->stats->bytes_out;
+	allocs = bench_allocs;
+	clock::time_point start = clock::now();
+	for (long i = 0; i < iterations; i++) {
+		clock::time_point t0 = clock::now();
+		op.fn();
+		lat[i] = std::chrono::duration<double, std::micro>(clock::now() - t0).count();
+	}
+	double total = std::chrono::duration<double>(clock::now() - start).count();
+	allocs = bench_allocs - allocs;
+	bytes = m->stats->bytes_in + m->stats->bytes_out - bytes;
+
+	std::sort(lat.begin(), lat.end());
+	printf("%-14s %-30s %10.0f %9.1f %9.1f %11.0f ",
+	       op.api, op.name, iterations / total,
+	       lat[iterations / 2], lat[(iterations * 99) / 100],
+	       (double)bytes / iterations);
+	if (op.spawns)
+		printf("%11s\n", "-");
+	else
+		printf("%11.1f\n", (double)allocs / iterations);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n iterations] [-p process-iterations] [-s string-bytes]\n"
+		"       [-e elements] [-l latency-us] [-f filter] [-m] [-c]\n"
+		"  -m  pass large bodies in memfds where the client supports it\n"
+		"  -c  use CBOR framing on every connection\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	long iterations = 20000;
+	long proc_iterations = 200;
+	const char *filter = NULL;
+	char sock_path[64];
+	struct mock_configd m;
+	int opt;
+
+	memset(&m, 0, sizeof(m));
+	m.str_len = 256;
+	m.elems = 8;
+	while ((opt = getopt(argc, argv, "n:p:s:e:l:f:mch")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atol(optarg);
+			break;
+		case 'p':
+			proc_iterations = atol(optarg);
+			break;
+		case 's':
+			m.str_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			m.elems = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			m.latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 'm':
+			m.memfd = 1;
+			break;
+		case 'c':
+			m.cbor = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (iterations < 1 || proc_iterations < 1)
+		usage(argv[0]);
+
+	snprintf(sock_path, sizeof(sock_path), "/tmp/mock-configd.%d.sock", getpid());
+	m.sock_path = sock_path;
+	if (mock_configd_start(&m) < 0) {
+		perror("mock configd");
+		return EXIT_FAILURE;
+	}
+	setenv("VYATTA_CONFIG_SID", "bench", 1);
+	/* picked up by every connection, including those of cli-shell-api */
+	if (m.cbor)
+		setenv("VYATTA_CONFIG_CBOR", "1", 1);
+
+	if (configd_open_connection(&conn) < 0) {
+		perror("configd_open_connection");
+		mock_configd_stop(&m);
+		return EXIT_FAILURE;
+	}
+	configd_set_session_id(&conn, "bench");
+	if (m.cbor && configd_conn_cbor_enable(&conn) != 1) {
+		fprintf(stderr, "CBOR framing not available\n");
+		configd_close_connection(&conn);
+		mock_configd_stop(&m);
+		return EXIT_FAILURE;
+	}
+	if (m.memfd && configd_conn_memfd_enable(&conn) != 1) {
+		fprintf(stderr, "memfd transport not available\n");
+		configd_close_connection(&conn);
+		mock_configd_stop(&m);
+		return EXIT_FAILURE;
+	}
+	null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	config_body.assign(m.str_len, 'x');
+
+	printf("string results %zu bytes, %zu elements per vector/map, %u us latency%s%s\n\n",
+	       m.str_len, m.elems, m.latency_us, m.memfd ? ", memfd transport" : "",
+	       m.cbor ? ", CBOR framing" : "");
+	printf("%-14s %-30s %10s %9s %9s %11s %11s\n", "api", "operation",
+	       "ops/sec", "p50 us", "p99 us", "bytes/call", "allocs/call");
+	{
+		CfgClient client;
+		cstore::Cstore cstore;
+		std::vector<bench_op> ops = make_ops(client, cstore);
+
+		for (size_t i = 0; i < ops.size(); i++) {
+			if (filter && !strstr(ops[i].api, filter)
+			    && !strstr(ops[i].name, filter))
+				continue;
+			run_op(ops[i], ops[i].spawns ? proc_iterations : iterations, &m);
+		}
+	}
+
+	configd_close_connection(&conn);
+	close(null_fd);
+	mock_configd_stop(&m);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+
+	Microbenchmark for expand_string() on large node scripts with many
+	$VAR() references. No configd is involved: var_ref_handle is left
+	unset so path references expand to nothing and $VAR(@) to the at
+	string, which leaves the cost of scanning and building exe_string.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/cli_cstore.h"
+
+int expand_string(const char *);
+const char *get_exe_string(void);
+
+static const char *sample_lines[] = {
+	"if [ -n \"$VAR(@)\" ]; then\n",
+	"    /opt/vyatta/sbin/vyatta-interfaces.pl --dev=$VAR(@) --check=dataplane\n",
+	"    echo \"address $VAR(./address/@@) mtu $VAR(./mtu/@)\" > /dev/null\n",
+	"fi\n",
+	"# plain comment line with a $ sign but no reference, costs $5\n",
+};
+
+static char *make_script(size_t lines)
+{
+	size_t n = sizeof(sample_lines) / sizeof(sample_lines[0]);
+	size_t len = 0, i;
+	char *script, *p;
+
+	for (i = 0; i < lines; i++)
+		len += strlen(sample_lines[i % n]);
+	script = malloc(len + 1);
+	if (!script)
+		return NULL;
+	for (i = 0, p = script; i < lines; i++)
+		p = stpcpy(p, sample_lines[i % n]);
+	return script;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	long iterations = (argc > 1) ? atol(argv[1]) : 20;
+	static const size_t sizes[] = { 100, 1000, 10000, 100000 };
+	char at_string[] = "dp0p1s1";
+	size_t s;
+
+	set_at_string(at_string);
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		char *script = make_script(sizes[s]);
+		size_t in = strlen(script), out = 0;
+		double start, elapsed;
+		long i;
+
+		if (!script) {
+			perror("malloc");
+			return EXIT_FAILURE;
+		}
+		start = now();
+		for (i = 0; i < iterations; i++) {
+			if (expand_string(script) != 0) {
+				fprintf(stderr, "expand_string failed\n");
+				return EXIT_FAILURE;
+			}
+			out = strlen(get_exe_string());
+		}
+		elapsed = (now() - start) / iterations;
+		printf("%7zu lines %9zu bytes -> %9zu bytes %10.1f us %8.1f MB/s\n",
+		       sizes[s], in, out, elapsed * 1e6, in / elapsed / 1e6);
+		free(script);
+	}
+	return EXIT_SUCCESS;
+}
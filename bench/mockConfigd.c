@@ -0,0 +1,438 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "internal.h"
+#include "mockConfigd.h"
+
+enum mock_kind {
+	MOCK_INT,
+	MOCK_STR,
+	MOCK_TREE,	/* a string holding a JSON encoded tree */
+	MOCK_VECTOR,
+	MOCK_MAP,
+	MOCK_TMPL,	/* a map that looks like a template */
+	MOCK_FEATURES,
+	MOCK_NKINDS
+};
+
+/* Result type of each method, as the client library reads it */
+static const struct {
+	const char *method;
+	enum mock_kind kind;
+} methods[] = {
+	{ "AuthAuthorize", MOCK_INT },
+	{ "AuthGetPerms", MOCK_MAP },
+	{ "CallRpc", MOCK_STR },
+	{ "CancelCommit", MOCK_STR },
+	{ "Comment", MOCK_INT },
+	{ "Commit", MOCK_STR },
+	{ "ConfirmedCommit", MOCK_STR },
+	{ "Copy", MOCK_STR },
+	{ "CopyConfig", MOCK_STR },
+	{ "Delete", MOCK_INT },
+	{ "Discard", MOCK_INT },
+	{ "EditConfigXML", MOCK_STR },
+	{ "Exists", MOCK_INT },
+	{ "Get", MOCK_VECTOR },
+	{ "GetFeatures", MOCK_FEATURES },
+	{ "GetHelp", MOCK_MAP },
+	{ "GetSchemas", MOCK_STR },
+	{ "Load", MOCK_INT },
+	{ "LoadReportWarnings", MOCK_INT },
+	{ "MergeReportWarnings", MOCK_INT },
+	{ "MigrateConfigFile", MOCK_STR },
+	{ "NodeGetComment", MOCK_STR },
+	{ "NodeGetStatus", MOCK_INT },
+	{ "NodeGetType", MOCK_INT },
+	{ "NodeIsDefault", MOCK_INT },
+	{ "ReadConfigFile", MOCK_STR },
+	{ "Rename", MOCK_STR },
+	{ "Save", MOCK_INT },
+	{ "SchemaGet", MOCK_STR },
+	{ "SessionChanged", MOCK_INT },
+	{ "SessionExists", MOCK_INT },
+	{ "SessionLock", MOCK_INT },
+	{ "SessionLocked", MOCK_INT },
+	{ "SessionMarkSaved", MOCK_INT },
+	{ "SessionMarkUnsaved", MOCK_INT },
+	{ "SessionSaved", MOCK_INT },
+	{ "SessionSetup", MOCK_INT },
+	{ "SessionSetupShared", MOCK_INT },
+	{ "SessionTeardown", MOCK_INT },
+	{ "SessionUnlock", MOCK_INT },
+	{ "Set", MOCK_STR },
+	{ "SetFraming", MOCK_INT },
+	{ "Show", MOCK_STR },
+	{ "ShowDefaults", MOCK_STR },
+	{ "TmplGet", MOCK_TMPL },
+	{ "TmplGetAllowed", MOCK_VECTOR },
+	{ "TmplGetChildren", MOCK_VECTOR },
+	{ "TmplValidatePath", MOCK_INT },
+	{ "TmplValidateValues", MOCK_INT },
+	{ "TreeGet", MOCK_TREE },
+	{ "TreeGetFull", MOCK_TREE },
+	{ "Validate", MOCK_STR },
+	{ "ValidateConfig", MOCK_STR },
+	{ "ValidatePath", MOCK_STR },
+};
+
+static json_t *results[MOCK_NKINDS];
+
+static void build_results(const struct mock_configd *m)
+{
+	char *str, *tree;
+	size_t i, len;
+
+	results[MOCK_INT] = json_integer(1);
+
+	str = malloc(m->str_len + 1);
+	memset(str, 'x', m->str_len);
+	str[m->str_len] = '\0';
+	results[MOCK_STR] = json_string(str);
+	free(str);
+
+	/* short entries until the text is at least str_len long */
+	tree = malloc(m->str_len + 128);
+	len = sprintf(tree, "{\"interfaces\":{\"dataplane\":[");
+	for (i = 0; len < m->str_len || i == 0; i++)
+		len += sprintf(tree + len, "%s{\"tagnode\":\"dp0p%zus1\",\"mtu\":1500}",
+			       i ? "," : "", i);
+	sprintf(tree + len, "]}}");
+	results[MOCK_TREE] = json_string(tree);
+	free(tree);
+
+	results[MOCK_VECTOR] = json_array();
+	results[MOCK_MAP] = json_object();
+	results[MOCK_FEATURES] = json_object();
+	if (m->memfd)
+		json_object_set_new(results[MOCK_FEATURES], "memfd-transport",
+				    json_string("1"));
+	if (m->cbor)
+		json_object_set_new(results[MOCK_FEATURES], "cbor-framing",
+				    json_string("1"));
+	results[MOCK_TMPL] = json_pack("{s:s, s:s, s:s, s:s}",
+				       "type", "txt", "tag", "1",
+				       "is_value", "1", "help", "Mock node");
+	for (i = 0; i < m->elems; i++) {
+		char key[32], val[32];
+
+		snprintf(key, sizeof(key), "key%zu", i);
+		snprintf(val, sizeof(val), "value%zu", i);
+		json_array_append_new(results[MOCK_VECTOR], json_string(val));
+		json_object_set_new(results[MOCK_MAP], key, json_string(val));
+		json_object_set_new(results[MOCK_FEATURES], key, json_string(val));
+		json_object_set_new(results[MOCK_TMPL], key, json_string(val));
+	}
+}
+
+static json_t *lookup_result(const char *method)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+		if (strcmp(methods[i].method, method) == 0)
+			return results[methods[i].kind];
+	}
+	return NULL;
+}
+
+#define MAX_FDS 8
+
+/* Reads through this count towards bytes_in. Descriptors passed with
+ * the memfd transport are kept until the request using them is seen.
+ */
+struct counting_fd {
+	int fd;
+	struct mock_configd_stats *stats;
+	int nfds;
+	int fds[MAX_FDS];
+};
+
+static ssize_t counting_read(void *cookie, char *buf, size_t size)
+{
+	struct counting_fd *c = cookie;
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * MAX_FDS)];
+		struct cmsghdr align;
+	} ctl;
+	struct iovec iov = { .iov_base = buf, .iov_len = size };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctl.buf,
+		.msg_controllen = sizeof(ctl.buf),
+	};
+	struct cmsghdr *cmsg;
+	ssize_t n = recvmsg(c->fd, &msg, 0);
+	int i, *fds;
+
+	if (n > 0)
+		__atomic_add_fetch(&c->stats->bytes_in, n, __ATOMIC_RELAXED);
+	for (cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		fds = (int *)CMSG_DATA(cmsg);
+		for (i = 0; CMSG_LEN(sizeof(int) * (i + 1)) <= cmsg->cmsg_len; i++) {
+			if (c->nfds < MAX_FDS)
+				c->fds[c->nfds++] = fds[i];
+			else
+				close(fds[i]);
+		}
+	}
+	return n;
+}
+
+/* Take the bodies of parameters sent in memfds, counting them as read */
+static void take_memfds(struct counting_fd *c, json_t *jmemfd)
+{
+	json_t *params = json_object_get(jmemfd, "params");
+	struct stat st;
+	size_t i;
+
+	for (i = 0; i < json_array_size(params) && c->nfds; i++) {
+		if (fstat(c->fds[0], &st) == 0)
+			__atomic_add_fetch(&c->stats->bytes_in, st.st_size,
+					   __ATOMIC_RELAXED);
+		close(c->fds[0]);
+		memmove(c->fds, c->fds + 1, --c->nfds * sizeof(int));
+	}
+}
+
+static int body_memfd(const char *body, size_t len)
+{
+	int fd = memfd_create("mock", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+	if (fd < 0)
+		return -1;
+	if (write(fd, body, len) != (ssize_t)len
+	    || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW
+		     | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int send_with_fd(int sock, const char *buf, size_t len, int fd)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} ctl;
+	struct iovec iov = { .iov_base = (void *)buf, .iov_len = len };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctl.buf,
+		.msg_controllen = sizeof(ctl.buf),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	ssize_t n;
+
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	n = sendmsg(sock, &msg, 0);
+	return n < 0 ? -1 : (int)n;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void serve_conn(int fd, const struct mock_configd *m)
+{
+	struct counting_fd cookie = { .fd = fd, .stats = m->stats };
+	cookie_io_functions_t io = { .read = counting_read };
+	FILE *fp = fopencookie(&cookie, "r", io);
+	json_error_t jerr;
+	int framed = 0;
+
+	if (!fp)
+		return;
+
+	for (;;) {
+		json_t *jreq, *jresp, *result, *jmemfd;
+		const char *method = NULL;
+		json_int_t id = 0, accept = -1;
+		int body_fd = -1, set_framing;
+		size_t len, sent = 0;
+		char *out;
+
+		if (framed)
+			jreq = frame_loadf(fp, &jerr);
+		else
+			jreq = json_loadf(fp, JSON_DISABLE_EOF_CHECK, &jerr);
+		if (!jreq)
+			break;
+		json_unpack(jreq, "{s:s, s:I}", "method", &method, "id", &id);
+		/* the reply to SetFraming still goes out as JSON */
+		set_framing = m->cbor && method
+			&& strcmp(method, "SetFraming") == 0;
+		jmemfd = json_object_get(jreq, "memfd");
+		if (jmemfd) {
+			take_memfds(&cookie, jmemfd);
+			json_unpack(jmemfd, "{s:I}", "accept", &accept);
+		}
+
+		result = method ? lookup_result(method) : NULL;
+		if (json_is_string(result) && accept >= 0
+		    && json_string_length(result) >= (size_t)accept) {
+			/* the body is counted as written along with the rest */
+			body_fd = body_memfd(json_string_value(result),
+					     json_string_length(result));
+			__atomic_add_fetch(&m->stats->bytes_out,
+					   json_string_length(result),
+					   __ATOMIC_RELAXED);
+			jresp = json_pack("{s:n, s:I, s:I}", "result", "memfd",
+					  (json_int_t)json_string_length(result),
+					  "id", id);
+		} else if (result) {
+			jresp = json_pack("{s:O, s:I}", "result", result, "id", id);
+		} else {
+			jresp = json_pack("{s:s, s:I}",
+					  "error", "unsupported method", "id", id);
+		}
+		json_decref(jreq);
+
+		if (framed)
+			out = frame_dumps(jresp, &len);
+		else if ((out = json_dumps(jresp, JSON_COMPACT)))
+			len = strlen(out);
+		json_decref(jresp);
+		if (!out)
+			break;
+		if (m->latency_us)
+			usleep(m->latency_us);
+		/* count before replying so the client never sees a stale total */
+		__atomic_add_fetch(&m->stats->bytes_out, len, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&m->stats->requests, 1, __ATOMIC_RELAXED);
+		if (body_fd >= 0) {
+			int n = send_with_fd(fd, out, len, body_fd);
+
+			close(body_fd);
+			if (n < 0) {
+				free(out);
+				break;
+			}
+			sent = n;
+		}
+		if (write_all(fd, out + sent, len - sent) < 0) {
+			free(out);
+			break;
+		}
+		free(out);
+		if (set_framing)
+			framed = 1;
+	}
+	while (cookie.nfds)
+		close(cookie.fds[--cookie.nfds]);
+	fclose(fp);
+}
+
+static void serve(int lfd, const struct mock_configd *m)
+{
+	/* one process per connection so that clients holding a connection
+	 * open do not block others; don't leave zombies behind */
+	signal(SIGCHLD, SIG_IGN);
+	build_results(m);
+
+	for (;;) {
+		int fd = accept(lfd, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			_exit(EXIT_FAILURE);
+		}
+		switch (fork()) {
+		case 0:
+			close(lfd);
+			serve_conn(fd, m);
+			_exit(EXIT_SUCCESS);
+		default:
+			close(fd);
+			break;
+		}
+	}
+}
+
+int mock_configd_start(struct mock_configd *m)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int lfd;
+
+	m->stats = mmap(NULL, sizeof(*m->stats), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (m->stats == MAP_FAILED)
+		return -1;
+	memset(m->stats, 0, sizeof(*m->stats));
+
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", m->sock_path);
+	unlink(addr.sun_path);
+	lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (lfd < 0)
+		return -1;
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+	    || listen(lfd, 16) < 0) {
+		close(lfd);
+		return -1;
+	}
+
+	fflush(NULL);
+	m->pid = fork();
+	if (m->pid < 0) {
+		close(lfd);
+		return -1;
+	}
+	if (m->pid == 0)
+		serve(lfd, m); /* does not return */
+
+	close(lfd);
+	return setenv("VYATTA_CONFIG_SOCKET", m->sock_path, 1);
+}
+
+void mock_configd_stop(struct mock_configd *m)
+{
+	if (m->pid > 0) {
+		kill(m->pid, SIGTERM);
+		waitpid(m->pid, NULL, 0);
+		m->pid = 0;
+	}
+	unlink(m->sock_path);
+	if (m->stats && m->stats != MAP_FAILED)
+		munmap(m->stats, sizeof(*m->stats));
+	m->stats = NULL;
+}
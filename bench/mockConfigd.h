@@ -0,0 +1,55 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+
+	A stand-in for configd that answers every client request with a
+	canned response of the type the client library expects for that
+	method. It runs in a child process so its own work does not show up
+	in the measurements of the client under test.
+*/
+
+#ifndef MOCK_CONFIGD_H
+#define MOCK_CONFIGD_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Counters shared with the server process */
+struct mock_configd_stats {
+	unsigned long long requests;
+	unsigned long long bytes_in;	/* request bytes read by the server */
+	unsigned long long bytes_out;	/* response bytes written by it */
+};
+
+struct mock_configd {
+	/* Filled in by the caller */
+	const char *sock_path;
+	unsigned int latency_us;	/* delay before each response */
+	size_t str_len;			/* length of string results */
+	size_t elems;			/* entries in vector and map results */
+	int memfd;			/* offer the memfd transport */
+	int cbor;			/* offer binary framing */
+
+	/* Filled in by mock_configd_start() */
+	pid_t pid;
+	struct mock_configd_stats *stats;
+};
+
+/*
+ * Start serving on m->sock_path and point VYATTA_CONFIG_SOCKET at it so
+ * that subsequent client connections, including those of child
+ * processes, reach the mock. Returns 0 on success, -1 with errno set.
+ */
+int mock_configd_start(struct mock_configd *m);
+void mock_configd_stop(struct mock_configd *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MOCK_CONFIGD_H */
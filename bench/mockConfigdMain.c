@@ -0,0 +1,79 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+
+	Runs the mock configd on its own, for benchmarks of clients that
+	are not written in C. It prints "ready" once clients can connect and
+	serves until it is sent SIGTERM or SIGINT.
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mockConfigd.h"
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-s string-bytes] [-e elements] [-l latency-us] [-m] [-c]\n"
+		"       socket-path\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	struct mock_configd m;
+	sigset_t set;
+	int opt, sig;
+
+	memset(&m, 0, sizeof(m));
+	m.str_len = 256;
+	m.elems = 8;
+	while ((opt = getopt(argc, argv, "s:e:l:mch")) != -1) {
+		switch (opt) {
+		case 's':
+			m.str_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			m.elems = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			m.latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			m.memfd = 1;
+			break;
+		case 'c':
+			m.cbor = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+	m.sock_path = argv[optind];
+
+	if (mock_configd_start(&m) < 0) {
+		perror("mock configd");
+		return EXIT_FAILURE;
+	}
+
+	/* only now, as the server would inherit the mask */
+	sigemptyset(&set);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGINT);
+	sigprocmask(SIG_BLOCK, &set, NULL);
+
+	printf("ready\n");
+	fflush(stdout);
+	sigwait(&set, &sig);
+
+	fprintf(stderr, "mock configd: %llu requests\n", m.stats->requests);
+	mock_configd_stop(&m);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+
+	Microbenchmark for building configd paths from component vectors,
+	comparing the previous per-component uriEscapeA approach with the
+	single pass encoder in path.c.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <uriparser/Uri.h>
+
+#include "path.h"
+
+#define URI_MULT 6
+
+typedef std::vector<std::string> StringVector;
+
+static const char *sample_paths[] = {
+	"interfaces dataplane dp0s3 address 10.0.0.1/24",
+	"interfaces dataplane dp0p1s1 vif 100 ip ospf cost 10",
+	"protocols bgp 65000 neighbor 2001:db8::1 address-family ipv6-unicast prefix-list import FROM-PEER",
+	"security firewall name OUTSIDE-IN rule 10 description allow-ssh-from-mgmt",
+	"service snmp community public authorization ro",
+	"system login user vyatta authentication encrypted-password $6$abc/def.ghi$jkl",
+	"policy route pbr POLICY rule 20 source address 192.0.2.0/24",
+	"resources group address-group MGMT address 198.51.100.17",
+};
+
+/* what CfgClient::mkpath() and Cstore::strVecToChar() used to do */
+static std::string legacy_mkpath(const StringVector &cfgpath)
+{
+	std::string path("/");
+	for (size_t i = 0; i < cfgpath.size(); ++i) {
+		if (i) {
+			path += "/";
+		}
+		char *out = new char[cfgpath[i].length() * URI_MULT + 1];
+		uriEscapeA(cfgpath[i].c_str(), out, URI_FALSE, URI_TRUE);
+		path += out;
+		delete[] out;
+	}
+	return path;
+}
+
+static std::string encoder_mkpath(const StringVector &cfgpath)
+{
+	size_t len = 1;
+	for (size_t i = 0; i < cfgpath.size(); ++i) {
+		len += (i ? 1 : 0)
+			+ configd_path_escape_len(cfgpath[i].data(), cfgpath[i].length());
+	}
+
+	std::string path(len, '/');
+	char *p = &path[1];
+	for (size_t i = 0; i < cfgpath.size(); ++i) {
+		if (i) {
+			p++;
+		}
+		p = configd_path_escape(p, cfgpath[i].data(), cfgpath[i].length());
+	}
+	return path;
+}
+
+static StringVector split(const char *s)
+{
+	StringVector v;
+	std::string str(s);
+	size_t start = 0, pos;
+	while ((pos = str.find(' ', start)) != std::string::npos) {
+		v.push_back(str.substr(start, pos - start));
+		start = pos + 1;
+	}
+	v.push_back(str.substr(start));
+	return v;
+}
+
+typedef std::string (*mkpath_fn)(const StringVector &);
+
+static double run(const char *name, mkpath_fn fn,
+		  const std::vector<StringVector> &paths, long iterations)
+{
+	size_t bytes = 0;
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	for (long i = 0; i < iterations; i++) {
+		bytes += fn(paths[i % paths.size()]).length();
+	}
+	std::chrono::duration<double, std::nano> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	double ns = elapsed.count() / iterations;
+	printf("%-10s %10.1f ns/path %12.0f paths/sec (%zu bytes)\n",
+	       name, ns, 1e9 / ns, bytes);
+	return ns;
+}
+
+int main(int argc, char **argv)
+{
+	long iterations = (argc > 1) ? atol(argv[1]) : 1000000;
+	std::vector<StringVector> paths;
+
+	for (size_t i = 0; i < sizeof(sample_paths) / sizeof(sample_paths[0]); i++) {
+		paths.push_back(split(sample_paths[i]));
+		if (legacy_mkpath(paths.back()) != encoder_mkpath(paths.back())) {
+			fprintf(stderr, "encoding mismatch for '%s'\n", sample_paths[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	double legacy = run("uriEscapeA", legacy_mkpath, paths, iterations);
+	double encoder = run("encoder", encoder_mkpath, paths, iterations);
+	printf("speedup    %10.2fx\n", legacy / encoder);
+	return EXIT_SUCCESS;
+}
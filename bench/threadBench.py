@@ -0,0 +1,117 @@
+#!/usr/bin/python3
+# Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+#
+# SPDX-License-Identifier: GPL-2.0-only
+
+# Thread scaling of the Python configd binding, against the mock configd
+# so that no running configd is needed. Each thread makes calls as fast
+# as it can for a while. Meanwhile a pure Python thread counts, to show
+# whether it still gets to run while the others wait on configd.
+#
+# With the GIL released during calls, calls/sec rises with the number of
+# threads until the mock runs out of CPUs, and the counter keeps going.
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+
+def load_configd(module_dir, tmpdir):
+    # The build tree has configd.py and libtool's library, which Python
+    # only finds under the name it will have once installed.
+    so = os.path.join(module_dir, "_configd.so")
+    if not os.path.exists(so):
+        so = os.path.join(module_dir, ".libs", "libCfgClient.so")
+    os.symlink(os.path.abspath(so), os.path.join(tmpdir, "_configd.so"))
+    os.symlink(os.path.abspath(os.path.join(module_dir, "configd.py")),
+               os.path.join(tmpdir, "configd.py"))
+    sys.path.insert(0, tmpdir)
+    import configd
+    return configd
+
+
+def run(configd, nthreads, seconds, shared, method):
+    if shared:
+        clients = [configd.Client()] * nthreads
+    else:
+        clients = [configd.Client(False) for i in range(nthreads)]
+    calls = [0] * nthreads
+    ticks = [0]
+    stop = threading.Event()
+
+    def caller(i):
+        call = getattr(clients[i], method)
+        while not stop.is_set():
+            call(clients[i].RUNNING, ["interfaces"])
+            calls[i] += 1
+
+    def counter():
+        while not stop.is_set():
+            ticks[0] += 1
+
+    threads = [threading.Thread(target=caller, args=(i,))
+               for i in range(nthreads)]
+    threads.append(threading.Thread(target=counter))
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    time.sleep(seconds)
+    stop.set()
+    for t in threads:
+        t.join()
+    elapsed = time.monotonic() - start
+    return sum(calls) / elapsed, ticks[0] / elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Thread scaling of the Python configd binding")
+    parser.add_argument("--mock", default="./mock_configd",
+                        help="mock configd program")
+    parser.add_argument("--module-dir",
+                        default="../src/client/python3",
+                        help="directory holding the built configd module")
+    parser.add_argument("--threads", default="1,2,4,8",
+                        help="comma separated thread counts")
+    parser.add_argument("--seconds", type=float, default=2.0)
+    parser.add_argument("--latency-us", type=int, default=1000,
+                        help="delay before each mock response")
+    parser.add_argument("--method", default="tree_get",
+                        help="Client method taking (database, path)")
+    parser.add_argument("--shared", action="store_true",
+                        help="all threads use one Client")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        sock = os.path.join(tmpdir, "configd.sock")
+        mock = subprocess.Popen([args.mock, "-l", str(args.latency_us), sock],
+                                stdout=subprocess.PIPE)
+        try:
+            if mock.stdout.readline().strip() != b"ready":
+                sys.exit("mock configd failed to start")
+            os.environ["VYATTA_CONFIG_SOCKET"] = sock
+            configd = load_configd(args.module_dir, tmpdir)
+
+            print("%s, %d us latency, %s\n" % (
+                args.method, args.latency_us,
+                "one shared client" if args.shared else "client per thread"))
+            print("%8s %12s %8s %14s" % (
+                "threads", "calls/sec", "speedup", "counter/sec"))
+            base = None
+            for n in [int(t) for t in args.threads.split(",")]:
+                rate, ticks = run(configd, n, args.seconds, args.shared,
+                                  args.method)
+                base = base or rate
+                print("%8d %12.0f %7.1fx %14.0f" % (n, rate, rate / base,
+                                                     ticks))
+        finally:
+            mock.terminate()
+            mock.wait()
+
+
+if __name__ == "__main__":
+    main()
@@ -10,6 +10,7 @@
 #include "CppUTest/TestHarness_c.h"
 #include "CppUTestExt/MockSupport_c.h"
 #include <string.h>
+#include <unistd.h>
 
 #include "common_mocks.h"
 #include "log.h"
@@ -44,11 +45,35 @@ void set_incoming_rpc_json(json_t *incoming) {
     incoming_rpc = incoming;
 }
 
+// Responses to pipelined requests, returned in turn before incoming_rpc.
+static json_t *queued_rpcs[256];
+static int queued, dequeued;
+
+void queue_incoming_rpc_json(json_t *incoming) {
+    if (dequeued == queued)
+        queued = dequeued = 0;
+    queued_rpcs[queued++] = incoming;
+}
+
 json_t *__wrap_json_loadf(FILE *input, size_t flags, json_error_t *error) {
+    if (dequeued < queued)
+        return queued_rpcs[dequeued++];
     return incoming_rpc;
 }
 
-int __wrap_write(FILE *output, char *jstr, size_t jlen) {
+// Writes to this fd go through, so that output streamed to a file can be
+// checked.  Anything else (ie requests) is dropped.
+static int passthrough_fd = -1;
+
+void set_write_passthrough_fd(int fd) {
+    passthrough_fd = fd;
+}
+
+ssize_t __real_write(int fd, const void *buf, size_t len);
+
+ssize_t __wrap_write(int fd, const void *buf, size_t len) {
+    if (fd >= 0 && fd == passthrough_fd)
+        return __real_write(fd, buf, len);
     return 0;
 }
 
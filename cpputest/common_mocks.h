@@ -15,5 +15,7 @@
 #include <jansson.h>
 
 void set_incoming_rpc_json(json_t *incoming);
+void queue_incoming_rpc_json(json_t *incoming);
+void set_write_passthrough_fd(int fd);
 
 #endif
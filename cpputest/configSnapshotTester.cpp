@@ -0,0 +1,288 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+*/
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "ConfigSnapshot.hpp"
+
+extern "C"
+{
+#include "common_mocks.h"
+}
+
+// node.c's completion support isn't built into this test
+extern "C" char *getCompletionEnv(struct configd_conn *, const char *)
+{
+	return NULL;
+}
+
+#define TREE \
+	"{\"interfaces\":{\"dataplane\":[" \
+	"{\"tagnode\":\"dp0s4\",\"mtu\":1500,\"address\":[\"dhcp\"]}," \
+	"{\"tagnode\":\"dp0s3\",\"mtu\":9000,\"disable\":null," \
+	"\"address\":[\"10.0.0.2/24\",\"10.0.0.1/24\"]}]," \
+	"\"loopback\":[{\"tagnode\":\"lo\",\"mtu\":65536}]}}"
+
+// As TREE without the defaults: the loopback and the mtu of dp0s4
+#define EXPLICIT_TREE \
+	"{\"interfaces\":{\"dataplane\":[" \
+	"{\"tagnode\":\"dp0s4\",\"address\":[\"dhcp\"]}," \
+	"{\"tagnode\":\"dp0s3\",\"mtu\":9000,\"disable\":null," \
+	"\"address\":[\"10.0.0.2/24\",\"10.0.0.1/24\"]}]}}"
+
+static std::vector<std::string> path(const char *p)
+{
+	std::vector<std::string> out;
+	std::string s(p);
+	size_t start = 0, end;
+
+	while ((end = s.find(' ', start)) != std::string::npos) {
+		out.push_back(s.substr(start, end - start));
+		start = end + 1;
+	}
+	if (start < s.size())
+		out.push_back(s.substr(start));
+	return out;
+}
+
+// The snapshot is read over a connection to a socket nobody answers:
+// requests are dropped by the write mock and responses are queued for
+// json_loadf.
+TEST_GROUP(Snapshot)
+{
+	char dir[32];
+	std::string sock;
+	int listener;
+	int id;
+	CfgClient *client;
+
+	void setup()
+	{
+		struct sockaddr_un addr;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(dir, "/tmp/configdXXXXXX");
+		CHECK(mkdtemp(dir));
+		sock = std::string(dir) + "/sock";
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock.c_str());
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		CHECK(listener >= 0);
+		CHECK(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+		CHECK(listen(listener, 1) == 0);
+		setenv("VYATTA_CONFIG_SOCKET", sock.c_str(), 1);
+		unsetenv("VYATTA_CONFIG_SID");
+
+		client = new CfgClient();
+		id = 0;
+	}
+
+	void teardown()
+	{
+		delete client;
+		close(listener);
+		unlink(sock.c_str());
+		rmdir(dir);
+		unsetenv("VYATTA_CONFIG_SOCKET");
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	// The trees with and without defaults, in the order requested
+	void respond(const char *tree, const char *explicitTree)
+	{
+		queue_incoming_rpc_json(json_pack(
+			"{sssnsi}", "result", tree, "error", "id", ++id));
+		queue_incoming_rpc_json(json_pack(
+			"{sssnsi}", "result", explicitTree, "error", "id", ++id));
+	}
+};
+
+TEST(Snapshot, children_are_sorted)
+{
+	respond(TREE, EXPLICIT_TREE);
+	ConfigSnapshot snap(*client, CfgClient::RUNNING, path("interfaces"));
+
+	std::vector<std::string> kids = snap.Children(path("interfaces"));
+	LONGS_EQUAL(2, kids.size());
+	STRCMP_EQUAL("dataplane", kids[0].c_str());
+	STRCMP_EQUAL("loopback", kids[1].c_str());
+
+	kids = snap.Children(path("interfaces dataplane"));
+	LONGS_EQUAL(2, kids.size());
+	STRCMP_EQUAL("dp0s3", kids[0].c_str());
+	STRCMP_EQUAL("dp0s4", kids[1].c_str());
+}
+
+TEST(Snapshot, tagnode_is_not_a_child)
+{
+	respond(TREE, EXPLICIT_TREE);
+	ConfigSnapshot snap(*client, CfgClient::RUNNING, path("interfaces"));
+
+	std::vector<std::string> kids = snap.Children(path("interfaces dataplane dp0s3"));
+	LONGS_EQUAL(3, kids.size());
+	STRCMP_EQUAL("address", kids[0].c_str());
+	STRCMP_EQUAL("disable", kids[1].c_str());
+	STRCMP_EQUAL("mtu", kids[2].c_str());
+	CHECK_FALSE(snap.Exists(path("interfaces dataplane dp0s3 tagnode")));
+}
+
+TEST(Snapshot, leaf_values)
+{
+	respond(TREE, EXPLICIT_TREE);
+	ConfigSnapshot snap(*client, CfgClient::RUNNING, path("interfaces"));
+
+	STRCMP_EQUAL("9000", snap.Get(path("interfaces dataplane dp0s3 mtu")).c_str());
+	CHECK(snap.Exists(path("interfaces dataplane dp0s3 mtu 9000")));
+
+	std::vector<std::string> addrs = snap.Children(path("interfaces dataplane dp0s3 address"));
+	LONGS_EQUAL(2, addrs.size());
+	STRCMP_EQUAL("10.0.0.2/24", addrs[0].c_str());
+	STRCMP_EQUAL("10.0.0.1/24", addrs[1].c_str());
+
+	// An empty leaf exists, with no value
+	CHECK(snap.Exists(path("interfaces dataplane dp0s3 disable")));
+	LONGS_EQUAL(0, snap.Children(path("interfaces dataplane dp0s3 disable")).size());
+	STRCMP_EQUAL("", snap.Get(path("interfaces dataplane dp0s3 disable")).c_str());
+
+	// Not a leaf
+	STRCMP_EQUAL("", snap.Get(path("interfaces dataplane dp0s3")).c_str());
+}
+
+TEST(Snapshot, defaults_are_flagged)
+{
+	respond(TREE, EXPLICIT_TREE);
+	ConfigSnapshot snap(*client, CfgClient::RUNNING, path("interfaces"));
+
+	CHECK_FALSE(snap.IsDefault(path("interfaces dataplane dp0s3 mtu")));
+	CHECK_FALSE(snap.IsDefault(path("interfaces dataplane dp0s3 mtu 9000")));
+	CHECK(snap.IsDefault(path("interfaces dataplane dp0s4 mtu")));
+	CHECK(snap.IsDefault(path("interfaces dataplane dp0s4 mtu 1500")));
+	CHECK_FALSE(snap.IsDefault(path("interfaces dataplane dp0s4 address dhcp")));
+	CHECK(snap.IsDefault(path("interfaces loopback")));
+	CHECK(snap.IsDefault(path("interfaces loopback lo mtu")));
+	CHECK_FALSE(snap.IsDefault(path("interfaces dataplane")));
+	CHECK_FALSE(snap.IsDefault(path("interfaces nonexistent")));
+}
+
+TEST(Snapshot, default_leaf_list_values)
+{
+	respond("{\"ntp\":{\"server\":[\"a\",\"b\",\"c\"]}}",
+		"{\"ntp\":{\"server\":[\"b\"]}}");
+	ConfigSnapshot snap(*client, CfgClient::RUNNING, path("ntp"));
+
+	CHECK(snap.IsDefault(path("ntp server a")));
+	CHECK_FALSE(snap.IsDefault(path("ntp server b")));
+	CHECK(snap.IsDefault(path("ntp server c")));
+	STRCMP_EQUAL("a", snap.Get(path("ntp server")).c_str());
+}
+
+TEST(Snapshot, leaf_list_keeps_order)
+{
+	respond("{\"ntp\":{\"server\":[\"c\",\"a\",\"b\"]}}",
+		"{\"ntp\":{\"server\":[\"c\",\"a\",\"b\"]}}");
+	ConfigSnapshot snap(*client, CfgClient::RUNNING, path("ntp"));
+
+	std::vector<std::string> servers = snap.Children(path("ntp server"));
+	LONGS_EQUAL(3, servers.size());
+	STRCMP_EQUAL("c", servers[0].c_str());
+	STRCMP_EQUAL("a", servers[1].c_str());
+	STRCMP_EQUAL("b", servers[2].c_str());
+	STRCMP_EQUAL("c", snap.Get(path("ntp server")).c_str());
+
+	CHECK(snap.Exists(path("ntp server a")));
+	CHECK(snap.Exists(path("ntp server b")));
+	CHECK(snap.Exists(path("ntp server c")));
+	CHECK_FALSE(snap.Exists(path("ntp server d")));
+}
+
+TEST(Snapshot, paths_outside)
+{
+	respond(TREE, EXPLICIT_TREE);
+	ConfigSnapshot snap(*client, CfgClient::RUNNING, path("interfaces"));
+
+	CHECK(snap.Exists(path("interfaces")));
+	CHECK_FALSE(snap.Exists(path("system")));
+	CHECK_FALSE(snap.Exists(path("interfaces dataplane dp0s5")));
+	LONGS_EQUAL(0, snap.Children(path("system")).size());
+}
+
+// The tree of a list entry is rooted at the list, above the entry
+TEST(Snapshot, list_entry_drops_two)
+{
+	respond("{\"dataplane\":[{\"tagnode\":\"dp0s3\",\"mtu\":9000}]}",
+		"{\"dataplane\":[{\"tagnode\":\"dp0s3\",\"mtu\":9000}]}");
+	ConfigSnapshot snap(*client, CfgClient::RUNNING,
+			    path("interfaces dataplane dp0s3"));
+
+	CHECK(snap.Exists(path("interfaces dataplane dp0s3")));
+	STRCMP_EQUAL("9000", snap.Get(path("interfaces dataplane dp0s3 mtu")).c_str());
+	CHECK_FALSE(snap.Exists(path("interfaces dataplane dp0s4")));
+	CHECK_FALSE(snap.Exists(path("system")));
+	// dataplane, dp0s3, mtu and its value
+	LONGS_EQUAL(4, snap.Size());
+}
+
+TEST(Snapshot, container_drops_one)
+{
+	respond("{\"login\":{\"banner\":\"hello\"}}",
+		"{\"login\":{\"banner\":\"hello\"}}");
+	ConfigSnapshot snap(*client, CfgClient::RUNNING, path("system login"));
+
+	CHECK(snap.Exists(path("system login banner")));
+	STRCMP_EQUAL("hello", snap.Get(path("system login banner")).c_str());
+	CHECK_FALSE(snap.Exists(path("system host-name")));
+}
+
+TEST(Snapshot, empty)
+{
+	respond("{}", "{}");
+	ConfigSnapshot snap(*client, CfgClient::RUNNING, path("interfaces"));
+
+	CHECK_FALSE(snap.Exists(path("interfaces")));
+	LONGS_EQUAL(0, snap.Size());
+}
+
+TEST(Snapshot, error_throws)
+{
+	queue_incoming_rpc_json(json_pack(
+		"{sssnsi}", "result", TREE, "error", "id", ++id));
+	queue_incoming_rpc_json(json_pack(
+		"{snsssi}", "result", "error", "a message", "id", ++id));
+	bool thrown = false;
+
+	try {
+		ConfigSnapshot snap(*client, CfgClient::RUNNING, path("interfaces"));
+	} catch (const CfgClientException &e) {
+		thrown = true;
+		STRCMP_EQUAL("a message\n", e.what().c_str());
+	}
+	CHECK(thrown);
+}
+
+TEST(Snapshot, not_json_throws)
+{
+	respond(TREE, "{");
+	bool thrown = false;
+
+	try {
+		ConfigSnapshot snap(*client, CfgClient::RUNNING, path("interfaces"));
+	} catch (const CfgClientException &) {
+		thrown = true;
+	}
+	CHECK(thrown);
+}
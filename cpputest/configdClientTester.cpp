@@ -0,0 +1,310 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+*/
+
+// Built as C++17, as the users of ConfigdClient.hpp are, see Makefile.am.
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTestExt/MockSupport.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ConfigdClient.hpp"
+
+extern "C"
+{
+#include "common_mocks.h"
+}
+
+// node.c's completion support isn't built into this test
+extern "C" char *getCompletionEnv(struct configd_conn *, const char *)
+{
+	return NULL;
+}
+
+#define TEST_MESSAGE "a message"
+#define TEST_PATH "path/to/node"
+
+TEST_GROUP(Path)
+{
+};
+
+TEST(Path, elements_are_joined)
+{
+	configd::Path p{ "interfaces", "dataplane", "dp0s3" };
+
+	STRCMP_EQUAL("/interfaces/dataplane/dp0s3", p.c_str());
+}
+
+TEST(Path, elements_are_escaped)
+{
+	configd::Path p{ "system", "login", "banner", "a/b c%" };
+
+	STRCMP_EQUAL("/system/login/banner/a%2Fb%20c%25", p.c_str());
+}
+
+TEST(Path, empty_path_is_root)
+{
+	std::vector<std::string> none;
+	configd::Path p(none);
+
+	STRCMP_EQUAL("/", p.c_str());
+}
+
+TEST(Path, sequences_of_strings)
+{
+	std::vector<std::string> strs{ "a b", "c" };
+	std::list<std::string_view> views{ "a b", "c" };
+	const char *cstrs[] = { "a b", "c" };
+	configd::Path p1(strs), p2(views), p3(cstrs);
+
+	STRCMP_EQUAL("/a%20b/c", p1.c_str());
+	STRCMP_EQUAL("/a%20b/c", p2.c_str());
+	STRCMP_EQUAL("/a%20b/c", p3.c_str());
+	CHECK(p1.Encoded() == "/a%20b/c");
+}
+
+TEST_GROUP(Result)
+{
+};
+
+TEST(Result, value)
+{
+	configd::Result<std::string> r(std::string("value"));
+
+	CHECK(r.HasValue());
+	CHECK(bool(r));
+	STRCMP_EQUAL("value", r.Value().c_str());
+	std::string value = r.ValueOr("other");
+	STRCMP_EQUAL("value", value.c_str());
+	std::string moved = std::move(r).Value();
+	STRCMP_EQUAL("value", moved.c_str());
+}
+
+TEST(Result, error)
+{
+	configd::Result<std::string> r(configd::Error(TEST_MESSAGE));
+
+	CHECK_FALSE(r.HasValue());
+	CHECK_FALSE(bool(r));
+	STRCMP_EQUAL(TEST_MESSAGE, r.GetError().Message().c_str());
+	std::string other = r.ValueOr("other");
+	STRCMP_EQUAL("other", other.c_str());
+	LONGS_EQUAL(0, r.GetError().MgmtErrors().size());
+}
+
+TEST(Result, value_of_error_throws)
+{
+	const configd::Result<int> r(configd::Error(TEST_MESSAGE));
+	bool thrown = false;
+
+	try {
+		(void)r.Value();
+	} catch (const configd::Exception &e) {
+		thrown = true;
+		STRCMP_EQUAL(TEST_MESSAGE, e.what());
+		STRCMP_EQUAL(TEST_MESSAGE, e.GetError().Message().c_str());
+	}
+	CHECK(thrown);
+}
+
+// The calls are made on a connection to a socket nobody answers: requests
+// are dropped by the write mock and responses are queued for json_loadf.
+TEST_GROUP(Client)
+{
+	char dir[32];
+	std::string sock;
+	int listener;
+	int id;
+	std::optional<configd::Client> client;
+
+	void setup()
+	{
+		struct sockaddr_un addr = { AF_UNIX, {} };
+
+		strcpy(dir, "/tmp/configdXXXXXX");
+		CHECK(mkdtemp(dir));
+		sock = std::string(dir) + "/sock";
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock.c_str());
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		CHECK(listener >= 0);
+		CHECK(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+		CHECK(listen(listener, 1) == 0);
+		setenv("VYATTA_CONFIG_SOCKET", sock.c_str(), 1);
+		unsetenv("VYATTA_CONFIG_SID");
+
+		auto r = configd::Client::Connect();
+		CHECK(r.HasValue());
+		client.emplace(std::move(r).Value());
+		id = 0;
+	}
+
+	void teardown()
+	{
+		client.reset();
+		close(listener);
+		unlink(sock.c_str());
+		rmdir(dir);
+		unsetenv("VYATTA_CONFIG_SOCKET");
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	void respond(json_t *result)
+	{
+		queue_incoming_rpc_json(json_pack(
+			"{sosnsi}", "result", result, "error", "id", ++id));
+	}
+
+	void respond_error(const char *text)
+	{
+		queue_incoming_rpc_json(json_pack(
+			"{snsssi}", "result", "error", text, "id", ++id));
+	}
+
+	void respond_mgmt_error()
+	{
+		queue_incoming_rpc_json(json_pack(
+			"{snsns{s[{ssssssssss}]}si}",
+			"result",
+			"error",
+			"mgmterrorlist", "error-list",
+			"error-type", "application",
+			"error-severity", "error",
+			"error-tag", "invalid-value",
+			"error-message", TEST_MESSAGE,
+			"error-path", TEST_PATH,
+			"id", ++id));
+	}
+};
+
+TEST(Client, connect_fails)
+{
+	setenv("VYATTA_CONFIG_SOCKET", "/nonexistent/sock", 1);
+
+	auto r = configd::Client::Connect();
+	CHECK_FALSE(r.HasValue());
+	STRCMP_EQUAL("failed to connect to configd", r.GetError().Message().c_str());
+}
+
+TEST(Client, booleans)
+{
+	respond(json_integer(1));
+	respond(json_integer(0));
+	respond(json_integer(1));
+
+	configd::Path p{ "system", "host-name" };
+	CHECK(client->NodeExists(configd::Database::RUNNING, p).Value());
+	CHECK_FALSE(client->NodeExists(configd::Database::CANDIDATE, p).Value());
+	CHECK(client->NodeIsDefault(configd::Database::AUTO, p).Value());
+}
+
+TEST(Client, boolean_error)
+{
+	respond_error(TEST_MESSAGE);
+
+	auto r = client->NodeExists(configd::Database::RUNNING, { "system" });
+	CHECK_FALSE(r.HasValue());
+	STRCMP_CONTAINS(TEST_MESSAGE, r.GetError().Message().c_str());
+	bool thrown = false;
+	try {
+		(void)r.Value();
+	} catch (const configd::Exception &) {
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+TEST(Client, node_get)
+{
+	respond(json_pack("[sss]", "dp0s3", "dp0s4", "dp0s5"));
+
+	auto r = client->NodeGet(configd::Database::RUNNING,
+				 { "interfaces", "dataplane" });
+	CHECK(r.HasValue());
+	LONGS_EQUAL(3, r.Value().size());
+	STRCMP_EQUAL("dp0s3", r.Value()[0].c_str());
+	STRCMP_EQUAL("dp0s5", r.Value()[2].c_str());
+}
+
+TEST(Client, strings)
+{
+	respond(json_string("{\"system\":{}}"));
+	respond(json_string(""));
+	respond(json_string("committed"));
+
+	auto tree = client->TreeGet(configd::Database::RUNNING, { "system" });
+	auto set = client->Set({ "system", "host-name", "r1" });
+	auto commit = client->Commit("a comment");
+
+	STRCMP_EQUAL("{\"system\":{}}", tree.Value().c_str());
+	STRCMP_EQUAL("", set.Value().c_str());
+	STRCMP_EQUAL("committed", commit.Value().c_str());
+}
+
+TEST(Client, mgmt_error)
+{
+	respond_mgmt_error();
+
+	auto r = client->Set({ "system", "host-name", "r 1" });
+	CHECK_FALSE(r.HasValue());
+	STRCMP_EQUAL(TEST_MESSAGE, r.GetError().Message().c_str());
+	LONGS_EQUAL(1, r.GetError().MgmtErrors().size());
+	const configd::MgmtError &me = r.GetError().MgmtErrors()[0];
+	STRCMP_EQUAL("invalid-value", me.tag.c_str());
+	STRCMP_EQUAL("application", me.type.c_str());
+	STRCMP_EQUAL(TEST_PATH, me.path.c_str());
+	STRCMP_EQUAL(TEST_MESSAGE, me.message.c_str());
+}
+
+TEST(Client, set_many)
+{
+	respond(json_string(""));
+	respond_error(TEST_MESSAGE);
+	respond(json_string(""));
+
+	std::vector<configd::Path> paths{
+		{ "a" }, { "b" }, { "c" },
+	};
+	auto r = client->SetMany(paths);
+	CHECK(r.HasValue());
+	LONGS_EQUAL(3, r.Value().size());
+	STRCMP_EQUAL("", r.Value()[0].c_str());
+	STRCMP_CONTAINS(TEST_MESSAGE, r.Value()[1].c_str());
+	STRCMP_EQUAL("", r.Value()[2].c_str());
+}
+
+TEST(Client, delete_many_connection_lost)
+{
+	respond(json_integer(1));
+	queue_incoming_rpc_json(json_pack(
+		"{sisnsi}", "result", 1, "error", "id", 999));
+
+	std::vector<configd::Path> paths{
+		{ "a" }, { "b" },
+	};
+	auto r = client->DeleteMany(paths);
+	CHECK_FALSE(r.HasValue());
+	STRCMP_CONTAINS("Error receiving response", r.GetError().Message().c_str());
+}
+
+TEST(Client, moved)
+{
+	configd::Client other(std::move(*client));
+
+	respond(json_integer(1));
+	CHECK(other.NodeExists(configd::Database::RUNNING, { "system" }).Value());
+}
@@ -7,15 +7,24 @@
 #include "CppUTest/TestHarness.h"
 #include "CppUTestExt/MockSupport.h"
 
+#include <string>
+
 extern "C"
 {
+#include <fcntl.h>
 #include <netinet/ip.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <jansson.h>
 #include <string.h>
 
 #include <vyatta-util/map.h>
 #include <vyatta-util/vector.h>
 
+#include "async.h"
 #include "connect.h"
 #include "error.h"
 #include "rpc.h"
@@ -492,3 +501,876 @@ TEST(Error, handle_rpc_mgmt_error_fail)
 
 	LONGS_EQUAL(-1, get_int(&test_conn, &test_req, NULL));
 }
+
+TEST_GROUP(ConnStats)
+{
+	void setup()
+	{
+		memset(&test_conn, 0, sizeof(configd_conn));
+		test_conn.req_id = TEST_REQ_ID;
+	}
+
+	void teardown()
+	{
+		configd_close_connection(&test_conn);
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	int call(const char *fn)
+	{
+		struct request req = { fn, json_pack("{ss}", "key", "value") };
+
+		set_incoming_rpc_json(json_pack(
+			"{sisi}", "result", 1, "id", test_conn.req_id + 1));
+		return get_int(&test_conn, &req, NULL);
+	}
+
+	const struct configd_method_stats *method(const char *fn)
+	{
+		const struct configd_conn_stats *cs = configd_conn_stats(&test_conn);
+
+		for (size_t i = 0; cs && i < cs->num_methods; i++) {
+			if (strcmp(cs->methods[i].method, fn) == 0)
+				return &cs->methods[i];
+		}
+		return NULL;
+	}
+};
+
+TEST(ConnStats, disabled_by_default)
+{
+	LONGS_EQUAL(1, call("Exists"));
+	POINTERS_EQUAL(NULL, configd_conn_stats(&test_conn));
+}
+
+TEST(ConnStats, counts_per_method)
+{
+	LONGS_EQUAL(0, configd_conn_stats_enable(&test_conn));
+
+	LONGS_EQUAL(1, call("Exists"));
+	LONGS_EQUAL(1, call("Get"));
+	LONGS_EQUAL(1, call("Exists"));
+
+	const struct configd_conn_stats *cs = configd_conn_stats(&test_conn);
+	CHECK(cs != NULL);
+	LONGS_EQUAL(2, cs->num_methods);
+
+	const struct configd_method_stats *ms = method("Exists");
+	CHECK(ms != NULL);
+	LONGS_EQUAL(2, ms->calls);
+
+	unsigned long total = 0;
+	for (int i = 0; i < CONFIGD_STATS_BUCKETS; i++)
+		total += ms->hist[i];
+	LONGS_EQUAL(2, total);
+
+	ms = method("Get");
+	CHECK(ms != NULL);
+	LONGS_EQUAL(1, ms->calls);
+}
+
+TEST(ConnStats, enable_twice_keeps_counts)
+{
+	LONGS_EQUAL(0, configd_conn_stats_enable(&test_conn));
+	LONGS_EQUAL(1, call("Exists"));
+	LONGS_EQUAL(0, configd_conn_stats_enable(&test_conn));
+
+	const struct configd_method_stats *ms = method("Exists");
+	CHECK(ms != NULL);
+	LONGS_EQUAL(1, ms->calls);
+}
+
+// Each response is booked to the request with its id, however many are
+// awaiting one.
+TEST(ConnStats, pipelined_requests)
+{
+	struct request reqs[] = {
+		{ "Set", json_pack("[s]", "a") },
+		{ "Delete", json_pack("[s]", "b") },
+		{ "Set", json_pack("[s]", "c") },
+	};
+	char *trace = NULL;
+	size_t len = 0;
+	FILE *fp = open_memstream(&trace, &len);
+	char want[64];
+
+	LONGS_EQUAL(0, configd_conn_stats_enable(&test_conn));
+	LONGS_EQUAL(0, configd_conn_stats_trace(&test_conn, fp));
+	for (int i = 1; i <= 3; i++)
+		queue_incoming_rpc_json(json_pack(
+			"{sisnsi}", "result", 1, "error", "id", TEST_REQ_ID + i));
+
+	LONGS_EQUAL(0, get_pipelined(&test_conn, reqs, 3, NULL, NULL));
+	fclose(fp);
+
+	const struct configd_method_stats *ms = method("Set");
+	CHECK(ms != NULL);
+	LONGS_EQUAL(2, ms->calls);
+	unsigned long total = 0;
+	for (int i = 0; i < CONFIGD_STATS_BUCKETS; i++)
+		total += ms->hist[i];
+	LONGS_EQUAL(2, total);
+
+	ms = method("Delete");
+	CHECK(ms != NULL);
+	LONGS_EQUAL(1, ms->calls);
+
+	snprintf(want, sizeof(want), "\"method\":\"Delete\",\"id\":%d,",
+		 TEST_REQ_ID + 2);
+	CHECK(strstr(trace, want) != NULL);
+	snprintf(want, sizeof(want), "\"method\":\"Set\",\"id\":%d,",
+		 TEST_REQ_ID + 3);
+	CHECK(strstr(trace, want) != NULL);
+	free(trace);
+}
+
+TEST(ConnStats, close_discards_stats)
+{
+	LONGS_EQUAL(0, configd_conn_stats_enable(&test_conn));
+	LONGS_EQUAL(1, call("Exists"));
+
+	configd_close_connection(&test_conn);
+	memset(&test_conn, 0, sizeof(configd_conn));
+
+	POINTERS_EQUAL(NULL, configd_conn_stats(&test_conn));
+}
+
+// get_str_to_fd() parses the response itself rather than through
+// json_loadf(), so these tests feed it raw text.
+TEST_GROUP(StreamResponse)
+{
+	FILE *out;
+	char buf[256];
+
+	void setup()
+	{
+		memset(&test_conn, 0, sizeof(configd_conn));
+		test_conn.req_id = TEST_REQ_ID;
+		memset(&test_err, 0, sizeof(test_err));
+
+		out = tmpfile();
+		set_write_passthrough_fd(fileno(out));
+	}
+
+	void teardown()
+	{
+		set_write_passthrough_fd(-1);
+		fclose(out);
+		if (test_conn.fp)
+			fclose(test_conn.fp);
+		configd_error_free(&test_err);
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	int call(const char *incoming)
+	{
+		struct request req = { "TreeGet", json_pack("{ss}", "key", "value") };
+
+		test_conn.fp = fmemopen((void *)incoming, strlen(incoming), "r");
+		return get_str_to_fd(&test_conn, &req, fileno(out), &test_err);
+	}
+
+	const char *output()
+	{
+		size_t len;
+
+		rewind(out);
+		len = fread(buf, 1, sizeof(buf) - 1, out);
+		buf[len] = '\0';
+		return buf;
+	}
+};
+
+TEST(StreamResponse, result_unescaped)
+{
+	LONGS_EQUAL(0, call(
+		"{\"result\":\"{\\\"a\\\":\\\"b\\\\\\\\c\\\"}\\n\\t\\/"
+		"\\u00e9\\ud83d\\ude00\",\"error\":null,"
+		"\"mgmterrorlist\":{\"error-list\":[]},\"id\":124}"));
+	STRCMP_EQUAL("{\"a\":\"b\\\\c\"}\n\t/\xc3\xa9\xf0\x9f\x98\x80",
+		     output());
+}
+
+TEST(StreamResponse, result_after_other_members)
+{
+	LONGS_EQUAL(0, call(
+		" { \"id\" : 124 , \"error\" : null , \"result\" : \"x\" } "));
+	STRCMP_EQUAL("x", output());
+}
+
+TEST(StreamResponse, error_string)
+{
+	LONGS_EQUAL(-1, call(
+		"{\"result\":null,\"error\":\"" TEST_ERROR "\",\"id\":124}"));
+	STRCMP_EQUAL(TEST_ERROR "\n", test_err.text);
+	STRCMP_EQUAL("", output());
+}
+
+TEST(StreamResponse, id_mismatch)
+{
+	LONGS_EQUAL(-1, call("{\"result\":\"x\",\"id\":7}"));
+}
+
+TEST(StreamResponse, truncated)
+{
+	mock().expectOneCall("msg_err").withParameter(
+		"fmt", "%s: malformed configd response\n");
+
+	LONGS_EQUAL(-1, call("{\"result\":\"abc"));
+}
+
+TEST(StreamResponse, bad_escape)
+{
+	mock().expectOneCall("msg_err").withParameter(
+		"fmt", "%s: malformed configd response\n");
+
+	LONGS_EQUAL(-1, call("{\"result\":\"\\ud83d\",\"id\":124}"));
+}
+
+// get_json() parses a string result as it unescapes it.
+TEST_GROUP(ParsedResponse)
+{
+	json_t *parsed;
+
+	void setup()
+	{
+		memset(&test_conn, 0, sizeof(configd_conn));
+		test_conn.req_id = TEST_REQ_ID;
+		memset(&test_err, 0, sizeof(test_err));
+		parsed = NULL;
+	}
+
+	void teardown()
+	{
+		json_decref(parsed);
+		if (test_conn.fp)
+			fclose(test_conn.fp);
+		configd_error_free(&test_err);
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	json_t *call(const char *incoming)
+	{
+		struct request req = { "TreeGet", json_pack("{ss}", "key", "value") };
+
+		test_conn.fp = fmemopen((void *)incoming, strlen(incoming), "r");
+		parsed = get_json(&test_conn, &req, &test_err);
+		return parsed;
+	}
+};
+
+TEST(ParsedResponse, object)
+{
+	CHECK(call("{\"result\":\"{\\\"a\\\":[\\\"b\\\\\\\\c\\\",1,"
+		   "true],\\\"\\u00e9\\\":{}}\",\"error\":null,\"id\":124}"));
+	CHECK(json_is_object(parsed));
+	LONGS_EQUAL(2, json_object_size(parsed));
+	json_t *a = json_object_get(parsed, "a");
+	LONGS_EQUAL(3, json_array_size(a));
+	STRCMP_EQUAL("b\\c", json_string_value(json_array_get(a, 0)));
+	LONGS_EQUAL(1, json_integer_value(json_array_get(a, 1)));
+	CHECK(json_is_true(json_array_get(a, 2)));
+	CHECK(json_is_object(json_object_get(parsed, "\xc3\xa9")));
+}
+
+TEST(ParsedResponse, larger_than_buffer)
+{
+	std::string value(20000, 'x');
+	std::string incoming = "{\"result\":\"[\\\"" + value +
+		"\\\"]\",\"id\":124}";
+
+	CHECK(call(incoming.c_str()));
+	STRCMP_EQUAL(value.c_str(),
+		     json_string_value(json_array_get(parsed, 0)));
+}
+
+TEST(ParsedResponse, not_json)
+{
+	mock().expectOneCall("msg_err").withParameter(
+		"fmt", "%s: %s\n");
+
+	POINTERS_EQUAL(NULL, call(
+		"{\"result\":\"{\\\"a\\\":\",\"error\":null,\"id\":124}"));
+	STRCMP_EQUAL("Response is not valid JSON", test_err.text);
+}
+
+TEST(ParsedResponse, error_string)
+{
+	POINTERS_EQUAL(NULL, call(
+		"{\"result\":null,\"error\":\"" TEST_ERROR "\",\"id\":124}"));
+	STRCMP_EQUAL(TEST_ERROR "\n", test_err.text);
+}
+
+TEST(ParsedResponse, bad_escape)
+{
+	mock().expectOneCall("msg_err").withParameter(
+		"fmt", "%s: malformed configd response\n");
+
+	POINTERS_EQUAL(NULL, call("{\"result\":\"[\\ud83d]\",\"id\":124}"));
+}
+
+// The memfd transport, with the test acting as configd on the other end of
+// a socket pair.
+TEST_GROUP(Memfd)
+{
+	int sv[2];
+	FILE *out;
+	char buf[256];
+
+	void setup()
+	{
+		memset(&test_conn, 0, sizeof(configd_conn));
+		memset(&test_err, 0, sizeof(test_err));
+
+		CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+		test_conn.fd = sv[0];
+		test_conn.fp = fdopen(sv[0], "r+");
+		CHECK(test_conn.fp != NULL);
+		test_conn.req_id = TEST_REQ_ID;
+
+		set_incoming_rpc_json(json_pack(
+			"{s{ss}si}", "result", "memfd-transport", "1",
+			"id", TEST_REQ_ID + 1));
+		LONGS_EQUAL(1, configd_conn_memfd_enable(&test_conn));
+
+		out = tmpfile();
+		set_write_passthrough_fd(fileno(out));
+	}
+
+	void teardown()
+	{
+		set_write_passthrough_fd(-1);
+		fclose(out);
+		fclose(test_conn.fp);
+		close(sv[1]);
+		configd_error_free(&test_err);
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	int body_fd(const char *body, int seals)
+	{
+		int fd = memfd_create("test", MFD_ALLOW_SEALING);
+
+		CHECK(fd >= 0);
+		// write() is mocked, so use pwrite()
+		LONGS_EQUAL(strlen(body), pwrite(fd, body, strlen(body), 0));
+		CHECK(fcntl(fd, F_ADD_SEALS, seals) == 0);
+		return fd;
+	}
+
+	// Queue a response from "configd", with body_fd attached if >= 0
+	void respond(const char *incoming, int fd)
+	{
+		if (fd >= 0) {
+			LONGS_EQUAL(strlen(incoming),
+				    memfd_send(sv[1], incoming, strlen(incoming), &fd, 1));
+			close(fd);
+		} else {
+			LONGS_EQUAL(strlen(incoming),
+				    send(sv[1], incoming, strlen(incoming), 0));
+		}
+	}
+
+	int call()
+	{
+		struct request req = { "TreeGet", json_pack("[s]", "path") };
+
+		return get_str_to_fd(&test_conn, &req, fileno(out), &test_err);
+	}
+
+	const char *output()
+	{
+		size_t len;
+
+		rewind(out);
+		len = fread(buf, 1, sizeof(buf) - 1, out);
+		buf[len] = '\0';
+		return buf;
+	}
+};
+
+// Only connections that enable the transport read with recvmsg
+TEST(Memfd, stream_replaced_on_enable)
+{
+	CHECK(test_conn.fd != sv[0]);
+	LONGS_EQUAL(-1, fileno(test_conn.fp));
+	LONGS_EQUAL(FD_CLOEXEC, fcntl(test_conn.fd, F_GETFD));
+}
+
+TEST(Memfd, stream_kept_if_not_supported)
+{
+	struct configd_conn conn;
+	int pair[2];
+	FILE *fp;
+
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+	memset(&conn, 0, sizeof(conn));
+	conn.fd = pair[0];
+	conn.fp = fp = fdopen(pair[0], "r+");
+	conn.req_id = TEST_REQ_ID;
+	set_incoming_rpc_json(json_pack(
+		"{s{}si}", "result", "id", TEST_REQ_ID + 1));
+
+	LONGS_EQUAL(0, configd_conn_memfd_enable(&conn));
+	POINTERS_EQUAL(fp, conn.fp);
+	LONGS_EQUAL(pair[0], conn.fd);
+
+	fclose(conn.fp);
+	close(pair[1]);
+}
+
+TEST(Memfd, large_param_moved_to_memfd)
+{
+	std::string big(MEMFD_THRESHOLD, 'x');
+	json_t *jreq = json_pack("{s:s, s:[ss], s:i}", "method", "EditConfigXML",
+				 "params", "small", big.c_str(), "id", 1);
+	int fds[MEMFD_MAX_FDS];
+	struct stat st;
+	json_int_t accept = 0, param = -1;
+
+	LONGS_EQUAL(1, memfd_prepare_request(&test_conn, jreq, fds));
+
+	json_t *params = json_object_get(jreq, "params");
+	STRCMP_EQUAL("small", json_string_value(json_array_get(params, 0)));
+	LONGS_EQUAL(MEMFD_THRESHOLD, json_integer_value(json_array_get(params, 1)));
+	LONGS_EQUAL(0, json_unpack(json_object_get(jreq, "memfd"), "{s:I, s:[I]}",
+				   "accept", &accept, "params", &param));
+	LONGS_EQUAL(MEMFD_THRESHOLD, accept);
+	LONGS_EQUAL(1, param);
+
+	CHECK(fcntl(fds[0], F_GET_SEALS) & F_SEAL_WRITE);
+	CHECK(fstat(fds[0], &st) == 0);
+	LONGS_EQUAL(MEMFD_THRESHOLD, st.st_size);
+
+	memfd_close(fds, 1);
+	json_decref(jreq);
+}
+
+TEST(Memfd, small_param_stays_inline)
+{
+	json_t *jreq = json_pack("{s:s, s:[s], s:i}", "method", "Set",
+				 "params", "small", "id", 1);
+	int fds[MEMFD_MAX_FDS];
+
+	LONGS_EQUAL(0, memfd_prepare_request(&test_conn, jreq, fds));
+	STRCMP_EQUAL("small", json_string_value(
+		json_array_get(json_object_get(jreq, "params"), 0)));
+	json_decref(jreq);
+}
+
+TEST(Memfd, result_in_memfd)
+{
+	respond("{\"result\":null,\"memfd\":11,\"id\":125}",
+		body_fd("{\"a\":\"b\\\"\"}", F_SEAL_SHRINK | F_SEAL_WRITE));
+
+	LONGS_EQUAL(0, call());
+	STRCMP_EQUAL("{\"a\":\"b\\\"\"}", output());
+}
+
+TEST(Memfd, inline_result_still_handled)
+{
+	respond("{\"result\":\"inline\",\"id\":125}", -1);
+
+	LONGS_EQUAL(0, call());
+	STRCMP_EQUAL("inline", output());
+}
+
+TEST(Memfd, missing_descriptor)
+{
+	respond("{\"result\":null,\"memfd\":11,\"id\":125}", -1);
+
+	mock().expectOneCall("msg_err").withParameter(
+		"fmt", "configd memfd response without a descriptor\n");
+
+	LONGS_EQUAL(-1, call());
+}
+
+TEST(Memfd, unsealed_memfd_rejected)
+{
+	respond("{\"result\":null,\"memfd\":4,\"id\":125}",
+		body_fd("body", 0));
+
+	mock().expectOneCall("msg_err").withParameter(
+		"fmt", "configd memfd response is not sealed or too short\n");
+
+	LONGS_EQUAL(-1, call());
+	STRCMP_EQUAL("", output());
+}
+
+// Binary framing. The codec is checked directly, as enabling the framing
+// takes a configd that answers both GetFeatures and SetFraming. The mock
+// configd in bench/ does that.
+TEST_GROUP(Frame)
+{
+	char hex[256];
+
+	void setup()
+	{
+		memset(&test_conn, 0, sizeof(configd_conn));
+		test_conn.req_id = TEST_REQ_ID;
+	}
+
+	void teardown()
+	{
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	const char *dump_hex(json_t *jval)
+	{
+		size_t i, len = 0;
+		char *frame = frame_dumps(jval, &len);
+
+		json_decref(jval);
+		CHECK(frame != NULL);
+		CHECK(len * 2 < sizeof(hex));
+		for (i = 0; i < len; i++)
+			sprintf(hex + 2 * i, "%02x", (unsigned char)frame[i]);
+		hex[2 * len] = '\0';
+		free(frame);
+		return hex;
+	}
+
+	bool rejected(const char *body, size_t len)
+	{
+		json_t *jval = frame_loads(body, len);
+
+		json_decref(jval);
+		return jval == NULL;
+	}
+};
+
+TEST(Frame, encode)
+{
+	STRCMP_EQUAL("0000000aa161618501216178f5f6",
+		     dump_hex(json_pack("{s:[i,i,s,b,n]}", "a", 1, -2, "x", 1)));
+}
+
+TEST(Frame, encode_long_arguments)
+{
+	STRCMP_EQUAL("0000000d821b0000000100000000390101",
+		     dump_hex(json_pack("[I,i]", (json_int_t)1 << 32, -258)));
+}
+
+TEST(Frame, round_trip)
+{
+	std::string big(300, 'x');
+	json_t *jval = json_pack("{s:s, s:f, s:{s:[b,n,I]}, s:s}",
+				 "result", big.c_str(), "real", 1.5,
+				 "nested", "list", 0, -((json_int_t)1 << 40),
+				 "utf8", "caf\xc3\xa9");
+	size_t len = 0;
+	char *frame = frame_dumps(jval, &len);
+	json_t *back = frame_loads(frame + 4, len - 4);
+
+	CHECK(back != NULL);
+	CHECK(json_equal(jval, back));
+	json_decref(back);
+	json_decref(jval);
+	free(frame);
+}
+
+TEST(Frame, malformed_rejected)
+{
+	CHECK(rejected("\x82\x01", 2));			// truncated array
+	CHECK(rejected("\x01\x02", 2));			// trailing item
+	CHECK(rejected("\x41\x61", 2));			// byte string
+	CHECK(rejected("\x9f\x01\xff", 3));		// indefinite length
+	CHECK(rejected("\x62\xc3\x28", 3));		// invalid UTF-8
+	CHECK(rejected("\xa1\x62\x61\x00\x01", 5));	// NUL in key
+	CHECK(rejected("\xa1\x01\x01", 3));		// integer key
+	CHECK(rejected("\x1b\x80\0\0\0\0\0\0\0", 9));	// integer too large
+	CHECK(!rejected("\x1b\x7f\0\0\0\0\0\0\0", 9));
+}
+
+TEST(Frame, truncated_frame)
+{
+	char buf[] = "\0\0\0\x0a\x82\x01";
+	FILE *fp = fmemopen(buf, sizeof(buf) - 1, "r");
+	json_error_t jerr;
+
+	POINTERS_EQUAL(NULL, frame_loadf(fp, &jerr));
+	STRCMP_EQUAL("truncated frame", jerr.text);
+	fclose(fp);
+}
+
+TEST(Frame, not_offered_by_configd)
+{
+	set_incoming_rpc_json(json_pack(
+		"{s{ss}si}", "result", "memfd-transport", "1",
+		"id", TEST_REQ_ID + 1));
+
+	LONGS_EQUAL(0, configd_conn_cbor_enable(&test_conn));
+	LONGS_EQUAL(0, frame_enabled(&test_conn));
+}
+
+// Shared connections. mux_await is given its own reader, which hands out
+// queued responses in the order a test chooses.
+static json_t *mux_queue[8];
+static int mux_queued, mux_reads;
+
+static json_t *mux_test_read(struct configd_conn *)
+{
+	if (mux_reads == mux_queued)
+		return NULL;
+	return mux_queue[mux_reads++];
+}
+
+static void *mux_test_thread(void *arg)
+{
+	return mux_await(&test_conn, *(unsigned int *)arg, mux_test_read);
+}
+
+TEST_GROUP(Mux)
+{
+	void setup()
+	{
+		memset(&test_conn, 0, sizeof(configd_conn));
+		mux_queued = mux_reads = 0;
+		LONGS_EQUAL(0, configd_conn_mux_enable(&test_conn));
+	}
+
+	void teardown()
+	{
+		mux_close(&test_conn);
+		while (mux_reads < mux_queued)
+			json_decref(mux_queue[mux_reads++]);
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	void queue(unsigned int id)
+	{
+		mux_queue[mux_queued++] = json_pack("{s:i, s:i}",
+						    "result", id * 10, "id", id);
+	}
+
+	void check_reply(unsigned int id, json_t *jresp)
+	{
+		CHECK(jresp != NULL);
+		LONGS_EQUAL(id * 10, json_integer_value(
+				    json_object_get(jresp, "result")));
+		json_decref(jresp);
+	}
+};
+
+TEST(Mux, enabled)
+{
+	struct configd_conn other;
+
+	CHECK(mux_enabled(&test_conn));
+	CHECK(!mux_enabled(&other));
+}
+
+TEST(Mux, replies_kept_for_other_ids)
+{
+	queue(3);
+	queue(1);
+	queue(2);
+
+	check_reply(1, mux_await(&test_conn, 1, mux_test_read));
+	LONGS_EQUAL(2, mux_reads);
+	check_reply(3, mux_await(&test_conn, 3, mux_test_read));
+	LONGS_EQUAL(2, mux_reads);
+	check_reply(2, mux_await(&test_conn, 2, mux_test_read));
+	LONGS_EQUAL(3, mux_reads);
+}
+
+TEST(Mux, read_error_fails_every_caller)
+{
+	queue(2);
+
+	POINTERS_EQUAL(NULL, mux_await(&test_conn, 1, mux_test_read));
+	// The response to 2 was read before the failure, later ones won't be
+	check_reply(2, mux_await(&test_conn, 2, mux_test_read));
+	queue(3);
+	POINTERS_EQUAL(NULL, mux_await(&test_conn, 3, mux_test_read));
+}
+
+TEST(Mux, missing_id)
+{
+	mux_queue[mux_queued++] = json_pack("{s:i}", "result", 1);
+
+	mock().expectOneCall("msg_err").withParameter(
+		"fmt", "configd response id must be an integer\n");
+
+	POINTERS_EQUAL(NULL, mux_await(&test_conn, 1, mux_test_read));
+	LONGS_EQUAL(EPROTO, errno);
+}
+
+TEST(Mux, threads_get_their_own_reply)
+{
+	unsigned int ids[4] = { 1, 2, 3, 4 };
+	pthread_t threads[4];
+	void *jresp;
+	int i;
+
+	for (i = 4; i > 0; i--)
+		queue(i);
+	for (i = 0; i < 4; i++)
+		LONGS_EQUAL(0, pthread_create(&threads[i], NULL,
+					      mux_test_thread, &ids[i]));
+	for (i = 0; i < 4; i++) {
+		LONGS_EQUAL(0, pthread_join(threads[i], &jresp));
+		check_reply(ids[i], (json_t *)jresp);
+	}
+	LONGS_EQUAL(4, mux_reads);
+}
+
+TEST_GROUP(Async)
+{
+	int sv[2];
+	unsigned int id;
+	char *result;
+
+	void setup()
+	{
+		memset(&test_conn, 0, sizeof(configd_conn));
+		memset(&test_err, 0, sizeof(test_err));
+		result = NULL;
+
+		CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+		test_conn.fd = sv[0];
+		test_conn.fp = fdopen(sv[0], "r+");
+		CHECK(test_conn.fp != NULL);
+		test_conn.session_id = (char *)"";
+		test_conn.req_id = TEST_REQ_ID;
+		set_write_passthrough_fd(sv[0]);
+		LONGS_EQUAL(0, configd_conn_async_enable(&test_conn));
+	}
+
+	void teardown()
+	{
+		set_write_passthrough_fd(-1);
+		async_close(&test_conn);
+		fclose(test_conn.fp);
+		close(sv[1]);
+		free(result);
+		configd_error_free(&test_err);
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	void respond(const char *incoming)
+	{
+		LONGS_EQUAL(strlen(incoming),
+			    send(sv[1], incoming, strlen(incoming), 0));
+	}
+};
+
+TEST(Async, results_in_arrival_order)
+{
+	LONGS_EQUAL(TEST_REQ_ID + 1, configd_async_tree_get(
+			    &test_conn, 0, "/a", "json", &test_err));
+	LONGS_EQUAL(TEST_REQ_ID + 2, configd_async_set(
+			    &test_conn, "/b", &test_err));
+	LONGS_EQUAL(0, configd_async_flush(&test_conn));
+
+	// The second response first, then the first split across reads
+	respond("{\"result\":\"set\",\"id\":125}\n{\"result\":\"{\\\"a");
+	LONGS_EQUAL(1, configd_async_read(&test_conn));
+	respond("\\\"}\",\"id\":124}");
+	LONGS_EQUAL(2, configd_async_read(&test_conn));
+
+	LONGS_EQUAL(1, configd_async_result(&test_conn, &id, &result,
+					    &test_err));
+	LONGS_EQUAL(TEST_REQ_ID + 2, id);
+	STRCMP_EQUAL("set", result);
+	free(result);
+	LONGS_EQUAL(1, configd_async_result(&test_conn, &id, &result,
+					    &test_err));
+	LONGS_EQUAL(TEST_REQ_ID + 1, id);
+	STRCMP_EQUAL("{\"a\"}", result);
+	free(result);
+	result = NULL;
+	LONGS_EQUAL(0, configd_async_result(&test_conn, &id, &result,
+					    &test_err));
+}
+
+// What is left after the complete responses is kept for the next read
+TEST(Async, several_in_one_read)
+{
+	for (int i = 1; i <= 4; i++)
+		LONGS_EQUAL(TEST_REQ_ID + i, configd_async_set(
+				    &test_conn, "/a", &test_err));
+
+	respond("{\"result\":\"1\",\"id\":124}{\"result\":\"2\",\"id\":125}"
+		"\n{\"result\":\"3\",\"id\":126}{\"result\":");
+	LONGS_EQUAL(3, configd_async_read(&test_conn));
+	respond("\"4\",\"id\":127}");
+	LONGS_EQUAL(4, configd_async_read(&test_conn));
+
+	for (int i = 1; i <= 4; i++) {
+		LONGS_EQUAL(1, configd_async_result(&test_conn, &id, &result,
+						    &test_err));
+		LONGS_EQUAL(TEST_REQ_ID + i, id);
+		LONGS_EQUAL('0' + i, result[0]);
+		free(result);
+		result = NULL;
+	}
+}
+
+TEST(Async, nothing_to_read)
+{
+	LONGS_EQUAL(0, configd_async_read(&test_conn));
+}
+
+TEST(Async, error_response)
+{
+	LONGS_EQUAL(TEST_REQ_ID + 1, configd_async_delete(
+			    &test_conn, "/a", &test_err));
+	respond("{\"error\":\"" TEST_ERROR "\",\"id\":124}");
+	LONGS_EQUAL(1, configd_async_read(&test_conn));
+
+	LONGS_EQUAL(1, configd_async_result(&test_conn, &id, &result,
+					    &test_err));
+	LONGS_EQUAL(TEST_REQ_ID + 1, id);
+	POINTERS_EQUAL(NULL, result);
+	STRCMP_EQUAL(TEST_ERROR "\n", test_err.text);
+	STRCMP_EQUAL("configd_async_delete", test_err.source);
+}
+
+TEST(Async, missing_id)
+{
+	mock().expectOneCall("msg_err").withParameter(
+		"fmt", "configd response id must be an integer\n");
+
+	respond("{\"result\":\"x\"}");
+	LONGS_EQUAL(-1, configd_async_read(&test_conn));
+	LONGS_EQUAL(EPROTO, errno);
+}
+
+TEST(Async, not_json)
+{
+	respond("result");
+	LONGS_EQUAL(-1, configd_async_read(&test_conn));
+	LONGS_EQUAL(EPROTO, errno);
+}
+
+TEST(Async, closed_by_configd)
+{
+	close(sv[1]);
+	sv[1] = -1;
+	LONGS_EQUAL(-1, configd_async_read(&test_conn));
+	LONGS_EQUAL(ECONNRESET, errno);
+	LONGS_EQUAL(-1, configd_async_set(&test_conn, "/a", &test_err));
+}
+
+// The args are consumed all the same
+TEST(Async, blocking_calls_refused)
+{
+	struct request req = { "TreeGet", json_pack("[s]", "path") };
+
+	POINTERS_EQUAL(NULL, get_str(&test_conn, &req, &test_err));
+	LONGS_EQUAL(EBUSY, errno);
+}
@@ -0,0 +1,215 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+*/
+
+#include "CppUTest/TestHarness.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpustat.h"
+
+TEST_GROUP(CpuStatParse)
+{
+	std::vector<CpuTimes> cpus;
+};
+
+TEST(CpuStatParse, cpu_lines_are_read)
+{
+	const char *text =
+		"cpu  100 2 30 4000 5 0 6 7 8 9\n"
+		"cpu0 60 1 20 2000 3 0 4 5 6 7\n"
+		"cpu1 40 1 10 2000 2 0 2 2 2 2\n"
+		"intr 12345 0 0\n"
+		"ctxt 678\n";
+
+	CHECK(cpustat_parse(text, cpus));
+	LONGS_EQUAL(3, cpus.size());
+	LONGS_EQUAL(-1, cpus[0].cpu);
+	LONGS_EQUAL(0, cpus[1].cpu);
+	LONGS_EQUAL(1, cpus[2].cpu);
+	LONGS_EQUAL(100, cpus[0].t[CPU_USER]);
+	LONGS_EQUAL(4000, cpus[0].t[CPU_IDLE]);
+	LONGS_EQUAL(9, cpus[0].t[CPU_GNICE]);
+	LONGS_EQUAL(20, cpus[1].t[CPU_SYS]);
+	LONGS_EQUAL(2, cpus[2].t[CPU_STEAL]);
+}
+
+TEST(CpuStatParse, missing_fields_are_zero)
+{
+	/* Older kernels have no steal, guest or guest_nice */
+	CHECK(cpustat_parse("cpu  1 2 3 4 5 6 7\ncpu0 1 2 3 4 5 6 7\n", cpus));
+	LONGS_EQUAL(2, cpus.size());
+	LONGS_EQUAL(7, cpus[0].t[CPU_SOFT]);
+	LONGS_EQUAL(0, cpus[0].t[CPU_STEAL]);
+	LONGS_EQUAL(0, cpus[1].t[CPU_GNICE]);
+}
+
+TEST(CpuStatParse, no_trailing_newline)
+{
+	CHECK(cpustat_parse("cpu  1 2 3 4 5 6 7 8 9 10", cpus));
+	LONGS_EQUAL(1, cpus.size());
+	LONGS_EQUAL(10, cpus[0].t[CPU_GNICE]);
+}
+
+TEST(CpuStatParse, no_cpu_lines)
+{
+	CHECK_FALSE(cpustat_parse("intr 12345\nctxt 678\n", cpus));
+	CHECK_FALSE(cpustat_parse("", cpus));
+	LONGS_EQUAL(0, cpus.size());
+}
+
+TEST(CpuStatParse, proc_stat_is_read)
+{
+	CHECK(cpustat_read("/proc/stat", cpus));
+	CHECK(cpus.size() >= 2);
+	LONGS_EQUAL(-1, cpus[0].cpu);
+	LONGS_EQUAL(0, cpus[1].cpu);
+}
+
+/*
+ * The sample file as cpustat_sampler writes it, see cpustat.cpp.
+ */
+struct SampleFile {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ncpu;
+	uint32_t slots;
+	uint32_t interval_ms;
+	uint32_t pad;
+	uint64_t seq;
+	uint64_t count;
+};
+
+#define SAMPLE_SLOTS 4
+#define SAMPLE_CPUS 2
+#define SAMPLE_INTERVAL 1000
+
+static uint64_t test_now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+TEST_GROUP(CpuStatWindows)
+{
+	char file[32];
+	std::vector<std::vector<CpuTimes> > out;
+
+	void setup()
+	{
+		strcpy(file, "/tmp/cpustatXXXXXX");
+		int fd = mkstemp(file);
+		CHECK(fd >= 0);
+		close(fd);
+	}
+
+	void teardown()
+	{
+		unlink(file);
+	}
+
+	/*
+	 * Write count samples, the newest taken age_ms ago, in which each CPU
+	 * spends sample n^2 ticks in user and n in idle.
+	 */
+	void write_samples(uint64_t count, uint64_t age_ms)
+	{
+		SampleFile h = { 0x43505553, 1, SAMPLE_CPUS, SAMPLE_SLOTS,
+				 SAMPLE_INTERVAL, 0, 2 * count, count };
+		struct {
+			uint64_t time_ns;
+			CpuTimes cpu[SAMPLE_CPUS];
+		} s[SAMPLE_SLOTS];
+		uint64_t now = test_now_ns();
+
+		memset(s, 0, sizeof(s));
+		for (uint64_t n = count > SAMPLE_SLOTS ? count - SAMPLE_SLOTS : 0;
+		     n < count; n++) {
+			s[n % SAMPLE_SLOTS].time_ns = now - age_ms * 1000000ULL
+				- (count - 1 - n) * SAMPLE_INTERVAL * 1000000ULL;
+			for (int c = 0; c < SAMPLE_CPUS; c++) {
+				CpuTimes *t = &s[n % SAMPLE_SLOTS].cpu[c];
+				t->cpu = c - 1;
+				t->t[CPU_USER] = n * n;
+				t->t[CPU_IDLE] = n;
+			}
+		}
+
+		FILE *f = fopen(file, "w");
+		CHECK(f);
+		LONGS_EQUAL(1, fwrite(&h, sizeof(h), 1, f));
+		LONGS_EQUAL(1, fwrite(s, sizeof(s), 1, f));
+		fclose(f);
+	}
+};
+
+TEST(CpuStatWindows, windows_are_differences)
+{
+	const unsigned int windows[] = { 0, 1, 2 };
+
+	write_samples(3, 0);
+	CHECK(cpustat_windows(file, windows, 3, out));
+	LONGS_EQUAL(3, out.size());
+	for (int c = 0; c < SAMPLE_CPUS; c++) {
+		LONGS_EQUAL(c - 1, out[0][c].cpu);
+		/* 2^2 - 1^2 over the latest interval */
+		LONGS_EQUAL(3, out[0][c].t[CPU_USER]);
+		LONGS_EQUAL(1, out[0][c].t[CPU_IDLE]);
+		LONGS_EQUAL(3, out[1][c].t[CPU_USER]);
+		LONGS_EQUAL(4, out[2][c].t[CPU_USER]);
+		LONGS_EQUAL(2, out[2][c].t[CPU_IDLE]);
+		LONGS_EQUAL(0, out[2][c].t[CPU_SYS]);
+	}
+}
+
+TEST(CpuStatWindows, windows_are_limited_to_samples)
+{
+	const unsigned int windows[] = { 60 };
+
+	/* Fewer samples than the window */
+	write_samples(3, 0);
+	CHECK(cpustat_windows(file, windows, 1, out));
+	LONGS_EQUAL(4, out[0][0].t[CPU_USER]);
+
+	/* More than the ring holds: samples 6 to 9 are left */
+	write_samples(10, 0);
+	CHECK(cpustat_windows(file, windows, 1, out));
+	LONGS_EQUAL(81 - 36, out[0][1].t[CPU_USER]);
+	LONGS_EQUAL(3, out[0][1].t[CPU_IDLE]);
+}
+
+TEST(CpuStatWindows, stale_samples_are_ignored)
+{
+	const unsigned int windows[] = { 0 };
+
+	write_samples(3, 10 * SAMPLE_INTERVAL);
+	CHECK_FALSE(cpustat_windows(file, windows, 1, out));
+}
+
+TEST(CpuStatWindows, one_sample_is_not_enough)
+{
+	const unsigned int windows[] = { 0 };
+
+	write_samples(1, 0);
+	CHECK_FALSE(cpustat_windows(file, windows, 1, out));
+}
+
+TEST(CpuStatWindows, not_a_sample_file)
+{
+	const unsigned int windows[] = { 0 };
+	FILE *f = fopen(file, "w");
+
+	fputs("cpu  1 2 3 4 5 6 7 8 9 10\n", f);
+	fclose(f);
+	CHECK_FALSE(cpustat_windows(file, windows, 1, out));
+	unlink(file);
+	CHECK_FALSE(cpustat_windows(file, windows, 1, out));
+}
@@ -11,19 +11,29 @@ extern "C"
 {
 #include <netinet/ip.h>
 #include <jansson.h>
+#include <signal.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include <vyatta-util/map.h>
 #include <vyatta-util/vector.h>
 
 #include "connect.h"
 #include "error.h"
+#include "node.h"
 #include "rpc.h"
 #include "transaction.h"
 #include "internal.h"
 #include "common_mocks.h"
 }
 
+// node.c's completion support isn't built into this test
+extern "C" char *getCompletionEnv(struct configd_conn *, const char *)
+{
+	return NULL;
+}
+
 #define PATH_FIELD "error-path"
 #define MESSAGE_FIELD "error-message"
 #define APP_TAG_FIELD "error-app-tag"
@@ -331,4 +341,323 @@ TEST(Format, multiple_error_unformatted)
 	CHECK_FALSE(retval == -1);
 
 	STRCMP_EQUAL(exp_output, test_err.text);
-}
\ No newline at end of file
+}
+// configd_set_many() and configd_delete_many() read the responses to their
+// pipelined requests in turn, gathering the errors of those that fail.
+TEST_GROUP(Many)
+{
+	const char *paths[100];
+	char *errors[100];
+
+	void setup()
+	{
+		memset(&test_conn, 0, sizeof(configd_conn));
+		test_conn.req_id = TEST_REQ_ID;
+		test_conn.session_id = strdup("TEST_SESSION_ID");
+
+		memset(&test_err, 0, sizeof(struct configd_error));
+		for (int i = 0; i < 100; i++)
+			paths[i] = "/some/path";
+		memset(errors, 0, sizeof(errors));
+	}
+
+	void teardown()
+	{
+		// Allocated by the code under test, so freed by it too
+		for (int i = 0; i < 100; i++) {
+			struct configd_error e = { NULL, errors[i], };
+			configd_error_free(&e);
+		}
+		configd_error_free(&test_err);
+		free(test_conn.session_id);
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	void respond_ok(int n)
+	{
+		// send_request() increments ID
+		queue_incoming_rpc_json(json_pack(
+			"{sssnsi}", "result", "", "error", "id", TEST_REQ_ID + n));
+	}
+};
+
+TEST(Many, all_set)
+{
+	for (int i = 1; i <= 3; i++)
+		respond_ok(i);
+
+	LONGS_EQUAL(0, configd_set_many(&test_conn, paths, 3, errors,
+					&test_err));
+	POINTERS_EQUAL(NULL, errors[0]);
+	POINTERS_EQUAL(NULL, errors[1]);
+	POINTERS_EQUAL(NULL, errors[2]);
+	POINTERS_EQUAL(NULL, test_err.text);
+}
+
+TEST(Many, errors_gathered)
+{
+	respond_ok(1);
+	queue_incoming_rpc_json(json_pack(
+		"{snsssi}", "result", "error", TEST_MESSAGE_2,
+		"id", TEST_REQ_ID + 2));
+	queue_incoming_rpc_json(json_pack(
+		"{snsns{s[{ssssssssss}]}si}",
+		"result",
+		"error",
+		"mgmterrorlist", "error-list",
+		"error-type", "err-type",
+		"error-severity", "some-severity",
+		"error-tag", "some-tag",
+		MESSAGE_FIELD, TEST_MESSAGE,
+		PATH_FIELD, TEST_PATH,
+		"id", TEST_REQ_ID + 3));
+	respond_ok(4);
+
+	LONGS_EQUAL(2, configd_set_many(&test_conn, paths, 4, errors,
+					&test_err));
+	POINTERS_EQUAL(NULL, errors[0]);
+	STRCMP_EQUAL(TEST_MESSAGE_2 "\n", errors[1]);
+	STRCMP_EQUAL(TEST_MESSAGE, errors[2]);
+	POINTERS_EQUAL(NULL, errors[3]);
+
+	STRCMP_EQUAL(TEST_MESSAGE_2 "\n" TEST_MESSAGE, test_err.text);
+	CHECK(configd_error_is_mgmt_error(&test_err));
+	LONGS_EQUAL(1, configd_error_num_mgmt_errors(&test_err));
+	STRCMP_EQUAL(TEST_PATH, configd_mgmt_error_path(
+			     configd_error_mgmt_error_list(&test_err)[0]));
+}
+
+TEST(Many, more_than_pipelined_at_once)
+{
+	for (int i = 1; i <= 100; i++)
+		queue_incoming_rpc_json(json_pack(
+			"{sisnsi}", "result", 1, "error", "id", TEST_REQ_ID + i));
+
+	LONGS_EQUAL(0, configd_delete_many(&test_conn, paths, 100, errors,
+					   &test_err));
+	LONGS_EQUAL(TEST_REQ_ID + 100, test_conn.req_id);
+	POINTERS_EQUAL(NULL, test_err.text);
+}
+
+TEST(Many, connection_lost)
+{
+	respond_ok(1);
+	queue_incoming_rpc_json(json_pack(
+		"{sssnsi}", "result", "", "error", "id", 999));
+
+	LONGS_EQUAL(-1, configd_set_many(&test_conn, paths, 3, errors,
+					 &test_err));
+	POINTERS_EQUAL(NULL, errors[0]);
+	STRCMP_EQUAL("Error receiving response", errors[1]);
+	STRCMP_EQUAL("Error receiving response", errors[2]);
+	STRCMP_EQUAL("Error receiving response\n", test_err.text);
+}
+
+// The args of the request that couldn't be sent have gone with it, only
+// those after it are left to free.
+TEST(Many, peer_closed)
+{
+	int sv[2];
+	void (*pipe_handler)(int) = signal(SIGPIPE, SIG_IGN);
+
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	close(sv[1]);
+	test_conn.fd = sv[0];
+	set_write_passthrough_fd(sv[0]);
+
+	LONGS_EQUAL(-1, configd_set_many(&test_conn, paths, 3, errors,
+					 &test_err));
+
+	set_write_passthrough_fd(-1);
+	close(sv[0]);
+	signal(SIGPIPE, pipe_handler);
+	STRCMP_EQUAL("Error sending request", errors[0]);
+	STRCMP_EQUAL("Error sending request", errors[2]);
+	STRCMP_EQUAL("Error sending request\n", test_err.text);
+}
+
+// configd_node_get_many() reads the responses to its requests a batch at a
+// time, leaving no value for the paths that fail.
+TEST_GROUP(GetMany)
+{
+	const char *paths[100];
+	struct vector *out[100];
+
+	void setup()
+	{
+		memset(&test_conn, 0, sizeof(configd_conn));
+		test_conn.req_id = TEST_REQ_ID;
+		test_conn.session_id = strdup("TEST_SESSION_ID");
+
+		memset(&test_err, 0, sizeof(struct configd_error));
+		for (int i = 0; i < 100; i++)
+			paths[i] = "/some/path";
+		memset(out, 0, sizeof(out));
+	}
+
+	void teardown()
+	{
+		for (int i = 0; i < 100; i++)
+			vector_free(out[i]);
+		configd_error_free(&test_err);
+		free(test_conn.session_id);
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	void respond_values(int n, const char *value)
+	{
+		// send_request() increments ID
+		queue_incoming_rpc_json(json_pack(
+			"{s[s]snsi}", "result", value, "error", "id",
+			TEST_REQ_ID + n));
+	}
+};
+
+TEST(GetMany, values_and_missing)
+{
+	respond_values(1, "one");
+	queue_incoming_rpc_json(json_pack(
+		"{snsssi}", "result", "error", TEST_MESSAGE,
+		"id", TEST_REQ_ID + 2));
+	respond_values(3, "three");
+
+	LONGS_EQUAL(0, configd_node_get_many(&test_conn, CANDIDATE, paths, 3,
+					     out, &test_err));
+	STRCMP_EQUAL("one", vector_next(out[0], NULL));
+	POINTERS_EQUAL(NULL, out[1]);
+	STRCMP_EQUAL("three", vector_next(out[2], NULL));
+	POINTERS_EQUAL(NULL, test_err.text);
+}
+
+TEST(GetMany, more_than_pipelined_at_once)
+{
+	for (int i = 1; i <= 100; i++)
+		respond_values(i, "value");
+
+	LONGS_EQUAL(0, configd_node_get_many(&test_conn, RUNNING, paths, 100,
+					     out, &test_err));
+	LONGS_EQUAL(TEST_REQ_ID + 100, test_conn.req_id);
+	for (int i = 0; i < 100; i++)
+		STRCMP_EQUAL("value", vector_next(out[i], NULL));
+}
+
+// Those already read are dropped too
+TEST(GetMany, connection_lost)
+{
+	for (int i = 1; i <= PIPELINE_DEPTH; i++)
+		respond_values(i, "value");
+	queue_incoming_rpc_json(json_pack(
+		"{s[s]snsi}", "result", "value", "error", "id", 999));
+
+	LONGS_EQUAL(-1, configd_node_get_many(&test_conn, RUNNING, paths, 100,
+					      out, &test_err));
+	for (int i = 0; i < 100; i++)
+		POINTERS_EQUAL(NULL, out[i]);
+	STRCMP_EQUAL("Error receiving response\n", test_err.text);
+}
+
+// configd_load_migrate() reads the responses to its migrate, load and
+// session changed requests together.
+TEST_GROUP(LoadMigrate)
+{
+	void setup()
+	{
+		memset(&test_conn, 0, sizeof(configd_conn));
+		test_conn.req_id = TEST_REQ_ID;
+		test_conn.session_id = strdup("TEST_SESSION_ID");
+
+		memset(&test_err, 0, sizeof(struct configd_error));
+	}
+
+	void teardown()
+	{
+		configd_error_free(&test_err);
+		free(test_conn.session_id);
+
+		mock().checkExpectations();
+		mock().clear();
+	}; // Trailing ';' stops VS code misaligning code inside TEST_GROUP.
+
+	void respond(int n, const char *migrated, int loaded, int changed)
+	{
+		queue_incoming_rpc_json(json_pack(
+			"{sssnsi}", "result", migrated, "error",
+			"id", TEST_REQ_ID + n));
+		queue_incoming_rpc_json(json_pack(
+			"{sbsnsi}", "result", loaded, "error",
+			"id", TEST_REQ_ID + n + 1));
+		queue_incoming_rpc_json(json_pack(
+			"{sbsnsi}", "result", changed, "error",
+			"id", TEST_REQ_ID + n + 2));
+	}
+};
+
+TEST(LoadMigrate, changed)
+{
+	respond(1, "", 1, 1);
+
+	LONGS_EQUAL(1, configd_load_migrate(&test_conn, "/config/config.boot",
+					    &test_err));
+	LONGS_EQUAL(TEST_REQ_ID + 3, test_conn.req_id);
+	POINTERS_EQUAL(NULL, test_err.text);
+}
+
+TEST(LoadMigrate, unchanged_with_migration_output)
+{
+	respond(1, "Migrated\n", 1, 0);
+
+	LONGS_EQUAL(0, configd_load_migrate(&test_conn, "/config/config.boot",
+					    &test_err));
+	STRCMP_EQUAL("Migrated\n", test_err.text);
+}
+
+TEST(LoadMigrate, migration_fails_load_fails)
+{
+	queue_incoming_rpc_json(json_pack(
+		"{snsssi}", "result", "error", TEST_MESSAGE,
+		"id", TEST_REQ_ID + 1));
+	queue_incoming_rpc_json(json_pack(
+		"{snsssi}", "result", "error", TEST_MESSAGE_2,
+		"id", TEST_REQ_ID + 2));
+	queue_incoming_rpc_json(json_pack(
+		"{sbsnsi}", "result", 0, "error", "id", TEST_REQ_ID + 3));
+
+	LONGS_EQUAL(-1, configd_load_migrate(&test_conn, "/config/config.boot",
+					     &test_err));
+	STRCMP_EQUAL(TEST_MESSAGE "\n" TEST_MESSAGE_2 "\n", test_err.text);
+}
+
+TEST(LoadMigrate, connection_lost)
+{
+	queue_incoming_rpc_json(json_pack(
+		"{sssnsi}", "result", "", "error", "id", TEST_REQ_ID + 1));
+	queue_incoming_rpc_json(json_pack(
+		"{sbsnsi}", "result", 1, "error", "id", 999));
+
+	LONGS_EQUAL(-1, configd_load_migrate(&test_conn, "/config/config.boot",
+					     &test_err));
+	STRCMP_EQUAL("Error receiving response\n", test_err.text);
+}
+
+TEST(LoadMigrate, peer_closed)
+{
+	int sv[2];
+	void (*pipe_handler)(int) = signal(SIGPIPE, SIG_IGN);
+
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	close(sv[1]);
+	test_conn.fd = sv[0];
+	set_write_passthrough_fd(sv[0]);
+
+	LONGS_EQUAL(-1, configd_load_migrate(&test_conn, "/config/config.boot",
+					     &test_err));
+
+	set_write_passthrough_fd(-1);
+	close(sv[0]);
+	signal(SIGPIPE, pipe_handler);
+	STRCMP_EQUAL("Error sending request\n", test_err.text);
+}
@@ -0,0 +1,89 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+*/
+
+#include "CppUTest/TestHarness.h"
+
+extern "C"
+{
+#include <string.h>
+#include <uriparser/Uri.h>
+
+#include "path.h"
+}
+
+// The escaped form must be byte for byte what uriEscapeA produces as
+// configd unescapes with uriparser on the other side.
+static void check_against_uriparser(const char *comp)
+{
+	size_t len = strlen(comp);
+	char *expected = (char *)calloc(1, len * 6 + 1);
+	char *actual = (char *)calloc(1, len * 6 + 1);
+
+	uriEscapeA(comp, expected, URI_FALSE, URI_TRUE);
+
+	size_t elen = configd_path_escape_len(comp, len);
+	char *end = configd_path_escape(actual, comp, len);
+
+	LONGS_EQUAL(strlen(expected), elen);
+	LONGS_EQUAL(elen, end - actual);
+	STRCMP_EQUAL(expected, actual);
+
+	free(expected);
+	free(actual);
+}
+
+TEST_GROUP(PathEscape)
+{
+};
+
+TEST(PathEscape, empty)
+{
+	char out[1] = { 'x' };
+
+	LONGS_EQUAL(0, configd_path_escape_len("", 0));
+	POINTERS_EQUAL(out, configd_path_escape(out, "", 0));
+	BYTES_EQUAL('x', out[0]);
+}
+
+TEST(PathEscape, unreserved_is_copied)
+{
+	check_against_uriparser("dataplane");
+	check_against_uriparser("dp0s3.100");
+	check_against_uriparser("AZaz09-._~");
+}
+
+TEST(PathEscape, reserved_is_escaped)
+{
+	check_against_uriparser("10.0.0.1/24");
+	check_against_uriparser("2001:db8::1");
+	check_against_uriparser("a description with spaces");
+	check_against_uriparser("100%+'\"$`\\");
+}
+
+TEST(PathEscape, line_breaks_are_normalised)
+{
+	check_against_uriparser("\n");
+	check_against_uriparser("\r");
+	check_against_uriparser("\r\n");
+	check_against_uriparser("\n\r");
+	check_against_uriparser("a\r\r\nb\n\nc");
+}
+
+TEST(PathEscape, high_bytes)
+{
+	check_against_uriparser("caf\xc3\xa9");
+	check_against_uriparser("\x7f\x80\xff");
+}
+
+TEST(PathEscape, length_only_covers_len_bytes)
+{
+	char out[16];
+
+	LONGS_EQUAL(3, configd_path_escape_len("a/bc", 2));
+	char *end = configd_path_escape(out, "a/bc", 2);
+	*end = '\0';
+	STRCMP_EQUAL("a%2F", out);
+}
@@ -0,0 +1,92 @@
+/*
+	Copyright (c) 2021 AT&T Intellectual Property.
+
+	SPDX-License-Identifier: GPL-2.0-only
+*/
+
+#include "CppUTest/TestHarness.h"
+
+extern "C"
+{
+#include <stdlib.h>
+#include <string.h>
+
+#include "cli_spawn.h"
+}
+
+TEST_GROUP(CliCmdParse)
+{
+	struct cli_cmd cc;
+
+	void setup()
+	{
+		setenv("PATH", "/usr/bin:/bin", 1);
+	}
+
+	void teardown()
+	{
+		cli_cmd_free(&cc);
+	}
+};
+
+TEST(CliCmdParse, plain_words_are_split)
+{
+	LONGS_EQUAL(0, cli_cmd_parse("  /bin/true -a\tb=c  10.0.0.1/24 ", &cc));
+	STRCMP_EQUAL("/bin/true", cc.path);
+	STRCMP_EQUAL("/bin/true", cc.argv[0]);
+	STRCMP_EQUAL("-a", cc.argv[1]);
+	STRCMP_EQUAL("b=c", cc.argv[2]);
+	STRCMP_EQUAL("10.0.0.1/24", cc.argv[3]);
+	POINTERS_EQUAL(NULL, cc.argv[4]);
+}
+
+TEST(CliCmdParse, name_is_looked_up_in_path)
+{
+	LONGS_EQUAL(0, cli_cmd_parse("env", &cc));
+	CHECK(strcmp(cc.path, "/usr/bin/env") == 0
+	      || strcmp(cc.path, "/bin/env") == 0);
+	STRCMP_EQUAL("env", cc.argv[0]);
+}
+
+TEST(CliCmdParse, shell_syntax_needs_shell)
+{
+	const char *cmds[] = {
+		"/bin/true $HOME", "/bin/true 'a b'", "/bin/true \"a\"",
+		"/bin/true a\\ b", "/bin/true > /dev/null", "/bin/true | cat",
+		"/bin/true; /bin/true", "/bin/true &", "/bin/true *",
+		"/bin/true ~", "/bin/true # comment", "/bin/true\n/bin/true",
+		"/bin/true `id`", "(/bin/true)",
+	};
+
+	for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++)
+		LONGS_EQUAL(-1, cli_cmd_parse(cmds[i], &cc));
+}
+
+TEST(CliCmdParse, assignments_need_shell)
+{
+	LONGS_EQUAL(-1, cli_cmd_parse("FOO=bar /bin/true", &cc));
+}
+
+TEST(CliCmdParse, builtins_need_shell)
+{
+	LONGS_EQUAL(-1, cli_cmd_parse("cd /tmp", &cc));
+	LONGS_EQUAL(-1, cli_cmd_parse("exit 1", &cc));
+}
+
+// These are also in PATH, but the shell runs its own
+TEST(CliCmdParse, builtins_in_path_need_shell)
+{
+	const char *cmds[] = {
+		"echo -n a", "printf %s a", "kill -l", "test -n a", "pwd",
+		"true", "false", "while", "if",
+	};
+
+	for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++)
+		LONGS_EQUAL(-1, cli_cmd_parse(cmds[i], &cc));
+}
+
+TEST(CliCmdParse, empty_needs_shell)
+{
+	LONGS_EQUAL(-1, cli_cmd_parse("", &cc));
+	LONGS_EQUAL(-1, cli_cmd_parse(" \t ", &cc));
+}
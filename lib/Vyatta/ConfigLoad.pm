@@ -22,7 +22,6 @@ use base qw(Exporter);
 
 use sort 'stable';
 use lib "/opt/vyatta/share/perl5";
-use XorpConfigParser; 
 use Vyatta::Config;
 
 my @all_nodes = ();
@@ -61,56 +60,49 @@ sub applySingleQuote {
 
 my @comment_list = ();
 
-sub enumerate_branch {
-  my $cur_node = shift;
-  my @cur_path = @_;
-  # name not defined at root level
-  if (defined($cur_node->{'name'})) {
-    my $name = $cur_node->{'name'};
-    if ($name =~ /^\s*(\S+)\s+(\S.*)$/) {
-      push @cur_path, ($1, $2);
-    } else {
-      push @cur_path, $name;
-    }
+my $config_sets = '/opt/vyatta/sbin/vyatta-config-sets';
+
+# Run vyatta-config-sets over a config file, which does the parsing.
+# $0: config file.
+# $1: '/' separated path of the node to start at, or undef.
+# return: list of statements, each a ref of [ kind, components... ].
+# Dies if the config can't be read or isn't well formed, rather than
+# return the statements read before the error.
+sub readStatements {
+  my ($load_cfg, $root_node) = @_;
+  my @args = ('--raw', '--comments', '--deactivate');
+  push @args, "--root=$root_node" if defined($root_node);
+
+  open(my $fh, '-|', $config_sets, @args, $load_cfg)
+    or die "Unable to run $config_sets: $!\n";
+  local $/ = "\0\0";
+  my @stmts = ();
+  while (my $rec = <$fh>) {
+    chomp $rec;
+    push @stmts, [ split(/\0/, $rec) ];
   }
-  my $terminal = 0;
-  if (!defined($cur_node->{'children'})) {
-      $terminal = 1;
-  } else {
-      my $comment;
-      foreach (@{$cur_node->{'children'}}) {
-	  if (defined($_->{'comment'})) {
-	      $comment = $_->{'comment'};
-	  }
-
-	  if (defined($_->{'name'})) {
-	      if (defined $comment) {
-		  push @comment_list, join(" ", (@cur_path, $_->{'name'}, "\"" . $comment . "\""));
-		  $comment = undef;
-	      }
-	      else {
-		  #need to check for existance of .comment file here.
-		  push @comment_list, join(" ", (@cur_path, $_->{'name'}, "\"\""));
-	      }
-	      enumerate_branch($_, @cur_path);
-	      $terminal = 0;
-	  }
-
-      }
-  }
-
-  if (defined($cur_node->{'disable'})) {
-      push @disable_list, join(" ",@cur_path);
+  # exits 1 if there are no statements, which is not an error
+  if (!close($fh) && ($! != 0 || ($? >> 8) != 1)) {
+    die "Unable to load configuration from $load_cfg\n";
   }
+  return @stmts;
+}
 
-  if ($terminal) {
-    my $val = $cur_node->{'value'};
-    if (defined($val)) {
-      push @cur_path, $val;
+# Fill the statement lists from the converted config.
+sub enumerate_statements {
+  @disable_list = ();
+  @comment_list = ();
+  foreach my $stmt (@_) {
+    my ($kind, @path) = @{$stmt};
+    if ($kind eq 'set') {
+      push @all_naked_nodes, [ @path ];
+      my @qpath = applySingleQuote(@path);
+      push @all_nodes, [\@qpath, 0];
+    } elsif ($kind eq 'comment') {
+      push @comment_list, join(" ", @path);
+    } elsif ($kind eq 'deactivate') {
+      push @disable_list, join(" ", @path);
     }
-    push @all_naked_nodes, [ @cur_path ];
-    my @qpath = applySingleQuote(@cur_path);
-    push @all_nodes, [\@qpath, 0];
   }
 }
 
@@ -127,14 +119,12 @@ sub getStartupConfigStatements {
   }
 
   my $comments = shift;
-  
-  my $xcp = new XorpConfigParser();
-  $xcp->parse($load_cfg);
-  my $root = $xcp->get_node( () );
-  if (!defined($root)) {
+
+  my @stmts = readStatements($load_cfg);
+  if (scalar(@stmts) == 0) {
     return ();
   }
-  enumerate_branch($root, ( ));
+  enumerate_statements(@stmts);
 
   if (defined $comments && $comments eq 'true') {
       #add comment commands to all nodes
@@ -191,25 +181,12 @@ sub loadConfigHierarchy {
 
   #allows loading from arbritary root
   my $root_node = shift;
-  
-  my $xcp = new XorpConfigParser();
-  $xcp->parse($load_cfg);
-  my $root;
-  my @root_path;
-  if (defined($root_node)) {
-      my $tmp = [split("/",$root_node)];
-      $root = $xcp->get_node($tmp);
-      my @tmp2 = split("/",$root_node);
-      @root_path = pop(@tmp2);
-      @root_path = @tmp2;
-  }
-  else {
-      $root = $xcp->get_node( () );
-  }
-  if (!defined($root)) {
+
+  my @stmts = readStatements($load_cfg, $root_node);
+  if (scalar(@stmts) == 0) {
     return ();
   }
-  enumerate_branch($root, @root_path);
+  enumerate_statements(@stmts);
 
   return generateHierarchy(\@all_naked_nodes);
 }
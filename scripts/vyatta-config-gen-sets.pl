@@ -24,39 +24,9 @@
 
 use strict;
 use warnings;
-use lib "/opt/vyatta/share/perl5/";
-use Vyatta::ConfigLoad;
-
-my $conf_file;
-my $conf_tmp = "/tmp/config.boot.$$";
-
-if (defined $ARGV[0]) {
-    $conf_file = $ARGV[0];
-} else {
-    system("cli-shell-api showCfg --show-active-only  > $conf_tmp");
-    $conf_file = $conf_tmp;
-}
-
-# get a list of all config statement in the startup config file
-my %cfg_hier = Vyatta::ConfigLoad::getStartupConfigStatements($conf_file);
-my @all_nodes    = @{ $cfg_hier{'set'} };
-if (scalar(@all_nodes) == 0) {
-  # no config statements
-  exit 1;
-}
-
-my $ret = 0;
-foreach (@all_nodes) {
-  my ($path_ref) = @$_;
-  my $elements = scalar(@$path_ref);
-  my @non_leaf = @$path_ref[0 .. ($elements - 2)] ;
-  my $path = join(' ', @non_leaf);
-  $path =~ s/'//g;
-  my $cmd = "set $path " . @$path_ref[($elements - 1)];
-  print "$cmd\n";
-}
-
-system("rm -f $conf_tmp") if $conf_file eq $conf_tmp;
-
-exit 0;
 
+# vyatta-config-sets does the work, reading the running config from
+# configd when no file is given. It exits 1 if there are no statements,
+# and 2 if the config can't be read or isn't well formed.
+exec('/opt/vyatta/sbin/vyatta-config-sets', defined($ARGV[0]) ? $ARGV[0] : ())
+  or die "Unable to run vyatta-config-sets: $!\n";
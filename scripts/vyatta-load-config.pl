@@ -107,21 +107,18 @@ openlog( $0, "", LOG_USER );
 my $login = getlogin() || getpwuid($<) || "unknown";
 syslog( "warning", "Load config [$orig_load_file] by $login" );
 
-# do config migration via configd since this script is called by unprivileged users directly.
-system("cli-shell-api migrateFile $load_file");
-
 # when presenting to users, show shortened /config path
 my $shortened_load_file = get_short_config_path($load_file);
 print "Loading configuration from '$shortened_load_file'...\n";
 
-my $cobj = new Vyatta::Config;
-# "load" => use backend through API
-system("cli-shell-api loadFileReportWarnings $load_file");
-
-if (!($cobj->sessionChanged())) {
+# migrate and load via configd, since this script is called by
+# unprivileged users directly. Exits 2 if the session is unchanged.
+my $rc = system("cli-shell-api", "--migrate", "loadFile", $load_file);
+if ($rc == 2 << 8) {
   print "No configuration changes to commit\n";
   exit 0;
 }
+exit 1 if $rc != 0;
 
 print ("\nLoad complete.  Use 'commit' to make changes active.\n");
 exit 0;
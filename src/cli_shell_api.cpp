@@ -17,8 +17,14 @@
 #include <string.h>
 #include <syslog.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <string>
+#include <vector>
+
+#include <jansson.h>
+
 #include <rpc.h>
 #include <vyatta-util/map.h>
 #include <vyatta-util/vector.h>
@@ -59,8 +65,15 @@ int op_show_ignore_edit = 0;
 int op_show_args_as_path = 0;
 char *op_show_cfg1 = NULL;
 char *op_show_cfg2 = NULL;
+/* loadFile options */
+int op_load_migrate = 0;
+/* global options */
+int op_stats = 0;
+int op_trace = 0;
 
 typedef void (*OpFuncT)(struct configd_conn *, const char *);
+/* for ops that take their arguments as given rather than joined */
+typedef void (*OpArgvFuncT)(struct configd_conn *, char **, int);
 
 typedef struct {
 	const char *op_name;
@@ -72,10 +85,12 @@ typedef struct {
 	bool op_insert_edit; // insert after command (e.g., getCompletionEnv show)
 	bool op_use_conn; // operation needs configd connection
 	OpFuncT op_func;
+	OpArgvFuncT op_argv_func;
 } OpT;
 
 const char EPATH_ENV[] = "VYATTA_EDIT_LEVEL";
 const char SID_ENV[] = "VYATTA_CONFIG_SID";
+const char TRACE_ENV[] = "CLI_SHELL_API_TRACE";
 const char EDIT_FMT[] = "export VYATTA_EDIT_LEVEL='%s'; "
 	"export PS1='[edit%s%s]\\n\\u@\\h# ';";
 
@@ -476,6 +491,100 @@ returnEffectiveValues(struct configd_conn *conn, const char *args)
 	list_nodes(conn, EFFECTIVE, args);
 }
 
+/* appends str to out single quoted for the shell */
+static void
+shell_quote(std::string &out, const char *str)
+{
+	out += '\'';
+	for (; *str; str++) {
+		if (*str == '\'')
+			out += "'\\''";
+		else
+			out += *str;
+	}
+	out += '\'';
+}
+
+static void
+values_multi(struct configd_conn *conn, int db, char **args, int nargs)
+{
+	std::string values = "declare -A values=(";
+	std::string exists = " exists=(";
+	int n = nargs - 1;
+	std::vector<char *> paths(n);
+	std::vector<struct vector *> vs(n);
+
+	for (int i = 0; i < n; i++) {
+		char *argz = NULL;
+		size_t argz_len = 0;
+
+		if (argz_create_sep(args[0], ' ', &argz, &argz_len)
+		    || argz_add_sep(&argz, &argz_len, args[i + 1], ' '))
+			exit(EXIT_FAILURE);
+		paths[i] = args_to_path(argz, argz_len);
+		free(argz);
+		if (!paths[i])
+			exit(EXIT_FAILURE);
+	}
+	if (configd_node_get_many(conn, db, (const char **)paths.data(), n,
+				  vs.data(), NULL) < 0)
+		exit(EXIT_FAILURE);
+
+	for (int i = 0; i < n; i++) {
+		struct vector *v = vs[i];
+
+		std::string key = "[";
+		shell_quote(key, args[i + 1]);
+		key += "]=";
+
+		std::string val;
+		const char *str = NULL;
+		while (v && (str = vector_next(v, str))) {
+			if (!val.empty())
+				val += '\n';
+			val += str;
+		}
+		if (i > 0) {
+			values += ' ';
+			exists += ' ';
+		}
+		values += key;
+		shell_quote(values, val.c_str());
+		exists += key;
+		exists += v ? '1' : '0';
+		vector_free(v);
+		free(paths[i]);
+	}
+	printf("%s)%s)\n", values.c_str(), exists.c_str());
+}
+
+/* fetches several leaves under one base path over a single connection,
+ * instead of a returnValue/returnValues/exists call for each.
+ *
+ * the base path is a single argument with its components separated by
+ * spaces, as is each leaf. the output MUST be "eval"ed and declares two
+ * associative arrays keyed by leaf as given: "values", holding the value
+ * or the newline separated values of each leaf, and "exists", holding 1
+ * or 0. every leaf has an entry in both. e.g.,
+ *
+ *   eval "$(cli-shell-api getValuesMulti 'interfaces dataplane dp0s1' \
+ *           mtu description address 'ip ospf cost')"
+ *   if [ "${exists[mtu]}" = 1 ]; then mtu=${values[mtu]}; fi
+ *   mapfile -t addrs <<< "${values[address]}"
+ */
+static void
+getValuesMulti(struct configd_conn *conn, char **args, int nargs)
+{
+	values_multi(conn, CANDIDATE, args, nargs);
+}
+
+/* same as getValuesMulti above, from the active config */
+static void
+getActiveValuesMulti(struct configd_conn *conn, char **args, int nargs)
+{
+	values_multi(conn, RUNNING, args, nargs);
+}
+
 /* checks if specified path is a valid "template path" *without* checking
  * the validity of any "tag values" along the path.
  */
@@ -565,24 +674,23 @@ static int get_show_flags(void)
 static void
 showCfg(struct configd_conn *conn, const char *args)
 {
-	char *result;
+	int result;
 	bool inSession = configd_sess_exists(conn, NULL);
 	bool active_only = (!inSession || op_show_active_only);
 	bool working_only = (inSession && op_show_working_only);
 	int flags = get_show_flags();
 
+	fflush(stdout);
 	if (active_only)
 		/* just show the active config (no diff) */
-		result = configd_show(conn, RUNNING, args, ACTIVE_CFG, ACTIVE_CFG, flags, NULL);
+		result = configd_show_to_fd(conn, RUNNING, args, ACTIVE_CFG, ACTIVE_CFG, flags, STDOUT_FILENO, NULL);
 	else if (working_only)
-		result = configd_show(conn, CANDIDATE, args, WORKING_CFG, WORKING_CFG, flags, NULL);
+		result = configd_show_to_fd(conn, CANDIDATE, args, WORKING_CFG, WORKING_CFG, flags, STDOUT_FILENO, NULL);
 	else
-		result = configd_show(conn, CANDIDATE, args, ACTIVE_CFG, WORKING_CFG, flags, NULL);
+		result = configd_show_to_fd(conn, CANDIDATE, args, ACTIVE_CFG, WORKING_CFG, flags, STDOUT_FILENO, NULL);
 
-	if (!result)
+	if (result < 0)
 		exit(EXIT_FAILURE);
-	printf("%s", result);
-	free(result);
 }
 
 /* new "show" API providing superset of functionality of showCfg above.
@@ -621,7 +729,6 @@ showConfig(struct configd_conn *conn, const char *args)
 {
 	const char *cfg1 = ACTIVE_CFG;
 	const char *cfg2 = WORKING_CFG;
-	char *result;
 	int flags = get_show_flags();
 
 	if (op_show_active_only) {
@@ -640,17 +747,41 @@ showConfig(struct configd_conn *conn, const char *args)
 		db = CANDIDATE;
 	}
 
-	result = configd_show(conn, db, args, cfg1, cfg2, flags, NULL);
-	if (!result)
+	/* written straight to stdout, saving a large config does not need
+	 * to hold a copy of it */
+	fflush(stdout);
+	if (configd_show_to_fd(conn, db, args, cfg1, cfg2, flags, STDOUT_FILENO, NULL) < 0)
 		exit(EXIT_FAILURE);
-	printf("%s", result);
-	free(result);
+}
+
+/* loadFile --migrate exit status when nothing was changed */
+#define EXIT_UNCHANGED 2
+
+/* migrates the file and loads it with its warnings, in one round trip */
+static void
+loadFileMigrate(struct configd_conn *conn, const char *args)
+{
+	struct configd_error err = {0};
+	int changed = configd_load_migrate(conn, args, &err);
+
+	if (err.text != NULL) {
+		printf("%s\n", err.text);
+	}
+	configd_error_free(&err);
+	if (changed < 0)
+		exit(EXIT_FAILURE);
+	if (changed == 0)
+		exit(EXIT_UNCHANGED);
 }
 
 static void
 loadFile(struct configd_conn *conn, const char *args)
 {
 	struct configd_error err;
+	if (op_load_migrate) {
+		loadFileMigrate(conn, args);
+		return;
+	}
 	if (configd_load(conn, args, &err) != 1) {
 		if (err.text != NULL) {
 			printf("%s\n", err.text);
@@ -724,25 +855,181 @@ getPostCommitHookDir(struct configd_conn *conn, const char *args)
 static void
 getTree(struct configd_conn *conn, const char *args)
 {
-	char *str = configd_tree_get(conn, CANDIDATE, args, NULL);
-	if (!str)
+	fflush(stdout);
+	if (configd_tree_get_to_fd(conn, CANDIDATE, args, STDOUT_FILENO, NULL) < 0)
 		exit(EXIT_FAILURE);
-	
-	printf("%s\n", str);
-	free(str);
+	printf("\n");
 }
 
 static void
 getActiveTree(struct configd_conn *conn, const char *args)
 {
-	char *str = configd_tree_get(conn, RUNNING, args, NULL);
+	fflush(stdout);
+	if (configd_tree_get_to_fd(conn, RUNNING, args, STDOUT_FILENO, NULL) < 0)
+		exit(EXIT_FAILURE);
+	printf("\n");
+}
+
+/* member names may carry a module prefix */
+static const char *
+export_name(const char *key)
+{
+	const char *colon = strchr(key, ':');
+	return colon ? colon + 1 : key;
+}
+
+static void
+export_scalar(std::string &val, json_t *j)
+{
+	char buf[32];
+
+	switch (json_typeof(j)) {
+	case JSON_STRING:
+		val += json_string_value(j);
+		break;
+	case JSON_INTEGER:
+		snprintf(buf, sizeof(buf), "%" JSON_INTEGER_FORMAT,
+			 json_integer_value(j));
+		val += buf;
+		break;
+	case JSON_REAL:
+		snprintf(buf, sizeof(buf), "%.17g", json_real_value(j));
+		val += buf;
+		break;
+	case JSON_TRUE:
+		val += "true";
+		break;
+	case JSON_FALSE:
+		val += "false";
+		break;
+	default:
+		/* null is a leaf without a value */
+		break;
+	}
+}
+
+/* paths are built with a leading space, which is dropped here */
+static void
+export_entry(std::string &out, const std::string &path, const std::string &val)
+{
+	out += " [";
+	shell_quote(out, path.c_str() + 1);
+	out += "]=";
+	shell_quote(out, val.c_str());
+}
+
+static void export_node(std::string &out, const std::string &path, json_t *node);
+
+/* exports each member of obj below path, except skip, and returns their
+ * names one per line
+ */
+static std::string
+export_children(std::string &out, const std::string &path, json_t *obj,
+		const char *skip)
+{
+	std::string names;
+	const char *key;
+	json_t *child;
+
+	json_object_foreach(obj, key, child) {
+		const char *name = export_name(key);
+
+		if (skip && strcmp(name, skip) == 0)
+			continue;
+		if (!names.empty())
+			names += '\n';
+		names += name;
+		export_node(out, path + " " + name, child);
+	}
+	return names;
+}
+
+static void
+export_node(std::string &out, const std::string &path, json_t *node)
+{
+	std::string val;
+	size_t i;
+	json_t *elem;
+
+	if (json_is_object(node)) {
+		val = export_children(out, path, node, NULL);
+	} else if (json_is_object(json_array_get(node, 0))) {
+		/* a tag node: list entries are keyed by their "tagnode" */
+		json_array_foreach(node, i, elem) {
+			std::string tag;
+			json_t *jtag = json_object_get(elem, "tagnode");
+
+			if (!jtag)
+				continue;
+			export_scalar(tag, jtag);
+			if (!val.empty())
+				val += '\n';
+			val += tag;
+			std::string tpath = path + " " + tag;
+			export_entry(out, tpath,
+				     export_children(out, tpath, elem, "tagnode"));
+		}
+	} else if (json_is_array(node)) {
+		/* a multi node */
+		json_array_foreach(node, i, elem) {
+			if (i > 0)
+				val += '\n';
+			export_scalar(val, elem);
+		}
+	} else {
+		export_scalar(val, node);
+	}
+	export_entry(out, path, val);
+}
+
+static void
+export_tree(struct configd_conn *conn, int db, const char *args)
+{
+	char *str = configd_tree_get(conn, db, args, NULL);
 	if (!str)
 		exit(EXIT_FAILURE);
-	
-	printf("%s\n", str);
+
+	json_t *tree = json_loads(str, 0, NULL);
 	free(str);
+	if (!json_is_object(tree))
+		exit(EXIT_FAILURE);
+
+	std::string out = "declare -A cfg=(";
+	const char *key;
+	json_t *child;
+	json_object_foreach(tree, key, child)
+		export_node(out, std::string(" ") + export_name(key), child);
+	json_decref(tree);
+	printf("%s )\n", out.c_str());
 }
 
+/* outputs the subtree at the specified path, fetched with a single
+ * request, as a "declare -A cfg" statement that MUST be "eval"ed.
+ *
+ * the keys are the space separated paths of every node in the tree that
+ * configd returns for the path, which is rooted at its last component.
+ * a leaf maps to its value, a multi node to its values and any other
+ * node to the names of its children (tag values for a tag node), one
+ * per line. e.g.,
+ *
+ *   eval "$(cli-shell-api exportTree interfaces dataplane)"
+ *   mapfile -t intfs <<< "${cfg[dataplane]}"
+ *   for intf in "${intfs[@]}"; do
+ *     echo "$intf mtu ${cfg[dataplane $intf mtu]}"
+ *   done
+ */
+static void
+exportTree(struct configd_conn *conn, const char *args)
+{
+	export_tree(conn, CANDIDATE, args);
+}
+
+/* same as exportTree above, from the active config */
+static void
+exportActiveTree(struct configd_conn *conn, const char *args)
+{
+	export_tree(conn, RUNNING, args);
+}
 
 static void
 migrateFile(struct configd_conn *conn, const char *filename)
@@ -767,7 +1054,10 @@ migrateFile(struct configd_conn *conn, const char *filename)
 
 
 #define OP(name, exact, exact_err, min, min_err, use_edit, insert_edit, use_conn)	\
-	{ #name, exact, exact_err, min, min_err, use_edit, insert_edit, use_conn, &name }
+	{ #name, exact, exact_err, min, min_err, use_edit, insert_edit, use_conn, &name, NULL }
+/* ops given their arguments as is never use the edit level */
+#define OP_ARGV(name, exact, exact_err, min, min_err)	\
+	{ #name, exact, exact_err, min, min_err, !USE_EDIT, !INS_EDIT, USE_CONN, NULL, &name }
 
 #define USE_CONN true
 #define USE_EDIT true
@@ -818,6 +1108,9 @@ static OpT ops[] = {
 	OP(returnActiveValues, -1, NULL, 1, "Must specify config path", false, false, USE_CONN),
 	OP(returnEffectiveValues, -1, NULL, 1, "Must specify config path", false, false, USE_CONN),
 
+	OP_ARGV(getValuesMulti, -1, NULL, 2, "Must specify base path and leaves"),
+	OP_ARGV(getActiveValuesMulti, -1, NULL, 2, "Must specify base path and leaves"),
+
 	OP(validateTmplPath, -1, NULL, 1, "Must specify config path", true, false, USE_CONN),
 	OP(validateTmplValPath, -1, NULL, 1, "Must specify config path", false, false, USE_CONN),
 	OP(getTmplAllowed, -1, NULL, 1, "Must specify config path", false, false, USE_CONN),
@@ -834,6 +1127,8 @@ static OpT ops[] = {
 
 	OP(getTree, -1, NULL, -1, NULL, true, false, USE_CONN),
 	OP(getActiveTree, -1, NULL, -1, NULL, true, false, USE_CONN),
+	OP(exportTree, -1, NULL, -1, NULL, true, false, USE_CONN),
+	OP(exportActiveTree, -1, NULL, -1, NULL, true, false, USE_CONN),
 
 	OP(migrateFile, -1, NULL, 1, "Must specify filename", !USE_EDIT, !INS_EDIT, USE_CONN),
 
@@ -847,6 +1142,7 @@ static OpT ops[] = {
 #define OP_insert_edit ops[op_idx].op_insert_edit
 #define OP_use_conn    ops[op_idx].op_use_conn
 #define OP_func        ops[op_idx].op_func
+#define OP_argv_func   ops[op_idx].op_argv_func
 #define OP_name        ops[op_idx].op_name
 
 enum {
@@ -854,6 +1150,127 @@ enum {
 	SHOW_CFG2
 };
 
+/* --stats and --trace. Most operations exit from inside OP_func, so the
+ * report is made from an exit handler as well as before a normal close.
+ */
+static struct {
+	struct configd_conn *conn;
+	const char *op;
+	char **args;
+	int nargs;
+	struct timespec start;
+	unsigned long long connect_us;
+	FILE *trace;
+	bool reported;
+} prof;
+
+static unsigned long long
+usecs_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000ULL
+		+ now.tv_nsec / 1000 - start->tv_nsec / 1000;
+}
+
+static void
+report_profile(void)
+{
+	const struct configd_conn_stats *cs = NULL;
+	unsigned long long wall_us, wait_us = 0;
+	unsigned long requests = 0;
+
+	if (prof.reported || (!op_stats && !op_trace))
+		return;
+	prof.reported = true;
+
+	wall_us = usecs_since(&prof.start);
+	if (prof.conn)
+		cs = configd_conn_stats(prof.conn);
+	for (size_t i = 0; cs && i < cs->num_methods; i++) {
+		requests += cs->methods[i].calls;
+		wait_us += cs->methods[i].total_us;
+	}
+
+	if (op_stats) {
+		fprintf(stderr, "cli-shell-api %s: %lu requests, %.3f ms total, "
+			"%.3f ms connecting, %.3f ms waiting for configd\n",
+			prof.op, requests, wall_us / 1000.0,
+			prof.connect_us / 1000.0, wait_us / 1000.0);
+		if (cs)
+			configd_conn_stats_dump(prof.conn, stderr);
+	}
+
+	if (prof.trace) {
+		json_t *jargs = json_array();
+		for (int i = 0; i < prof.nargs; i++)
+			json_array_append_new(jargs, json_string(prof.args[i]));
+		json_t *jline = json_pack("{s:i, s:s, s:o, s:i, s:I, s:I, s:I}",
+					  "pid", (int)getpid(),
+					  "op", prof.op,
+					  "args", jargs,
+					  "requests", (int)requests,
+					  "connect_us", (json_int_t)prof.connect_us,
+					  "wait_us", (json_int_t)wait_us,
+					  "wall_us", (json_int_t)wall_us);
+		char *line = jline ? json_dumps(jline, JSON_COMPACT) : NULL;
+		if (line) {
+			fprintf(prof.trace, "%s\n", line);
+			free(line);
+		}
+		json_decref(jline);
+		if (prof.trace != stderr)
+			fclose(prof.trace);
+		prof.trace = NULL;
+	}
+}
+
+static void
+start_profile(const char *op, char **args, int nargs)
+{
+	if (!op_stats && !op_trace)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &prof.start);
+	prof.op = op;
+	prof.args = args;
+	prof.nargs = nargs;
+
+	if (op_trace) {
+		const char *file = getenv(TRACE_ENV);
+
+		prof.trace = file ? fopen(file, "ae") : stderr;
+		if (!prof.trace) {
+			fprintf(stderr, "Unable to open %s: %s\n", file,
+				strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		/* the file is shared by every invocation, one write per line */
+		setvbuf(prof.trace, NULL, _IOLBF, 0);
+	}
+	atexit(report_profile);
+}
+
+static int
+open_connection(struct configd_conn *conn)
+{
+	struct timespec start;
+
+	if (!op_stats && !op_trace)
+		return configd_open_connection(conn);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (configd_open_connection(conn) == -1)
+		return -1;
+	prof.connect_us = usecs_since(&start);
+	prof.conn = conn;
+	configd_conn_stats_enable(conn);
+	if (prof.trace)
+		configd_conn_stats_trace(conn, prof.trace);
+	return 0;
+}
+
 struct option options[] = {
 	{"path", no_argument, &op_show_args_as_path, 1},
 	{"show-active-only", no_argument, &op_show_active_only, 1},
@@ -865,6 +1282,9 @@ struct option options[] = {
 	{"show-ignore-edit", no_argument, &op_show_ignore_edit, 1},
 	{"show-cfg1", required_argument, NULL, SHOW_CFG1},
 	{"show-cfg2", required_argument, NULL, SHOW_CFG2},
+	{"migrate", no_argument, &op_load_migrate, 1},
+	{"stats", no_argument, &op_stats, 1},
+	{"trace", no_argument, &op_trace, 1},
 	{NULL, 0, NULL, 0}
 };
 
@@ -914,6 +1334,7 @@ main(int argc, char **argv)
 		fprintf(stderr, "Invalid operation\n");
 		exit(EXIT_FAILURE);
 	}
+	start_profile(oname, nargv, nargs);
 	if (OP_exact_args >= 0 && nargs != OP_exact_args) {
 		fprintf(stderr, "%s\n", OP_exact_error);
 		exit(EXIT_FAILURE);
@@ -938,7 +1359,7 @@ main(int argc, char **argv)
 	if (argz_create(nargv, &args, &args_len))
 		exit(EXIT_FAILURE);
 
-	if (configd_open_connection(&conn) == -1) {
+	if (open_connection(&conn) == -1) {
 		fprintf(stderr, "Unable to open connection: %s\n", strerror(errno));
 		result = EXIT_FAILURE;
 		goto done;
@@ -950,6 +1371,10 @@ main(int argc, char **argv)
 
 	/*Commands that do not require edit level but require connection*/
 	if (!OP_use_edit) {
+		if (OP_argv_func) {
+			OP_argv_func(&conn, nargv, nargs);
+			goto done_conn;
+		}
 		if (OP_func != saveConfig && OP_func != loadFile
 			&& OP_func != loadFileReportWarnings
 		    && OP_func != showCfg && OP_func != showConfig
@@ -998,6 +1423,7 @@ main(int argc, char **argv)
 	OP_func(&conn, path);
 
 done_conn:
+	report_profile();
 	configd_close_connection(&conn);
 done:
 	free(args);
@@ -6,7 +6,6 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 #include <unistd.h>
-#include <uriparser/Uri.h>
 
 #include <vyatta-util/map.h>
 #include <vyatta-util/vector.h>
@@ -20,14 +19,11 @@
 #include "transaction.h"
 #include "template.h"
 #include "callrpc.h"
+#include "async.h"
+#include "path.h"
+#include "internal.h"
 #include "CfgClient.hpp"
 
-/*
- *  URI_MULT is defined by the uriparser documenation to need to be 6 when expanding breaks
- *  http://uriparser.sourceforge.net/doc/html/Uri_8h.html#a0d501e7c2a6abe76b729ea72e123dea8
- */
-#define URI_MULT 6
-
 typedef int (intapi)(struct configd_conn *, struct configd_error *);
 typedef int (intapistr)(struct configd_conn *, const char *, struct configd_error *);
 typedef int (intapiintstr)(struct configd_conn *, int, const char *, struct configd_error *);
@@ -40,24 +36,23 @@ typedef struct vector *(vecapiintstr)(struct configd_conn *, int, const char *,
 typedef struct map *(mapapi)(struct configd_conn *, struct configd_error *);
 typedef struct map *(mapapistr)(struct configd_conn *, const char *, struct configd_error *);
 typedef struct map *(mapapiintstr)(struct configd_conn *, int, const char *, struct configd_error *);
-
-static std::string url_escape(const std::string &s)
-{
-	char *out = new char[s.length() * URI_MULT];
-	uriEscapeA(s.c_str(), out, URI_FALSE, URI_TRUE);
-	std::string outs = out;
-	delete[] out;
-	return outs;
-}
+typedef int (manyapi)(struct configd_conn *, const char **, size_t, char **, struct configd_error *);
 
 static std::string mkpath(const std::vector<std::string> &cfgpath)
 {
-	std::string path("/");
+	size_t len = 1;
+	for (size_t i = 0; i < cfgpath.size(); ++i) {
+		len += (i ? 1 : 0)
+			+ configd_path_escape_len(cfgpath[i].data(), cfgpath[i].length());
+	}
+
+	std::string path(len, '/');
+	char *p = &path[1];
 	for (size_t i = 0; i < cfgpath.size(); ++i) {
 		if (i) {
-			path += "/";
+			p++;
 		}
-		path += url_escape(cfgpath[i]);
+		p = configd_path_escape(p, cfgpath[i].data(), cfgpath[i].length());
 	}
 	return path;
 }
@@ -303,6 +298,127 @@ void string2vec(std::string s, std::vector<std::string> &out) {
 	}
 }
 
+CfgTree::CfgTree() : _json(NULL)
+{
+}
+
+CfgTree::CfgTree(json_t *json) : _json(json)
+{
+}
+
+CfgTree::CfgTree(const CfgTree &other) : _json(json_incref(other._json))
+{
+}
+
+CfgTree &CfgTree::operator=(const CfgTree &other)
+{
+	json_t *old = _json;
+
+	_json = json_incref(other._json);
+	json_decref(old);
+	return *this;
+}
+
+CfgTree::~CfgTree()
+{
+	json_decref(_json);
+}
+
+CfgTree::Type CfgTree::GetType() const
+{
+	switch (json_typeof(_json ? _json : json_null())) {
+	case JSON_TRUE:
+	case JSON_FALSE:
+		return BOOLEAN;
+	case JSON_INTEGER:
+		return INTEGER;
+	case JSON_REAL:
+		return REAL;
+	case JSON_STRING:
+		return STRING;
+	case JSON_ARRAY:
+		return ARRAY;
+	case JSON_OBJECT:
+		return OBJECT;
+	default:
+		return NULL_VALUE;
+	}
+}
+
+bool CfgTree::GetBool() const
+{
+	return json_is_true(_json);
+}
+
+long long CfgTree::GetInt() const
+{
+	return json_integer_value(_json);
+}
+
+double CfgTree::GetReal() const
+{
+	return json_real_value(_json);
+}
+
+std::string CfgTree::GetString() const
+{
+	return std::string(json_is_string(_json) ? json_string_value(_json) : "",
+			   json_string_length(_json));
+}
+
+const char *CfgTree::GetCString() const
+{
+	return json_string_value(_json);
+}
+
+size_t CfgTree::GetStringLength() const
+{
+	return json_string_length(_json);
+}
+
+size_t CfgTree::Size() const
+{
+	if (json_is_object(_json))
+		return json_object_size(_json);
+	return json_array_size(_json);
+}
+
+CfgTree CfgTree::At(size_t index) const
+{
+	return CfgTree(json_incref(json_array_get(_json, index)));
+}
+
+std::vector<std::string> CfgTree::Names() const
+{
+	std::vector<std::string> names;
+	const char *name;
+	json_t *value;
+
+	names.reserve(json_object_size(_json));
+	json_object_foreach(_json, name, value)
+		names.push_back(name);
+	return names;
+}
+
+bool CfgTree::Has(const std::string &name) const
+{
+	return json_object_get(_json, name.c_str()) != NULL;
+}
+
+CfgTree CfgTree::Get(const std::string &name) const
+{
+	return CfgTree(json_incref(json_object_get(_json, name.c_str())));
+}
+
+CfgTree CfgTree::Get(const std::vector<std::string> &path) const
+{
+	json_t *json = _json;
+
+	for (size_t i = 0; i < path.size() && json; i++)
+		json = json_object_get(json, path[i].c_str());
+	return CfgTree(json_incref(json));
+}
+
 CfgClient::CfgClient() throw(CfgClientFatalException)
 {
 	_conn = new struct configd_conn;
@@ -316,6 +432,14 @@ CfgClient::CfgClient() throw(CfgClientFatalException)
 	}
 }
 
+CfgClient::CfgClient(bool shared) throw(CfgClientFatalException)
+	: CfgClient()
+{
+	if (shared && configd_conn_mux_enable(_conn) < 0) {
+		throw(CfgClientFatalException("failed to share configd connection"));
+	}
+}
+
 CfgClient::~CfgClient()
 {
 	configd_close_connection(_conn);
@@ -413,6 +537,45 @@ std::string CfgClient::Delete(const std::vector<std::string> &path) throw(CfgCli
 	return callstrapi(_conn, configd_delete, path);
 }
 
+static std::vector<std::string> callmanyapi(struct configd_conn *_conn, manyapi *api, const std::vector<std::vector<std::string> > &paths) throw(CfgClientException)
+{
+	struct configd_error err = { 0, };
+	std::vector<std::string> cpaths(paths.size());
+	std::vector<const char *> cstrs(paths.size());
+	std::vector<char *> errors(paths.size());
+	std::vector<std::string> out(paths.size());
+
+	for (size_t i = 0; i < paths.size(); ++i) {
+		cpaths[i] = mkpath(paths[i]);
+		cstrs[i] = cpaths[i].c_str();
+	}
+	int result = api(_conn, cstrs.data(), cstrs.size(), errors.data(), &err);
+	for (size_t i = 0; i < errors.size(); ++i) {
+		if (errors[i])
+			out[i] = errors[i];
+		free(errors[i]);
+	}
+	if (result < 0) {
+		std::string msg;
+		if (err.text)
+			msg = err.text;
+		configd_error_free(&err);
+		throw(CfgClientException(msg));
+	}
+	configd_error_free(&err);
+	return out;
+}
+
+std::vector<std::string> CfgClient::SetMany(const std::vector<std::vector<std::string> > &paths) throw(CfgClientException)
+{
+	return callmanyapi(_conn, configd_set_many, paths);
+}
+
+std::vector<std::string> CfgClient::DeleteMany(const std::vector<std::vector<std::string> > &paths) throw(CfgClientException)
+{
+	return callmanyapi(_conn, configd_delete_many, paths);
+}
+
 std::string CfgClient::ValidatePath(const std::vector<std::string> &path) throw(CfgClientException)
 {
 	return callstrapi(_conn, configd_validate_path, path);
@@ -586,6 +749,55 @@ std::string CfgClient::TreeGet(Database db, const std::vector<std::string> &path
 	return callstrapi(_conn, configd_tree_get, db, path);
 }
 
+CfgTree CfgClient::treeGetParsed(Database db, const std::vector<std::string> &path, const std::string &encoding, const char *fn, unsigned int flags) throw(CfgClientException)
+{
+	struct configd_error err = { 0, };
+	std::string cpath = mkpath(path);
+	json_t *result = tree_get_json(_conn, db, cpath.c_str(), encoding.c_str(), fn, flags, &err);
+	if (result == NULL) {
+		std::string msg;
+		if (err.text)
+			msg = err.text;
+		configd_error_free(&err);
+		throw(CfgClientException(msg));
+	}
+	return CfgTree(result);
+}
+
+/*
+ * The tree at path with each of the flags, read in one round trip so
+ * that no commit comes between them.
+ */
+std::vector<CfgTree> CfgClient::treeGetParsed(Database db, const std::vector<std::string> &path, const std::string &encoding, const char *fn, const std::vector<unsigned int> &flags) throw(CfgClientException)
+{
+	struct configd_error err = { 0, };
+	std::string cpath = mkpath(path);
+	std::vector<json_t *> results(flags.size());
+	if (tree_get_json_many(_conn, db, cpath.c_str(), encoding.c_str(), fn,
+			       flags.data(), flags.size(), results.data(), &err) < 0) {
+		std::string msg;
+		if (err.text)
+			msg = err.text;
+		configd_error_free(&err);
+		throw(CfgClientException(msg));
+	}
+	std::vector<CfgTree> trees;
+	trees.reserve(results.size());
+	for (size_t i = 0; i < results.size(); i++)
+		trees.push_back(CfgTree(results[i]));
+	return trees;
+}
+
+CfgTree CfgClient::TreeGetParsed(Database db, const std::vector<std::string> &path, const std::string &encoding) throw(CfgClientException)
+{
+	return treeGetParsed(db, path, encoding, "TreeGet", CONFIGD_TREEGET_ALL);
+}
+
+CfgTree CfgClient::TreeGetFullParsed(Database db, const std::vector<std::string> &path, const std::string &encoding) throw(CfgClientException)
+{
+	return treeGetParsed(db, path, encoding, "TreeGetFull", CONFIGD_TREEGET_ALL);
+}
+
 std::string CfgClient::TreeGetXML(Database db, const std::vector<std::string> &path) throw(CfgClientException)
 {
 	return callstrapi(_conn, configd_tree_get_xml, db, path);
@@ -690,4 +902,134 @@ std::string CfgClient::CopyConfig(
 	return res;
 }
 
+static unsigned int startasync(int id, struct configd_error *err) throw(CfgClientException)
+{
+	if (id < 0) {
+		std::string msg;
+		if (err->text)
+			msg = err->text;
+		configd_error_free(err);
+		throw(CfgClientException(msg));
+	}
+	return id;
+}
+
+CfgClientAsync::CfgClientAsync() throw(CfgClientFatalException)
+	: _failed(false)
+{
+	_conn = new struct configd_conn;
+	if (configd_open_connection(_conn) < 0) {
+		delete _conn;
+		throw(CfgClientFatalException("failed to connect to configd"));
+	}
+	if (configd_conn_async_enable(_conn) < 0) {
+		configd_close_connection(_conn);
+		delete _conn;
+		throw(CfgClientFatalException("failed to make configd connection non-blocking"));
+	}
+	char *sid = getenv("VYATTA_CONFIG_SID");
+	if (sid != NULL) {
+		configd_set_session_id(_conn, sid);
+	}
+}
+
+CfgClientAsync::~CfgClientAsync()
+{
+	configd_close_connection(_conn);
+	delete _conn;
+}
+
+void CfgClientAsync::SetSessionId(const std::string &sessid)
+{
+	configd_set_session_id(_conn, sessid.c_str());
+}
+
+int CfgClientAsync::Fd(void)
+{
+	return _conn->fd;
+}
+
+unsigned int CfgClientAsync::TreeGet(CfgClient::Database db, const std::vector<std::string> &path, const std::string &encoding) throw(CfgClientException)
+{
+	struct configd_error err = { 0, };
+	std::string cpath = mkpath(path);
+	return startasync(configd_async_tree_get(_conn, db, cpath.c_str(), encoding.c_str(), &err), &err);
+}
+
+unsigned int CfgClientAsync::NodeGet(CfgClient::Database db, const std::vector<std::string> &path) throw(CfgClientException)
+{
+	struct configd_error err = { 0, };
+	std::string cpath = mkpath(path);
+	return startasync(configd_async_node_get(_conn, db, cpath.c_str(), &err), &err);
+}
+
+unsigned int CfgClientAsync::Set(const std::vector<std::string> &path) throw(CfgClientException)
+{
+	struct configd_error err = { 0, };
+	std::string cpath = mkpath(path);
+	return startasync(configd_async_set(_conn, cpath.c_str(), &err), &err);
+}
+
+unsigned int CfgClientAsync::Delete(const std::vector<std::string> &path) throw(CfgClientException)
+{
+	struct configd_error err = { 0, };
+	std::string cpath = mkpath(path);
+	return startasync(configd_async_delete(_conn, cpath.c_str(), &err), &err);
+}
+
+unsigned int CfgClientAsync::Commit(const std::string &comment) throw(CfgClientException)
+{
+	struct configd_error err = { 0, };
+	return startasync(configd_async_commit(_conn, comment.c_str(), &err), &err);
+}
+
+unsigned int CfgClientAsync::CallRPC(const std::string ns, const std::string name, const std::string input) throw(CfgClientException)
+{
+	struct configd_error err = { 0, };
+	return startasync(configd_async_call_rpc(_conn, ns.c_str(), name.c_str(), input.c_str(), &err), &err);
+}
+
+bool CfgClientAsync::Flush(void) throw(CfgClientFatalException)
+{
+	int ret = configd_async_flush(_conn);
+	if (ret < 0) {
+		throw(CfgClientFatalException("failed to write to configd"));
+	}
+	return ret > 0;
+}
+
+int CfgClientAsync::Read(void) throw(CfgClientFatalException)
+{
+	int ret = configd_async_read(_conn);
+	if (ret < 0) {
+		throw(CfgClientFatalException("lost connection to configd"));
+	}
+	return ret;
+}
+
+unsigned int CfgClientAsync::NextResult(void)
+{
+	struct configd_error err = { 0, };
+	unsigned int id;
+	char *result;
+
+	if (configd_async_result(_conn, &id, &result, &err) <= 0) {
+		return 0;
+	}
+	_failed = result == NULL;
+	_result = result ? result : "";
+	_error = err.text ? err.text : "";
+	free(result);
+	configd_error_free(&err);
+	return id;
+}
+
+std::string CfgClientAsync::Result(void) throw(CfgClientException)
+{
+	if (_failed) {
+		throw(CfgClientException(_error));
+	}
+	return _result;
+}
+
 // Private functions
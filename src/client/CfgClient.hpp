@@ -24,6 +24,7 @@
 
 struct configd_conn;
 struct configd_error;
+struct json_t;
 
 void string2vec(std::string s, std::vector<std::string> &out);
 
@@ -57,6 +58,63 @@ private:
 	std::string _msg;
 };
 
+/**
+ * CfgTree is a configuration tree, or a value within one, as parsed from
+ * its JSON encoding by CfgClient::TreeGetParsed(). Copies share the parsed
+ * data, which lasts as long as any of them does. Asking a value for the
+ * wrong type gives an empty result.
+ */
+class CfgTree
+{
+public:
+	enum Type {
+		NULL_VALUE,
+		BOOLEAN,
+		INTEGER,
+		REAL,
+		STRING,
+		ARRAY,
+		OBJECT
+	};
+
+	CfgTree();
+	CfgTree(const CfgTree &other);
+	CfgTree &operator=(const CfgTree &other);
+	~CfgTree();
+
+	Type GetType() const;
+	bool GetBool() const;
+	long long GetInt() const;
+	double GetReal() const;
+	std::string GetString() const;
+	/**
+	 * GetCString() is the value of a STRING, without copying it, or
+	 * NULL. It lasts as long as the tree and may contain NULs.
+	 */
+	const char *GetCString() const;
+	size_t GetStringLength() const;
+
+	/**
+	 * Size() is the number of elements of an ARRAY or members of an
+	 * OBJECT.
+	 */
+	size_t Size() const;
+	CfgTree At(size_t index) const;
+	std::vector<std::string> Names() const;
+	bool Has(const std::string &name) const;
+	CfgTree Get(const std::string &name) const;
+	/**
+	 * Get(path) follows the member names in path from this OBJECT.
+	 */
+	CfgTree Get(const std::vector<std::string> &path) const;
+
+private:
+	friend class CfgClient;
+	friend class ConfigSnapshot;
+	explicit CfgTree(struct json_t *json);
+	struct json_t *_json;
+};
+
 class CfgClient
 {
 public:
@@ -68,6 +126,13 @@ public:
 	 * cannot be established.
 	 */
 	CfgClient() throw(CfgClientFatalException);
+	/**
+	 * CfgClient(shared) is as CfgClient(), but when shared is true the
+	 * one connection may be used by several threads at once. Each call
+	 * then waits only for its own response. Changing the session must
+	 * still be done while no other thread is using the object.
+	 */
+	CfgClient(bool shared) throw(CfgClientFatalException);
 	/**
 	 * ~CfgClient() disconnects from configd.
 	 * This doesn't teardown configuration sessions automatically
@@ -171,6 +236,22 @@ public:
 	 * @return Any informational messages that occurred during delete
 	 */
 	std::string Delete(const std::vector<std::string> &path) throw(CfgClientException);
+	/**
+	 * SetMany() is Set() for each of the paths, sent without waiting
+	 * for each response so that it takes about one round trip rather
+	 * than one per path. Every path is tried, whether or not earlier
+	 * ones fail.
+	 * An exception is thrown only if the connection fails.
+	 * @param paths The paths to the configuration, each represented as a vector
+	 * @return The error for each path, empty for those that were set
+	 */
+	std::vector<std::string> SetMany(const std::vector<std::vector<std::string> > &paths) throw(CfgClientException);
+	/**
+	 * DeleteMany() is Delete() for each of the paths, as SetMany().
+	 * @param paths The paths to the configuration, each represented as a vector
+	 * @return The error for each path, empty for those that were deleted
+	 */
+	std::vector<std::string> DeleteMany(const std::vector<std::vector<std::string> > &paths) throw(CfgClientException);
 	/**
 	 * ValidatePath() checks that the path can be set
 	 * @param path The path to the configuration represented as a vector
@@ -451,6 +532,21 @@ public:
 	 *         the given location.
 	 */
 	std::string TreeGet(Database db, const std::vector<std::string> &path) throw(CfgClientException);
+	/**
+	 * TreeGetParsed() is TreeGetEncoding() for JSON encodings, returning
+	 * the tree already parsed. The response is parsed as it is read,
+	 * without holding the encoded tree in memory at any point.
+	 * @param db The database to get the tree From.
+	 * @param path The configuration path at which to root the sub-tree.
+	 * @param encoding "json" or "rfc7951".
+	 * @return The tree at the given location.
+	 */
+	CfgTree TreeGetParsed(Database db, const std::vector<std::string> &path, const std::string &encoding) throw(CfgClientException);
+	/**
+	 * TreeGetFullParsed() is to TreeGetFullEncoding() as TreeGetParsed()
+	 * is to TreeGetEncoding().
+	 */
+	CfgTree TreeGetFullParsed(Database db, const std::vector<std::string> &path, const std::string &encoding) throw(CfgClientException);
 	/**
 	 * TreeGetXML() provides access to sub-trees of the configuration database.
 	 * This call is equivalent to TreeGetEncoding with XML_ENCODING.
@@ -548,8 +644,84 @@ public:
 		const std::string target_url) throw(CfgClientException);
 
 private:
+	friend class ConfigSnapshot;
+	CfgTree treeGetParsed(Database db, const std::vector<std::string> &path, const std::string &encoding, const char *fn, unsigned int flags) throw(CfgClientException);
+	std::vector<CfgTree> treeGetParsed(Database db, const std::vector<std::string> &path, const std::string &encoding, const char *fn, const std::vector<unsigned int> &flags) throw(CfgClientException);
+
 	std::string _sessionid;
 	struct configd_conn *_conn;
 };
 
+/**
+ * CfgClientAsync is a non-blocking connection to configd, for driving
+ * many requests at once from an event loop; it underlies the Python
+ * binding's asyncio client. Starting a request returns its id straight
+ * away. Call Flush() whenever Fd() is writable and there is output
+ * pending, and Read() whenever it is readable, then NextResult() and
+ * Result() until NextResult() returns 0.
+ */
+class CfgClientAsync
+{
+public:
+	/**
+	 * CfgClientAsync() connects to configd, inheriting the session from
+	 * the environment as CfgClient() does.
+	 */
+	CfgClientAsync() throw(CfgClientFatalException);
+	~CfgClientAsync();
+
+	/**
+	 * SetSessionId() sets the session later requests are made in. Unlike
+	 * CfgClient::SessionAttach() it does not check that it exists.
+	 */
+	void SetSessionId(const std::string &sessid);
+	/**
+	 * Fd() is the descriptor to watch for readability, and writability
+	 * while Flush() says there is more to write.
+	 */
+	int Fd(void);
+
+	/**
+	 * Each of these starts the request made by the CfgClient method of
+	 * the same name and returns its id.
+	 */
+	unsigned int TreeGet(CfgClient::Database db, const std::vector<std::string> &path, const std::string &encoding) throw(CfgClientException);
+	unsigned int NodeGet(CfgClient::Database db, const std::vector<std::string> &path) throw(CfgClientException);
+	unsigned int Set(const std::vector<std::string> &path) throw(CfgClientException);
+	unsigned int Delete(const std::vector<std::string> &path) throw(CfgClientException);
+	unsigned int Commit(const std::string &comment) throw(CfgClientException);
+	unsigned int CallRPC(const std::string ns, const std::string name, const std::string input) throw(CfgClientException);
+
+	/**
+	 * Flush() writes what it can of the requests started so far.
+	 * @return true if some are still to be written.
+	 */
+	bool Flush(void) throw(CfgClientFatalException);
+	/**
+	 * Read() reads whatever configd has sent.
+	 * @return The number of results waiting to be taken.
+	 */
+	int Read(void) throw(CfgClientFatalException);
+	/**
+	 * NextResult() takes the next result that has been read.
+	 * @return The id of the request it answers, 0 if there are none.
+	 */
+	unsigned int NextResult(void);
+	/**
+	 * Result() returns the result taken by NextResult(), or throws if
+	 * that request failed. A NodeGet() result is a JSON list of values.
+	 */
+	std::string Result(void) throw(CfgClientException);
+
+private:
+	/* The connection is owned, so it can't be copied */
+	CfgClientAsync(const CfgClientAsync &);
+	CfgClientAsync &operator=(const CfgClientAsync &);
+
+	struct configd_conn *_conn;
+	std::string _result;
+	std::string _error;
+	bool _failed;
+};
+
 #endif
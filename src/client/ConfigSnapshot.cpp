@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+#include <jansson.h>
+
+#include "node.h"
+#include "ConfigSnapshot.hpp"
+
+#define SNAPSHOT_DEFAULT (1 << 0)
+#define SNAPSHOT_VALUE   (1 << 1)
+
+namespace {
+
+/*
+ * A node whose children are still to be added, with what it holds in
+ * the tree with defaults and in the tree without, NULL if it is only a
+ * default. A list entry's key is its "tagnode" member, which is not a
+ * child.
+ */
+struct Pending {
+	json_t *tree;
+	json_t *explicitTree;
+	bool entry;
+};
+
+struct Child {
+	std::string name;
+	Pending pending;
+	uint32_t flags;
+
+	/* Values go last, in the order given, after the sorted nodes */
+	bool operator<(const Child &other) const {
+		bool value = flags & SNAPSHOT_VALUE;
+
+		if (value != bool(other.flags & SNAPSHOT_VALUE))
+			return other.flags & SNAPSHOT_VALUE;
+		return !value && name < other.name;
+	}
+};
+
+struct NameLess {
+	const char *names;
+
+	template <typename Node>
+	bool operator()(const Node &node, const char *name) const {
+		return strcmp(names + node.name, name) < 0;
+	}
+};
+
+struct NameIs {
+	const char *names;
+	const char *name;
+
+	template <typename Node>
+	bool operator()(const Node &node) const {
+		return strcmp(names + node.name, name) == 0;
+	}
+};
+
+struct NotValue {
+	template <typename Node>
+	bool operator()(const Node &node) const {
+		return !(node.flags & SNAPSHOT_VALUE);
+	}
+};
+
+std::string valueName(json_t *value)
+{
+	char buf[32];
+
+	switch (json_typeof(value)) {
+	case JSON_STRING:
+		return std::string(json_string_value(value),
+				   json_string_length(value));
+	case JSON_TRUE:
+		return "true";
+	case JSON_FALSE:
+		return "false";
+	case JSON_INTEGER:
+		snprintf(buf, sizeof(buf), "%" JSON_INTEGER_FORMAT,
+			 json_integer_value(value));
+		return buf;
+	case JSON_REAL:
+		snprintf(buf, sizeof(buf), "%.17g", json_real_value(value));
+		return buf;
+	default:
+		return "";
+	}
+}
+
+const char *tagName(json_t *entry)
+{
+	return json_string_value(json_object_get(entry, "tagnode"));
+}
+
+Child makeChild(const std::string &name, json_t *tree, json_t *explicitTree,
+		bool entry, uint32_t flags)
+{
+	Child child;
+
+	child.name = name;
+	child.pending.tree = tree;
+	child.pending.explicitTree = explicitTree;
+	child.pending.entry = entry;
+	child.flags = flags | (explicitTree ? 0 : SNAPSHOT_DEFAULT);
+	return child;
+}
+
+/*
+ * The children of a node in the "json" encoding: the members of an
+ * object, the entries of a list keyed by their tagnode, or a leaf's
+ * values, which are nodes with no children of their own.
+ */
+void children(const Pending &p, std::vector<Child> &out)
+{
+	const char *key;
+	json_t *value;
+	size_t i;
+
+	if (json_is_object(p.tree)) {
+		json_object_foreach(p.tree, key, value) {
+			if (p.entry && strcmp(key, "tagnode") == 0)
+				continue;
+			out.push_back(makeChild(key, value,
+				json_object_get(p.explicitTree, key), false, 0));
+		}
+	} else if (json_is_array(p.tree)) {
+		std::map<std::string, json_t *> entries;
+		std::set<std::string> values;
+
+		json_array_foreach(p.explicitTree, i, value) {
+			if (json_is_object(value) && tagName(value))
+				entries[tagName(value)] = value;
+			else
+				values.insert(valueName(value));
+		}
+		json_array_foreach(p.tree, i, value) {
+			if (json_is_object(value)) {
+				if (!tagName(value))
+					continue;
+				std::map<std::string, json_t *>::iterator it =
+					entries.find(tagName(value));
+				out.push_back(makeChild(tagName(value), value,
+					it == entries.end() ? NULL : it->second,
+					true, 0));
+			} else {
+				std::string name = valueName(value);
+				bool set = values.count(name);
+				out.push_back(makeChild(name, NULL,
+					set ? p.explicitTree : NULL,
+					false, SNAPSHOT_VALUE));
+			}
+		}
+	} else if (p.tree && !json_is_null(p.tree)) {
+		out.push_back(makeChild(valueName(p.tree), NULL, p.explicitTree,
+					false, SNAPSHOT_VALUE));
+	}
+}
+
+}
+
+ConfigSnapshot::ConfigSnapshot()
+{
+}
+
+ConfigSnapshot::ConfigSnapshot(CfgClient &client, CfgClient::Database db, const std::vector<std::string> &path) throw(CfgClientException)
+{
+	std::vector<unsigned int> flags;
+	flags.push_back(CONFIGD_TREEGET_ALL);
+	flags.push_back(CONFIGD_TREEGET_SECRETS);
+	std::vector<CfgTree> trees = client.treeGetParsed(db, path, "json", "TreeGet", flags);
+	const CfgTree &tree = trees[0];
+	const CfgTree &explicitTree = trees[1];
+	size_t n = path.size();
+	size_t drop = 0;
+
+	/*
+	 * The tree comes inside an object named for the node at path, or
+	 * for the list when that is a list entry, so it is rooted above.
+	 */
+	if (tree.GetType() == CfgTree::OBJECT && tree.Size() == 1) {
+		std::string top = tree.Names()[0];
+		if (n >= 1 && path[n - 1] == top)
+			drop = 1;
+		else if (n >= 2 && path[n - 2] == top)
+			drop = 2;
+	}
+	_prefix.assign(path.begin(), path.end() - drop);
+	build(tree, explicitTree);
+}
+
+/*
+ * The nodes are added breadth first, so that each node's children can
+ * be sorted and appended together as they are found. A leaf's values
+ * keep their configured order.
+ */
+void ConfigSnapshot::build(const CfgTree &tree, const CfgTree &explicitTree)
+{
+	std::unordered_map<std::string, uint32_t> interned;
+	std::vector<Pending> pending;
+	std::vector<Child> kids;
+	Node root = { 0, 0, 0, 0 };
+	Pending top = { tree._json, explicitTree._json, false };
+
+	_nodes.clear();
+	_names.assign(1, '\0');
+	interned[""] = 0;
+
+	_nodes.push_back(root);
+	pending.push_back(top);
+	for (size_t i = 0; i < _nodes.size(); i++) {
+		kids.clear();
+		children(pending[i], kids);
+		std::stable_sort(kids.begin(), kids.end());
+
+		_nodes[i].first = _nodes.size();
+		_nodes[i].count = kids.size();
+		for (size_t k = 0; k < kids.size(); k++) {
+			std::pair<std::unordered_map<std::string, uint32_t>::iterator, bool> ins =
+				interned.insert(std::make_pair(kids[k].name,
+							       (uint32_t)_names.size()));
+			if (ins.second)
+				_names.append(kids[k].name.c_str(),
+					      kids[k].name.size() + 1);
+
+			Node node = { ins.first->second, 0, 0, kids[k].flags };
+			_nodes.push_back(node);
+			pending.push_back(kids[k].pending);
+		}
+	}
+}
+
+const ConfigSnapshot::Node *ConfigSnapshot::find(const std::vector<std::string> &path) const
+{
+	NameLess less = { _names.c_str() };
+	const Node *node;
+
+	if (_nodes.empty() || path.size() < _prefix.size()
+	    || !std::equal(_prefix.begin(), _prefix.end(), path.begin()))
+		return NULL;
+
+	node = &_nodes[0];
+	for (size_t i = _prefix.size(); i < path.size(); i++) {
+		const Node *begin = _nodes.data() + node->first;
+		const Node *end = begin + node->count;
+		const Node *values = std::partition_point(begin, end, NotValue());
+		const char *name = path[i].c_str();
+		NameIs is = { _names.c_str(), name };
+
+		node = std::lower_bound(begin, values, name, less);
+		if (node != values && is(*node))
+			continue;
+		node = std::find_if(values, end, is);
+		if (node == end)
+			return NULL;
+	}
+	return node;
+}
+
+bool ConfigSnapshot::Exists(const std::vector<std::string> &path) const
+{
+	const Node *node = find(path);
+
+	/* The root is only there if configd returned something under it */
+	return node && (node != &_nodes[0] || node->count);
+}
+
+std::vector<std::string> ConfigSnapshot::Children(const std::vector<std::string> &path) const
+{
+	std::vector<std::string> out;
+	const Node *node = find(path);
+
+	if (!node)
+		return out;
+	out.reserve(node->count);
+	for (uint32_t i = 0; i < node->count; i++)
+		out.push_back(_names.c_str() + _nodes[node->first + i].name);
+	return out;
+}
+
+std::string ConfigSnapshot::Get(const std::vector<std::string> &path) const
+{
+	const Node *node = find(path);
+
+	if (!node)
+		return "";
+	for (uint32_t i = 0; i < node->count; i++) {
+		const Node &child = _nodes[node->first + i];
+		if (child.flags & SNAPSHOT_VALUE)
+			return _names.c_str() + child.name;
+	}
+	return "";
+}
+
+bool ConfigSnapshot::IsDefault(const std::vector<std::string> &path) const
+{
+	const Node *node = find(path);
+
+	return node && (node->flags & SNAPSHOT_DEFAULT);
+}
+
+size_t ConfigSnapshot::Size() const
+{
+	return _nodes.empty() ? 0 : _nodes.size() - 1;
+}
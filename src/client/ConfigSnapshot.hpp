@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef CONFIGSNAPSHOT_HPP_
+#define CONFIGSNAPSHOT_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "CfgClient.hpp"
+
+/**
+ * ConfigSnapshot is a configuration subtree read from configd once and
+ * then queried in memory, for daemons that would otherwise make a
+ * NodeExists() or NodeGet() call per node. It is not updated as the
+ * configuration changes; take a new one after each commit.
+ *
+ * Paths are full configuration paths, as given to CfgClient, and those
+ * outside the snapshot don't exist. The nodes are held in one array
+ * with the children of each node adjacent and sorted by name, so a
+ * lookup is a binary search per path element. A leaf's values keep
+ * their configured order and are scanned instead.
+ */
+class ConfigSnapshot
+{
+public:
+	/**
+	 * ConfigSnapshot() is empty.
+	 */
+	ConfigSnapshot();
+	/**
+	 * ConfigSnapshot() reads the tree at path from the database,
+	 * including defaults. Two requests are sent together, the second
+	 * without defaults to tell which nodes are.
+	 * @param client The connection to read the tree with.
+	 * @param db The database to read the tree from.
+	 * @param path The configuration path at which to root the snapshot.
+	 */
+	ConfigSnapshot(CfgClient &client, CfgClient::Database db, const std::vector<std::string> &path) throw(CfgClientException);
+
+	/**
+	 * Exists() reports whether the path exists in the snapshot.
+	 */
+	bool Exists(const std::vector<std::string> &path) const;
+	/**
+	 * Children() is the children of the node at path sorted by name,
+	 * or for a leaf its values in configured order, as NodeGet().
+	 */
+	std::vector<std::string> Children(const std::vector<std::string> &path) const;
+	/**
+	 * Get() is the value of the leaf at path, or the first of a
+	 * leaf-list's values. It is empty if the path is not a leaf.
+	 */
+	std::string Get(const std::vector<std::string> &path) const;
+	/**
+	 * IsDefault() reports whether the path exists only as a default.
+	 */
+	bool IsDefault(const std::vector<std::string> &path) const;
+	/**
+	 * Size() is the number of nodes in the snapshot, values included.
+	 */
+	size_t Size() const;
+
+private:
+	struct Node {
+		uint32_t name;		/* offset in _names */
+		uint32_t first;		/* index of the first child */
+		uint32_t count;		/* number of children */
+		uint32_t flags;
+	};
+
+	const Node *find(const std::vector<std::string> &path) const;
+	void build(const CfgTree &tree, const CfgTree &explicitTree);
+
+	std::vector<std::string> _prefix;
+	std::vector<Node> _nodes;
+	std::string _names;
+};
+
+#endif
@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * A C++17 interface to configd, for programs that make many calls. It
+ * sits beside CfgClient rather than replacing it: CfgClient is what the
+ * SWIG bindings are generated from, and is built as C++0x, so this header
+ * is not included by it and is compiled only by its users.
+ *
+ * Paths are given as any sequence of strings, or a braced list, and are
+ * escaped straight into the one string sent. Calls return a Result,
+ * holding the value or the Error that stopped it, so failures cost no
+ * exception unless Value() is asked of one. Nothing is allocated for the
+ * error on success.
+ */
+
+#ifndef CONFIGDCLIENT_HPP_
+#define CONFIGDCLIENT_HPP_
+
+#include <stdlib.h>
+
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <vyatta-util/vector.h>
+
+#include "callrpc.h"
+#include "connect.h"
+#include "error.h"
+#include "node.h"
+#include "path.h"
+#include "transaction.h"
+
+namespace configd {
+
+/**
+ * Database is as CfgClient::Database.
+ */
+enum class Database {
+	AUTO,
+	RUNNING,
+	CANDIDATE,
+	EFFECTIVE,
+};
+
+/**
+ * MgmtError is an <rpc-error> returned by configd, see configd_mgmt_error.
+ */
+struct MgmtError {
+	std::string tag;
+	std::string type;
+	std::string severity;
+	std::string app_tag;
+	std::string path;
+	std::string message;
+};
+
+/**
+ * Error is why a call failed.
+ */
+class Error
+{
+public:
+	explicit Error(std::string message) : _message(std::move(message)) {}
+
+	/**
+	 * Error(err) takes the contents of err, which is freed.
+	 */
+	explicit Error(struct configd_error &err)
+	{
+		if (err.text)
+			_message = err.text;
+		_mgmt.reserve(err.mgmt_errs.num_entries);
+		for (int i = 0; i < err.mgmt_errs.num_entries; i++) {
+			const struct configd_mgmt_error *me = err.mgmt_errs.me_list[i];
+			_mgmt.push_back({ str(configd_mgmt_error_tag(me)),
+					  str(configd_mgmt_error_type(me)),
+					  str(configd_mgmt_error_severity(me)),
+					  str(configd_mgmt_error_app_tag(me)),
+					  str(configd_mgmt_error_path(me)),
+					  str(configd_mgmt_error_message(me)) });
+		}
+		configd_error_free(&err);
+	}
+
+	const std::string &Message() const noexcept { return _message; }
+	const std::vector<MgmtError> &MgmtErrors() const noexcept { return _mgmt; }
+
+private:
+	static std::string str(const char *s) { return s ? s : ""; }
+
+	std::string _message;
+	std::vector<MgmtError> _mgmt;
+};
+
+/**
+ * Exception is thrown by Result::Value() when there is no value.
+ */
+class Exception : public std::runtime_error
+{
+public:
+	explicit Exception(const Error &error)
+		: std::runtime_error(error.Message()), _error(error) {}
+
+	const Error &GetError() const noexcept { return _error; }
+
+private:
+	Error _error;
+};
+
+/**
+ * Result is the value of a call that succeeded or the Error of one that
+ * failed. The value can be moved out of it.
+ */
+template <typename T>
+class [[nodiscard]] Result
+{
+public:
+	Result(T value) : _v(std::in_place_index<0>, std::move(value)) {}
+	Result(Error error) : _v(std::in_place_index<1>, std::move(error)) {}
+
+	bool HasValue() const noexcept { return _v.index() == 0; }
+	explicit operator bool() const noexcept { return HasValue(); }
+
+	T &Value() &
+	{
+		check();
+		return std::get<0>(_v);
+	}
+	const T &Value() const &
+	{
+		check();
+		return std::get<0>(_v);
+	}
+	T &&Value() &&
+	{
+		check();
+		return std::get<0>(std::move(_v));
+	}
+
+	T ValueOr(T other) const &
+	{
+		return HasValue() ? std::get<0>(_v) : std::move(other);
+	}
+	T ValueOr(T other) &&
+	{
+		return HasValue() ? std::get<0>(std::move(_v)) : std::move(other);
+	}
+
+	/**
+	 * GetError() is only to be called when there is no value.
+	 */
+	const Error &GetError() const { return std::get<1>(_v); }
+
+private:
+	void check() const
+	{
+		if (!HasValue())
+			throw Exception(std::get<1>(_v));
+	}
+
+	std::variant<T, Error> _v;
+};
+
+/**
+ * Path is a configuration path, escaped as configd expects it. It is made
+ * from any sequence of strings or a braced list of them.
+ */
+class Path
+{
+public:
+	Path(std::initializer_list<std::string_view> elems)
+	{
+		build(elems.begin(), elems.end());
+	}
+
+	template <typename Seq,
+		  typename = std::enable_if_t<std::is_convertible_v<
+			  decltype(*std::begin(std::declval<const Seq &>())),
+			  std::string_view>>>
+	Path(const Seq &elems)
+	{
+		build(std::begin(elems), std::end(elems));
+	}
+
+	const char *c_str() const noexcept { return _encoded.c_str(); }
+	std::string_view Encoded() const noexcept { return _encoded; }
+
+private:
+	template <typename It>
+	void build(It first, It last)
+	{
+		size_t len = 1;
+		for (It it = first; it != last; ++it) {
+			std::string_view elem(*it);
+			len += (it != first ? 1 : 0)
+				+ configd_path_escape_len(elem.data(), elem.size());
+		}
+
+		_encoded.assign(len, '/');
+		char *p = &_encoded[1];
+		for (It it = first; it != last; ++it) {
+			std::string_view elem(*it);
+			if (it != first)
+				p++;
+			p = configd_path_escape(p, elem.data(), elem.size());
+		}
+	}
+
+	std::string _encoded;
+};
+
+/**
+ * Client is a connection to configd. It can be moved but not copied.
+ */
+class Client
+{
+public:
+	/**
+	 * Connect() opens a connection to configd, in the session from the
+	 * environment if there is one. When shared is true the connection may
+	 * be used by several threads at once, see configd_conn_mux_enable.
+	 */
+	static Result<Client> Connect(bool shared = false)
+	{
+		std::unique_ptr<struct configd_conn, Closer> conn(new struct configd_conn);
+
+		if (configd_open_connection(conn.get()) < 0) {
+			delete conn.release();
+			return Error("failed to connect to configd");
+		}
+		const char *sid = getenv("VYATTA_CONFIG_SID");
+		if (sid)
+			configd_set_session_id(conn.get(), sid);
+		if (shared && configd_conn_mux_enable(conn.get()) < 0)
+			return Error("failed to share configd connection");
+		return Client(std::move(conn));
+	}
+
+	/**
+	 * SetSessionId() makes later calls in the given session.
+	 */
+	void SetSessionId(std::string_view sid)
+	{
+		configd_set_session_id(_conn.get(), std::string(sid).c_str());
+	}
+
+	Result<bool> NodeExists(Database db, const Path &path)
+	{
+		return boolapi(configd_node_exists, db, path);
+	}
+
+	Result<bool> NodeIsDefault(Database db, const Path &path)
+	{
+		return boolapi(configd_node_is_default, db, path);
+	}
+
+	/**
+	 * NodeGet() is the values of a leaf, or the children of another node.
+	 */
+	Result<std::vector<std::string>> NodeGet(Database db, const Path &path)
+	{
+		struct configd_error err = {};
+		struct vector *v = configd_node_get(_conn.get(), int(db), path.c_str(), &err);
+		if (!v)
+			return Error(err);
+
+		std::vector<std::string> out;
+		out.reserve(vector_count(v));
+		for (const char *s = NULL; (s = vector_next(v, s));)
+			out.emplace_back(s);
+		vector_free(v);
+		return out;
+	}
+
+	Result<std::string> TreeGet(Database db, const Path &path, std::string_view encoding = "json")
+	{
+		struct configd_error err = {};
+		return strresult(configd_tree_get_encoding(
+			_conn.get(), int(db), path.c_str(),
+			std::string(encoding).c_str(), &err), err);
+	}
+
+	Result<std::string> Set(const Path &path)
+	{
+		struct configd_error err = {};
+		return strresult(configd_set(_conn.get(), path.c_str(), &err), err);
+	}
+
+	Result<std::string> Delete(const Path &path)
+	{
+		struct configd_error err = {};
+		return strresult(configd_delete(_conn.get(), path.c_str(), &err), err);
+	}
+
+	/**
+	 * SetMany() sets each path, as configd_set_many. The result holds
+	 * the error for each path, empty for those that were set, and is an
+	 * Error only if the connection failed.
+	 */
+	Result<std::vector<std::string>> SetMany(const std::vector<Path> &paths)
+	{
+		return manyapi(configd_set_many, paths);
+	}
+
+	Result<std::vector<std::string>> DeleteMany(const std::vector<Path> &paths)
+	{
+		return manyapi(configd_delete_many, paths);
+	}
+
+	Result<std::string> Commit(std::string_view comment)
+	{
+		struct configd_error err = {};
+		return strresult(configd_commit(_conn.get(), std::string(comment).c_str(), &err), err);
+	}
+
+	Result<std::string> CallRPC(std::string_view ns, std::string_view name, std::string_view input)
+	{
+		struct configd_error err = {};
+		return strresult(configd_call_rpc(
+			_conn.get(), std::string(ns).c_str(), std::string(name).c_str(),
+			std::string(input).c_str(), &err), err);
+	}
+
+private:
+	struct Closer {
+		void operator()(struct configd_conn *conn) const
+		{
+			configd_close_connection(conn);
+			delete conn;
+		}
+	};
+
+	explicit Client(std::unique_ptr<struct configd_conn, Closer> conn)
+		: _conn(std::move(conn)) {}
+
+	Result<bool> boolapi(int (*api)(struct configd_conn *, int, const char *, struct configd_error *),
+			     Database db, const Path &path)
+	{
+		struct configd_error err = {};
+		int result = api(_conn.get(), int(db), path.c_str(), &err);
+		if (result < 0)
+			return Error(err);
+		configd_error_free(&err);
+		return result == 1;
+	}
+
+	static Result<std::string> strresult(char *result, struct configd_error &err)
+	{
+		if (!result)
+			return Error(err);
+		configd_error_free(&err);
+		std::string out(result);
+		free(result);
+		return out;
+	}
+
+	Result<std::vector<std::string>> manyapi(int (*api)(struct configd_conn *, const char **, size_t, char **, struct configd_error *),
+						 const std::vector<Path> &paths)
+	{
+		struct configd_error err = {};
+		std::vector<const char *> cpaths;
+		std::vector<char *> errors(paths.size());
+
+		cpaths.reserve(paths.size());
+		for (const Path &path : paths)
+			cpaths.push_back(path.c_str());
+		int result = api(_conn.get(), cpaths.data(), cpaths.size(), errors.data(), &err);
+
+		std::vector<std::string> out(paths.size());
+		for (size_t i = 0; i < errors.size(); i++) {
+			if (errors[i])
+				out[i] = errors[i];
+			free(errors[i]);
+		}
+		if (result < 0)
+			return Error(err);
+		configd_error_free(&err);
+		return out;
+	}
+
+	std::unique_ptr<struct configd_conn, Closer> _conn;
+};
+
+}
+
+#endif
@@ -0,0 +1,607 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Non-blocking requests, for callers driving many of them from an event
+ * loop. Requests are encoded into an output buffer as they are made and
+ * written out as the socket allows. Input is read into a buffer as it
+ * arrives and each complete response is parsed off the front of it,
+ * keeping a little state so that a large response is scanned only once
+ * however many reads it takes to arrive. Responses are then handed out
+ * in the order they arrived, each with the id of its request.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "async.h"
+#include "connect.h"
+#include "error.h"
+#include "internal.h"
+#include "log.h"
+#include "probes.h"
+#include "rpc.h"
+
+#define ASYNC_READ_SIZE 65536
+
+/* A request whose response has not been taken yet */
+struct async_req {
+	struct async_req *next;
+	unsigned int id;
+	const char *fn;
+	const char *source;	/* for the error, as error_init */
+};
+
+struct async_reply {
+	struct async_reply *next;
+	json_t *jresp;
+};
+
+/*
+ * Kept on the side as struct configd_conn is allocated by callers. Only
+ * the list is locked, a connection is used by one thread at a time.
+ */
+struct async_conn {
+	struct async_conn *next;
+	const struct configd_conn *conn;
+	int error;			/* errno once the connection failed */
+	struct async_req *reqs;
+	struct async_reply *replies;	/* read, oldest first */
+	struct async_reply **tail;
+	int nreplies;
+	char *out;			/* requests not yet written */
+	size_t out_len;
+	size_t out_sent;
+	size_t out_size;
+	char *in;			/* input not yet parsed */
+	size_t in_len;
+	size_t in_size;
+	size_t scan;			/* how far the text has been scanned */
+	unsigned int depth;		/* of the scan in objects and arrays */
+	int in_string;
+	int escape;
+};
+
+static struct async_conn *async_list;
+static int async_count;
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct async_conn *async_find(const struct configd_conn *conn)
+{
+	struct async_conn *ac;
+
+	if (__atomic_load_n(&async_count, __ATOMIC_RELAXED) == 0)
+		return NULL;
+
+	pthread_mutex_lock(&async_lock);
+	for (ac = async_list; ac; ac = ac->next) {
+		if (ac->conn == conn)
+			break;
+	}
+	pthread_mutex_unlock(&async_lock);
+	return ac;
+}
+
+int async_enabled(const struct configd_conn *conn)
+{
+	return async_find(conn) != NULL;
+}
+
+int configd_conn_async_enable(struct configd_conn *conn)
+{
+	struct async_conn *ac;
+	int flags;
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (async_enabled(conn))
+		return 0;
+	if (mux_enabled(conn)) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	flags = fcntl(conn->fd, F_GETFL);
+	if (flags < 0 || fcntl(conn->fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return -1;
+
+	ac = calloc(1, sizeof(*ac));
+	if (!ac)
+		return -1;
+	ac->conn = conn;
+	ac->tail = &ac->replies;
+
+	pthread_mutex_lock(&async_lock);
+	ac->next = async_list;
+	async_list = ac;
+	__atomic_add_fetch(&async_count, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&async_lock);
+	return 0;
+}
+
+void async_close(struct configd_conn *conn)
+{
+	struct async_conn **pac, *ac;
+	struct async_reply *mr;
+	struct async_req *ar;
+
+	if (__atomic_load_n(&async_count, __ATOMIC_RELAXED) == 0)
+		return;
+
+	pthread_mutex_lock(&async_lock);
+	for (pac = &async_list; *pac; pac = &(*pac)->next) {
+		if ((*pac)->conn == conn)
+			break;
+	}
+	ac = *pac;
+	if (ac) {
+		*pac = ac->next;
+		__atomic_sub_fetch(&async_count, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&async_lock);
+
+	if (!ac)
+		return;
+	while ((ar = ac->reqs)) {
+		ac->reqs = ar->next;
+		free(ar);
+	}
+	while ((mr = ac->replies)) {
+		ac->replies = mr->next;
+		json_decref(mr->jresp);
+		free(mr);
+	}
+	free(ac->out);
+	free(ac->in);
+	free(ac);
+}
+
+static int async_flush(struct configd_conn *conn, struct async_conn *ac)
+{
+	ssize_t n;
+
+	if (ac->error) {
+		errno = ac->error;
+		return -1;
+	}
+
+	while (ac->out_sent < ac->out_len) {
+		n = write(conn->fd, ac->out + ac->out_sent,
+			  ac->out_len - ac->out_sent);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 1;
+		if (n <= 0) {
+			ac->error = n < 0 ? errno : EIO;
+			errno = ac->error;
+			return -1;
+		}
+		ac->out_sent += n;
+	}
+	ac->out_len = ac->out_sent = 0;
+	return 0;
+}
+
+int configd_async_flush(struct configd_conn *conn)
+{
+	struct async_conn *ac = async_find(conn);
+
+	if (!ac) {
+		errno = EINVAL;
+		return -1;
+	}
+	return async_flush(conn, ac);
+}
+
+/* Consumes the reference to req->args */
+static int async_start(struct configd_conn *conn, struct request *req,
+		       const char *source, struct configd_error *error)
+{
+	struct async_conn *ac = async_find(conn);
+	struct async_req *ar;
+	char *jstr, *out;
+	size_t len, size;
+	int nfds;
+
+	error_init(error, source);
+	if (!req->args)
+		return -1;
+	if (!ac || ac->error) {
+		json_decref(req->args);
+		errno = ac ? ac->error : EINVAL;
+		error_setf(error, "Error sending request");
+		return -1;
+	}
+
+	ar = malloc(sizeof(*ar));
+	if (!ar) {
+		json_decref(req->args);
+		error_setf(error, "Error sending request");
+		return -1;
+	}
+
+	/* Large parameters stay inline, the descriptors would have to be
+	 * sent with the first byte of the request.
+	 */
+	jstr = encode_request(conn, req, NULL, &nfds, &len);
+	if (!jstr) {
+		free(ar);
+		error_setf(error, "Error sending request");
+		return -1;
+	}
+
+	if (ac->out_sent) {
+		ac->out_len -= ac->out_sent;
+		memmove(ac->out, ac->out + ac->out_sent, ac->out_len);
+		ac->out_sent = 0;
+	}
+	if (ac->out_len + len > ac->out_size) {
+		size = ac->out_size * 2;
+		if (size < ac->out_len + len)
+			size = ac->out_len + len;
+		out = realloc(ac->out, size);
+		if (!out) {
+			free(jstr);
+			free(ar);
+			error_setf(error, "Error sending request");
+			return -1;
+		}
+		ac->out = out;
+		ac->out_size = size;
+	}
+	memcpy(ac->out + ac->out_len, jstr, len);
+	ac->out_len += len;
+	free(jstr);
+
+	ar->id = req->id;
+	ar->fn = req->fn;
+	ar->source = source;
+	ar->next = ac->reqs;
+	ac->reqs = ar;
+
+	if (async_flush(conn, ac) < 0) {
+		error_setf(error, "Error sending request");
+		return -1;
+	}
+	return req->id;
+}
+
+int configd_async_tree_get(struct configd_conn *conn, int db, const char *path,
+			   const char *encoding, struct configd_error *error)
+{
+	struct request req = { .fn = "TreeGet" };
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+	req.args = json_pack("[isss{sbsb}]", db, conn->session_id, path,
+			     encoding, "Defaults", 1, "Secrets", 1);
+	return async_start(conn, &req, __func__, error);
+}
+
+int configd_async_node_get(struct configd_conn *conn, int db, const char *path,
+			   struct configd_error *error)
+{
+	struct request req = { .fn = "Get" };
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+	req.args = json_pack("[iss]", db, conn->session_id, path);
+	return async_start(conn, &req, __func__, error);
+}
+
+int configd_async_set(struct configd_conn *conn, const char *path,
+		      struct configd_error *error)
+{
+	struct request req = { .fn = "Set" };
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+	req.args = json_pack("[ss]", conn->session_id, path);
+	return async_start(conn, &req, __func__, error);
+}
+
+int configd_async_delete(struct configd_conn *conn, const char *path,
+			 struct configd_error *error)
+{
+	struct request req = { .fn = "Delete" };
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+	req.args = json_pack("[ss]", conn->session_id, path);
+	return async_start(conn, &req, __func__, error);
+}
+
+int configd_async_commit(struct configd_conn *conn, const char *comment,
+			 struct configd_error *error)
+{
+	struct request req = { .fn = "Commit" };
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+	req.args = json_pack("[ssb]", conn->session_id, comment, 0);
+	return async_start(conn, &req, __func__, error);
+}
+
+int configd_async_call_rpc(struct configd_conn *conn, const char *ns,
+			   const char *name, const char *input,
+			   struct configd_error *error)
+{
+	struct request req = { .fn = "CallRpc" };
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+	req.args = json_pack("[ssss]", ns, name, input, "json");
+	return async_start(conn, &req, __func__, error);
+}
+
+/*
+ * Finds the end of the JSON response at the front of in, carrying on from
+ * where the last call left off. Returns its length, 0 if it has not all
+ * arrived yet, or -1 if the input isn't an object or array.
+ */
+static ssize_t async_json_end(struct async_conn *ac, const char *in,
+			      size_t len)
+{
+	size_t i;
+	char c;
+
+	for (i = ac->scan; i < len; i++) {
+		c = in[i];
+		if (ac->in_string) {
+			if (ac->escape)
+				ac->escape = 0;
+			else if (c == '\\')
+				ac->escape = 1;
+			else if (c == '"')
+				ac->in_string = 0;
+			continue;
+		}
+		switch (c) {
+		case '"':
+			ac->in_string = 1;
+			break;
+		case '{':
+		case '[':
+			ac->depth++;
+			break;
+		case '}':
+		case ']':
+			if (ac->depth == 0)
+				return -1;
+			if (--ac->depth == 0) {
+				ac->scan = 0;
+				return i + 1;
+			}
+			break;
+		case ' ':
+		case '\t':
+		case '\n':
+		case '\r':
+			break;
+		default:
+			if (ac->depth == 0)
+				return -1;
+			break;
+		}
+	}
+	ac->scan = i;
+	return 0;
+}
+
+/* Parses the response at the front of in, if it has all arrived */
+static ssize_t async_next(struct configd_conn *conn, struct async_conn *ac,
+			  const char *in, size_t in_len, json_t **jresp)
+{
+	json_error_t jerr;
+	ssize_t len;
+
+	*jresp = NULL;
+	if (frame_enabled(conn))
+		return frame_next(in, in_len, jresp);
+
+	len = async_json_end(ac, in, in_len);
+	if (len <= 0)
+		return len;
+	*jresp = json_loadb(in, len, 0, &jerr);
+	if (!*jresp) {
+		msg_err("%s: %s\n", __func__, jerr.text);
+		return -1;
+	}
+	return len;
+}
+
+/* As mux_read, a result in a memfd is taken while the descriptors queued
+ * are still in step with the responses. What is left of the input is
+ * moved to the front once all the complete responses are parsed.
+ */
+static int async_parse(struct configd_conn *conn, struct async_conn *ac)
+{
+	struct async_reply *mr;
+	const char *body;
+	json_t *jresp;
+	ssize_t len;
+	size_t off = 0;
+	size_t n;
+	int ret;
+
+	while ((len = async_next(conn, ac, ac->in + off, ac->in_len - off,
+				 &jresp)) > 0) {
+		n = len;
+		off += n;
+		stats_response_received(conn, response_id(jresp), n);
+		CFG_PROBE(libvyatta_config, response_receive, NULL,
+			  response_id(jresp), n);
+
+		ret = memfd_take_result(conn, jresp, &body, &n);
+		if (ret > 0) {
+			ret = json_object_set_new(jresp, "result",
+						  json_stringn_nocheck(body, n));
+			memfd_release(body, n);
+		}
+		if (ret == 0 && !json_is_integer(json_object_get(jresp, "id"))) {
+			msg_err("configd response id must be an integer\n");
+			ret = -1;
+		}
+		mr = ret == 0 ? malloc(sizeof(*mr)) : NULL;
+		if (!mr) {
+			json_decref(jresp);
+			len = -1;
+			break;
+		}
+		mr->next = NULL;
+		mr->jresp = jresp;
+		*ac->tail = mr;
+		ac->tail = &mr->next;
+		ac->nreplies++;
+	}
+
+	if (off) {
+		ac->in_len -= off;
+		memmove(ac->in, ac->in + off, ac->in_len);
+	}
+	return len;
+}
+
+int configd_async_read(struct configd_conn *conn)
+{
+	struct async_conn *ac = async_find(conn);
+	size_t size;
+	ssize_t n;
+	char *in;
+
+	if (!ac) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (!ac->error) {
+		if (ac->in_size - ac->in_len < ASYNC_READ_SIZE) {
+			size = ac->in_size ? ac->in_size * 2 : ASYNC_READ_SIZE;
+			in = realloc(ac->in, size);
+			if (!in) {
+				ac->error = ENOMEM;
+				break;
+			}
+			ac->in = in;
+			ac->in_size = size;
+		}
+
+		size = ac->in_size - ac->in_len;
+		n = memfd_recv(conn, ac->in + ac->in_len, size);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n <= 0) {
+			ac->error = n < 0 ? errno : ECONNRESET;
+			break;
+		}
+		ac->in_len += n;
+		if (async_parse(conn, ac) < 0)
+			ac->error = EPROTO;
+		if ((size_t)n < size)
+			break;
+	}
+
+	if (ac->error) {
+		errno = ac->error;
+		return -1;
+	}
+	return ac->nreplies;
+}
+
+static struct async_req *async_take_req(struct async_conn *ac,
+					unsigned int id)
+{
+	struct async_req **par, *ar;
+
+	for (par = &ac->reqs; *par; par = &(*par)->next) {
+		ar = *par;
+		if (ar->id == id) {
+			*par = ar->next;
+			return ar;
+		}
+	}
+	return NULL;
+}
+
+static char *async_reply_result(json_t *jresp, unsigned int id,
+				const char *fn, struct configd_error *error)
+{
+	struct response resp;
+	json_t *jresult = json_object_get(jresp, "result");
+	char *result = NULL;
+
+	if (json_is_string(jresult))
+		return strdup(json_string_value(jresult));
+	if (jresult && !json_is_null(jresult)) {
+		result = json_dumps(jresult, JSON_COMPACT | JSON_ENCODE_ANY);
+		if (!result)
+			error_setf(error, "Error receiving response");
+		return result;
+	}
+
+	memset(&resp, 0, sizeof(resp));
+	if (parse_reply(jresp, id, &resp) == 0 && resp.type == ERROR) {
+		error_setf(error, "%s\n", resp.result.str_val);
+	} else if (resp.type == MGMTERROR) {
+		error_set_from_mgmt_error_list(error, &resp.result.mgmt_errs, fn);
+		if (fn && strcmp(fn, "Commit") == 0)
+			configd_error_format_for_commit_or_val(error, fn);
+	} else {
+		error_setf(error, "Error receiving response");
+	}
+	response_free(&resp);
+	return NULL;
+}
+
+int configd_async_result(struct configd_conn *conn, unsigned int *id,
+			 char **result, struct configd_error *error)
+{
+	struct async_conn *ac = async_find(conn);
+	struct async_reply *mr;
+	struct async_req *ar;
+
+	if (!ac) {
+		errno = EINVAL;
+		return -1;
+	}
+	mr = ac->replies;
+	if (!mr)
+		return 0;
+	ac->replies = mr->next;
+	if (!ac->replies)
+		ac->tail = &ac->replies;
+	ac->nreplies--;
+
+	*id = json_integer_value(json_object_get(mr->jresp, "id"));
+	ar = async_take_req(ac, *id);
+	error_init(error, ar ? ar->source : __func__);
+	*result = async_reply_result(mr->jresp, *id, ar ? ar->fn : NULL,
+				     error);
+
+	json_decref(mr->jresp);
+	free(mr);
+	free(ar);
+	return 1;
+}
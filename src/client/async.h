@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef CONFIGD_ASYNC_H_
+#define CONFIGD_ASYNC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct configd_conn;
+struct configd_error;
+
+/**
+ * configd_conn_async_enable makes the connection non-blocking, for use
+ * from an event loop. Requests are then started with the
+ * configd_async_* calls below, which return at once with the id of the
+ * request, and any number may be outstanding. The caller watches the
+ * connection's fd: configd_async_flush when it is writable and there is
+ * output pending, configd_async_read when it is readable, then
+ * configd_async_result until there are no more results.
+ *
+ * The blocking calls fail with EBUSY on such a connection, and it can't
+ * also be shared between threads. Returns 0:ok, -1:error.
+ */
+int configd_conn_async_enable(struct configd_conn *);
+
+/**
+ * Each of these starts the request made by the blocking call of the
+ * same name, in the connection's current session. They return the id of
+ * the request, or -1 on error.
+ */
+int configd_async_tree_get(struct configd_conn *, int db, const char *path,
+			   const char *encoding, struct configd_error *);
+int configd_async_node_get(struct configd_conn *, int db, const char *path,
+			   struct configd_error *);
+int configd_async_set(struct configd_conn *, const char *path,
+		      struct configd_error *);
+int configd_async_delete(struct configd_conn *, const char *path,
+			 struct configd_error *);
+int configd_async_commit(struct configd_conn *, const char *comment,
+			 struct configd_error *);
+int configd_async_call_rpc(struct configd_conn *, const char *ns,
+			   const char *name, const char *input,
+			   struct configd_error *);
+
+/**
+ * configd_async_flush writes as much of the pending requests as the
+ * socket takes. Returns 1 if some are still to be written, 0 when all
+ * have been, -1 on error.
+ */
+int configd_async_flush(struct configd_conn *);
+
+/**
+ * configd_async_read reads whatever has arrived from configd. Returns
+ * the number of results now waiting to be taken, or -1 if the
+ * connection has failed or been closed by configd, after which every
+ * request still outstanding is lost.
+ */
+int configd_async_read(struct configd_conn *);
+
+/**
+ * configd_async_result takes the next result that has been read, in the
+ * order they arrived, and sets *id to the request it answers. The result
+ * is as the blocking call would return it, except that one which is not
+ * a string, such as that of configd_async_node_get, is returned as JSON.
+ * If the request failed *result is NULL and the error is filled out.
+ * Returns 1 if a result was taken, 0 if there are none waiting.
+ */
+int configd_async_result(struct configd_conn *, unsigned int *id,
+			 char **result, struct configd_error *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -89,7 +89,7 @@ char *getCompletionEnv(struct configd_conn *cstore, const char *path)
 	bool is_typeless = true;
 	bool is_leaf_value = false;
 	bool is_value = false;
-	Ctemplate def(cstore, pcomps.to_path_string().c_str());
+	Ctemplate def(cstore, pcomps.to_path_cstr());
 	if (pcomps.size() > 0) {
 		if (!def.get()) {
 			/* invalid path */
@@ -97,7 +97,7 @@ char *getCompletionEnv(struct configd_conn *cstore, const char *path)
 		}
 		if (exists_only
 		    && configd_node_exists(cstore, CANDIDATE,
-					   pcomps.to_path_string().c_str(), NULL) != 1) {
+					   pcomps.to_path_cstr(), NULL) != 1) {
 			/* invalid path for the command (must exist) */
 			return NULL;
 		}
@@ -127,7 +127,7 @@ char *getCompletionEnv(struct configd_conn *cstore, const char *path)
 	bool last_comp_val = true;
 	
 	//gethelp, add to help_pairs
-	m = configd_get_help(cstore, (exists_only ? 0 : 1), pcomps.to_path_string().c_str(), NULL);
+	m = configd_get_help(cstore, (exists_only ? 0 : 1), pcomps.to_path_cstr(), NULL);
 	if (m == NULL) {
 		return NULL;
 	}
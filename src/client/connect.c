@@ -11,6 +11,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -23,6 +24,7 @@
 #include "log.h"
 #include "error.h"
 #include "internal.h"
+#include "probes.h"
 
 #define ENFORCE_STRING_ENTRIES 1
 #define IGNORE_NON_STRING_ENTRIES 0
@@ -116,6 +118,8 @@ int configd_open_connection(struct configd_conn *conn)
 		goto error;
 	}
 	conn->session_id = strdup("");
+	stats_open(conn);
+	frame_open(conn);
 	return 0;
 
 error:
@@ -126,6 +130,11 @@ error:
 
 void configd_close_connection(struct configd_conn *conn)
 {
+	stats_close(conn);
+	frame_close(conn);
+	mux_close(conn);
+	async_close(conn);
+
 	if (conn->fp)
 		fclose(conn->fp);
 
@@ -150,36 +159,88 @@ int configd_set_session_id(struct configd_conn *conn, const char *session_id)
 }
 
 
-int send_request(struct configd_conn *conn, const struct request *req)
+/* Packs req, giving it the next request id, and encodes it for the wire.
+ * When fds is given, large parameters may be moved into memfds for the
+ * optional transport, *nfds of them, which the caller must close.
+ */
+char *encode_request(struct configd_conn *conn, struct request *req,
+		     int *fds, int *nfds, size_t *len)
 {
 	json_t *jreq;
 	json_error_t jerr;
-	int result = -1;
 	char *jstr;
 
-	if (!conn || !req || !req->args) {
-		errno = EFAULT;
-		return -1;
-	}
+	/* Atomic in case the connection is shared between threads */
+	req->id = __atomic_add_fetch(&conn->req_id, 1, __ATOMIC_RELAXED);
 
-	/* Consumes ref to req->args on success */
+	/* Consumes ref to req->args, on failure too */
 	jreq = json_pack_ex(&jerr, 0, "{s:s, s:o, s:i}",
 			    "method", req->fn,
 			    "params", req->args,
-			    "id", ++(conn->req_id));
+			    "id", req->id);
 	if (!jreq || json_is_null(jreq)) {
 		msg_err("Unable to pack configd request: %s\n", jerr.text);
-		return -1;
+		return NULL;
+	}
+
+	*nfds = fds ? memfd_prepare_request(conn, jreq, fds) : 0;
+	if (*nfds < 0) {
+		json_decref(jreq);
+		return NULL;
 	}
 
 	msg_json(jreq, __func__); /* debugging */
-	jstr = json_dumps(jreq, JSON_COMPACT);
+	if (frame_enabled(conn))
+		jstr = frame_dumps(jreq, len);
+	else if ((jstr = json_dumps(jreq, JSON_COMPACT)))
+		*len = strlen(jstr);
 	if (jstr) {
-		result = write(conn->fd, jstr, strlen(jstr));
-		free(jstr);
+		stats_request_sent(conn, req->fn, req->id, *len);
+		CFG_PROBE(libvyatta_config, request_send,
+			  req->fn, req->id, *len);
+	} else {
+		memfd_close(fds, *nfds);
 	}
-
 	json_decref(jreq);
+	return jstr;
+}
+
+/* Consumes req->args, whether or not the request is sent */
+int send_request(struct configd_conn *conn, struct request *req)
+{
+	int result;
+	int fds[MEMFD_MAX_FDS];
+	int nfds;
+	char *jstr;
+	size_t len;
+
+	if (!conn || !req || !req->args) {
+		if (req)
+			json_decref(req->args);
+		errno = EFAULT;
+		return -1;
+	}
+
+	/* Its responses are read by configd_async_read() */
+	if (async_enabled(conn)) {
+		json_decref(req->args);
+		errno = EBUSY;
+		return -1;
+	}
+
+	jstr = encode_request(conn, req, fds, &nfds, &len);
+	if (!jstr)
+		return -1;
+
+	if (mux_enabled(conn))
+		result = mux_send(conn, jstr, len, fds, nfds);
+	else if (nfds)
+		result = memfd_send(conn->fd, jstr, len, fds, nfds);
+	else
+		result = write(conn->fd, jstr, len);
+	free(jstr);
+
+	memfd_close(fds, nfds);
 	return result;
 }
 
@@ -537,27 +598,25 @@ static int extract_result(json_t *jresult, struct response *resp) {
 	return retval;
 }
 
-int recv_response(struct configd_conn *conn, struct response *resp)
+static int check_reply_id(json_t *jresp, unsigned int id,
+			  struct response *resp)
 {
-	json_t *jresp = NULL;
-	json_t *jresult;
-	json_t *jobj;
-	int ret = -1;
-	json_error_t jerr;
+	json_t *jobj = json_object_get(jresp, "id");
 
-	if (!conn || !resp) {
-		errno = EFAULT;
+	if (!json_is_integer(jobj)) {
+		msg_err("configd response id must be an integer\n");
 		return -1;
 	}
+	resp->id = json_integer_value(jobj);
+	return (id == resp->id) ? 0 : -1;
+}
 
-	memset(&resp->result, 0, sizeof(resp->result));
-	while (jresp == NULL && !feof(conn->fp))
-		jresp = json_loadf(conn->fp, JSON_DISABLE_EOF_CHECK, &jerr);
-
-	if (!jresp || json_is_null(jresp)) {
-		msg_err("%s: %s\n", __func__, jerr.text);
-		return -1;
-	}
+/* id is that of the request being answered */
+int parse_reply(json_t *jresp, unsigned int id, struct response *resp)
+{
+	json_t *jresult;
+	json_t *jobj;
+	int ret = -1;
 
 	msg_json(jresp, __func__); /* debugging */
 
@@ -587,18 +646,711 @@ int recv_response(struct configd_conn *conn, struct response *resp)
 		}
 	}
 
-	jobj = json_object_get(jresp, "id");
-	if (!json_is_integer(jobj)) {
-		msg_err("configd response id must be an integer\n");
-		goto done;
+	ret = check_reply_id(jresp, id, resp);
+done:
+	return ret;
+}
+
+/* The id a response gives, or 0 if it has none */
+unsigned int response_id(const json_t *jresp)
+{
+	return json_integer_value(json_object_get(jresp, "id"));
+}
+
+/* fn is the method of the request being answered, for tracing only */
+static json_t *recv_message(struct configd_conn *conn, const char *fn)
+{
+	json_t *jresp = NULL;
+	json_error_t jerr;
+
+	jerr.position = 0;
+	if (frame_enabled(conn)) {
+		jresp = frame_loadf(conn->fp, &jerr);
+	} else {
+		while (jresp == NULL && !feof(conn->fp))
+			jresp = json_loadf(conn->fp, JSON_DISABLE_EOF_CHECK,
+					   &jerr);
 	}
-	resp->id = json_integer_value(jobj);
-	ret = (conn->req_id == resp->id) ? 0 : -1;
+
+	/* jansson leaves the bytes consumed in position, even on success */
+	stats_response_received(conn, response_id(jresp),
+				jresp ? jerr.position : 0);
+	CFG_PROBE(libvyatta_config, response_receive,
+		  fn, response_id(jresp), jresp ? jerr.position : 0);
+
+	if (!jresp || json_is_null(jresp)) {
+		msg_err("%s: %s\n", __func__, jerr.text);
+		json_decref(jresp);
+		return NULL;
+	}
+	return jresp;
+}
+
+/* id is that of the request being answered */
+static int recv_reply(struct configd_conn *conn, const char *fn,
+		      unsigned int id, struct response *resp)
+{
+	json_t *jresp;
+	const char *body;
+	size_t len;
+	int ret;
+
+	if (!conn || !resp) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	memset(&resp->result, 0, sizeof(resp->result));
+	jresp = recv_message(conn, fn);
+	if (!jresp)
+		return -1;
+
+	ret = memfd_take_result(conn, jresp, &body, &len);
+	if (ret > 0) {
+		resp->type = STRING;
+		resp->result.str_val = malloc(len + 1);
+		if (resp->result.str_val) {
+			memcpy(resp->result.str_val, body, len);
+			resp->result.str_val[len] = '\0';
+		}
+		memfd_release(body, len);
+		ret = resp->result.str_val
+			? check_reply_id(jresp, id, resp) : -1;
+	} else if (ret == 0) {
+		ret = parse_reply(jresp, id, resp);
+	}
+	json_decref(jresp);
+	return ret;
+}
+
+int recv_response(struct configd_conn *conn, struct response *resp)
+{
+	return recv_reply(conn, NULL, conn->req_id, resp);
+}
+
+/* Read the next response on a shared connection, whichever thread it is
+ * for. A result in a memfd is taken here, while the queued descriptors
+ * are still in step with the responses.
+ */
+static json_t *mux_read(struct configd_conn *conn)
+{
+	json_t *jresp = recv_message(conn, NULL);
+	const char *body;
+	size_t len;
+	int ret;
+
+	if (!jresp)
+		return NULL;
+
+	ret = memfd_take_result(conn, jresp, &body, &len);
+	if (ret > 0) {
+		ret = json_object_set_new(jresp, "result",
+					  json_stringn_nocheck(body, len));
+		memfd_release(body, len);
+	}
+	if (ret < 0) {
+		json_decref(jresp);
+		return NULL;
+	}
+	return jresp;
+}
+
+/* As recv_reply for the response to req, which on a shared connection
+ * another thread may already have read.
+ */
+static int await_reply(struct configd_conn *conn, const struct request *req,
+		       struct response *resp)
+{
+	json_t *jresp;
+	int ret;
+
+	if (!mux_enabled(conn))
+		return recv_reply(conn, req->fn, req->id, resp);
+
+	memset(&resp->result, 0, sizeof(resp->result));
+	jresp = mux_await(conn, req->id, mux_read);
+	if (!jresp)
+		return -1;
+	ret = parse_reply(jresp, req->id, resp);
+	json_decref(jresp);
+	return ret;
+}
+
+/*
+ * TreeGet and Show can return many megabytes of text. Rather than have
+ * jansson build the whole response and then copy the result string out
+ * of it, the members of the response object are read one at a time and
+ * a string result is unescaped straight into the caller's file
+ * descriptor, or into jansson's parser when the caller wants the tree it
+ * encodes. The other members are small and are parsed as usual.
+ */
+struct stream_reader {
+	FILE *fp;
+	size_t pos;		/* bytes consumed */
+	int fd;			/* -1 to parse a string result instead */
+	json_t *parsed;
+	int write_errno;	/* first failed write, output stops there */
+	int in_string;		/* as sr_string_step, for sr_string_load */
+	size_t off;		/* next byte of buf for sr_string_load */
+	size_t len;
+	char buf[8192];
+};
+
+static int sr_getc(struct stream_reader *sr)
+{
+	int c = getc_unlocked(sr->fp);
+
+	if (c != EOF)
+		sr->pos++;
+	return c;
+}
+
+static void sr_ungetc(struct stream_reader *sr, int c)
+{
+	ungetc(c, sr->fp);
+	sr->pos--;
+}
+
+static int sr_is_space(int c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int sr_skip_space(struct stream_reader *sr)
+{
+	int c;
+
+	do
+		c = sr_getc(sr);
+	while (sr_is_space(c));
+	return c;
+}
+
+static void sr_write(struct stream_reader *sr, const char *p, size_t len)
+{
+	ssize_t n;
+
+	while (len && !sr->write_errno) {
+		n = write(sr->fd, p, len);
+		if (n < 0) {
+			if (errno != EINTR)
+				sr->write_errno = errno;
+			continue;
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+static void sr_flush(struct stream_reader *sr)
+{
+	sr_write(sr, sr->buf, sr->len);
+	sr->len = 0;
+}
+
+static void sr_putc(struct stream_reader *sr, int c)
+{
+	if (sr->len == sizeof(sr->buf))
+		sr_flush(sr);
+	sr->buf[sr->len++] = c;
+}
+
+static void sr_put_utf8(struct stream_reader *sr, unsigned int cp)
+{
+	if (cp < 0x80) {
+		sr_putc(sr, cp);
+	} else if (cp < 0x800) {
+		sr_putc(sr, 0xc0 | cp >> 6);
+		sr_putc(sr, 0x80 | (cp & 0x3f));
+	} else if (cp < 0x10000) {
+		sr_putc(sr, 0xe0 | cp >> 12);
+		sr_putc(sr, 0x80 | (cp >> 6 & 0x3f));
+		sr_putc(sr, 0x80 | (cp & 0x3f));
+	} else {
+		sr_putc(sr, 0xf0 | cp >> 18);
+		sr_putc(sr, 0x80 | (cp >> 12 & 0x3f));
+		sr_putc(sr, 0x80 | (cp >> 6 & 0x3f));
+		sr_putc(sr, 0x80 | (cp & 0x3f));
+	}
+}
+
+static int sr_hex4(struct stream_reader *sr, unsigned int *cp)
+{
+	int i, c;
+
+	*cp = 0;
+	for (i = 0; i < 4; i++) {
+		c = sr_getc(sr);
+		if (c >= '0' && c <= '9')
+			c -= '0';
+		else if (c >= 'a' && c <= 'f')
+			c -= 'a' - 10;
+		else if (c >= 'A' && c <= 'F')
+			c -= 'A' - 10;
+		else
+			return -1;
+		*cp = *cp << 4 | c;
+	}
+	return 0;
+}
+
+/* Unescape the next character of a JSON string whose opening quote has
+ * been read. Returns 1 while there is more, 0 once the closing quote has
+ * been read and -1 if the string is malformed.
+ */
+static int sr_string_step(struct stream_reader *sr)
+{
+	unsigned int cp, lo;
+	int c;
+
+	c = sr_getc(sr);
+	if (c == EOF || (c >= 0 && c < 0x20))
+		return -1;
+	if (c == '"')
+		return 0;
+	if (c != '\\') {
+		sr_putc(sr, c);
+		return 1;
+	}
+	switch (c = sr_getc(sr)) {
+	case '"':
+	case '\\':
+	case '/':
+		break;
+	case 'b':
+		c = '\b';
+		break;
+	case 'f':
+		c = '\f';
+		break;
+	case 'n':
+		c = '\n';
+		break;
+	case 'r':
+		c = '\r';
+		break;
+	case 't':
+		c = '\t';
+		break;
+	case 'u':
+		if (sr_hex4(sr, &cp) < 0 || cp == 0)
+			return -1;
+		if (cp >= 0xd800 && cp < 0xdc00) {
+			if (sr_getc(sr) != '\\' || sr_getc(sr) != 'u'
+			    || sr_hex4(sr, &lo) < 0
+			    || lo < 0xdc00 || lo >= 0xe000)
+				return -1;
+			cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+		} else if (cp >= 0xdc00 && cp < 0xe000) {
+			return -1;
+		}
+		sr_put_utf8(sr, cp);
+		return 1;
+	default:
+		return -1;
+	}
+	sr_putc(sr, c);
+	return 1;
+}
+
+/* Write out the body of a JSON string whose opening quote has been read */
+static int sr_string_to_fd(struct stream_reader *sr)
+{
+	int ret;
+
+	while ((ret = sr_string_step(sr)) > 0)
+		;
+	if (ret == 0)
+		sr_flush(sr);
+	return ret;
+}
+
+/* json_load_callback_t handing jansson the string unescaped. As a step
+ * adds at most 4 bytes, buf is never flushed to sr->fd.
+ */
+static size_t sr_string_load(void *buffer, size_t size, void *data)
+{
+	struct stream_reader *sr = data;
+	size_t n;
+
+	if (sr->off == sr->len) {
+		sr->off = sr->len = 0;
+		while (sr->in_string > 0 && sr->len + 4 <= sizeof(sr->buf))
+			sr->in_string = sr_string_step(sr);
+		if (sr->in_string < 0)
+			return (size_t)-1;
+	}
+	n = sr->len - sr->off;
+	if (n > size)
+		n = size;
+	memcpy(buffer, sr->buf + sr->off, n);
+	sr->off += n;
+	return n;
+}
+
+/* Parse the body of a JSON string whose opening quote has been read as
+ * JSON in its own right, without unescaping it into memory first. The
+ * string is read to its end even if what it holds is not JSON, leaving
+ * sr->parsed NULL.
+ */
+static int sr_string_parse(struct stream_reader *sr)
+{
+	json_error_t jerr;
+
+	sr->in_string = 1;
+	sr->off = sr->len = 0;
+	sr->parsed = json_load_callback(sr_string_load, sr, JSON_DECODE_ANY,
+					&jerr);
+	if (!sr->parsed && sr->in_string >= 0)
+		msg_err("%s: %s\n", __func__, jerr.text);
+	while (sr->in_string > 0) {
+		sr->len = 0;
+		sr->in_string = sr_string_step(sr);
+	}
+	sr->len = 0;
+	return sr->in_string;
+}
+
+/* A string result that has been read whole */
+static void sr_result(struct stream_reader *sr, const char *p, size_t len)
+{
+	json_error_t jerr;
+
+	if (sr->fd >= 0) {
+		sr_write(sr, p, len);
+		return;
+	}
+	sr->parsed = json_loadb(p, len, JSON_DECODE_ANY, &jerr);
+	if (!sr->parsed)
+		msg_err("%s: %s\n", __func__, jerr.text);
+}
+
+/* Read an object key whose opening quote has been read. Keys with escapes
+ * are never ones we look for, so they are kept as is.
+ */
+static int sr_key(struct stream_reader *sr, char *key, size_t size)
+{
+	size_t n = 0;
+	int c;
+
+	while ((c = sr_getc(sr)) != '"') {
+		if (c == EOF)
+			return -1;
+		if (c == '\\' && (c = sr_getc(sr)) == EOF)
+			return -1;
+		if (n < size - 1)
+			key[n++] = c;
+	}
+	key[n] = '\0';
+	return 0;
+}
+
+struct sr_text {
+	char *str;
+	size_t len;
+	size_t size;
+};
+
+static int sr_text_add(struct sr_text *t, int c)
+{
+	size_t size;
+	char *str;
+
+	if (t->len + 1 >= t->size) {
+		size = t->size ? t->size * 2 : 64;
+		str = realloc(t->str, size);
+		if (!str)
+			return -1;
+		t->str = str;
+		t->size = size;
+	}
+	t->str[t->len++] = c;
+	t->str[t->len] = '\0';
+	return 0;
+}
+
+/* Copy out the JSON value starting with c and parse it */
+static json_t *sr_value(struct stream_reader *sr, int c)
+{
+	struct sr_text text = { NULL, 0, 0 };
+	int depth = 0, in_str = 0;
+	json_error_t jerr;
+	json_t *jval = NULL;
+
+	if (c == '"' || c == '{' || c == '[') {
+		for (;;) {
+			if (c == EOF || sr_text_add(&text, c) < 0)
+				goto done;
+			if (in_str) {
+				if (c == '\\') {
+					c = sr_getc(sr);
+					if (c == EOF || sr_text_add(&text, c) < 0)
+						goto done;
+				} else if (c == '"') {
+					in_str = 0;
+				}
+			} else if (c == '"') {
+				in_str = 1;
+			} else if (c == '{' || c == '[') {
+				depth++;
+			} else if (c == '}' || c == ']') {
+				depth--;
+			}
+			if (!in_str && depth == 0)
+				break;
+			c = sr_getc(sr);
+		}
+	} else {
+		while (c != EOF && c != ',' && c != '}' && !sr_is_space(c)) {
+			if (sr_text_add(&text, c) < 0)
+				goto done;
+			c = sr_getc(sr);
+		}
+		if (c == EOF || !text.len)
+			goto done;
+		sr_ungetc(sr, c);
+	}
+	jval = json_loads(text.str, JSON_DECODE_ANY, &jerr);
+	if (!jval)
+		msg_err("%s: %s\n", __func__, jerr.text);
 done:
+	free(text.str);
+	return jval;
+}
+
+/* Read one response object, streaming a string result to fd or the
+ * parser. The other members are collected in *jresp. Returns 1 if the
+ * result was streamed, 0 if it was not a string and -1 if the response
+ * is malformed.
+ */
+static int sr_response(struct stream_reader *sr, json_t **jresp)
+{
+	int c, streamed = 0;
+	char key[32];
+	json_t *jval;
+
+	*jresp = json_object();
+	if (!*jresp)
+		return -1;
+
+	if (sr_skip_space(sr) != '{')
+		return -1;
+	c = sr_skip_space(sr);
+	if (c == '}')
+		return 0;
+
+	for (;;) {
+		if (c != '"' || sr_key(sr, key, sizeof(key)) < 0)
+			return -1;
+		if (sr_skip_space(sr) != ':')
+			return -1;
+		c = sr_skip_space(sr);
+		if (c == '"' && strcmp(key, "result") == 0) {
+			if ((sr->fd >= 0 ? sr_string_to_fd(sr)
+					 : sr_string_parse(sr)) < 0)
+				return -1;
+			streamed = 1;
+		} else {
+			jval = sr_value(sr, c);
+			if (!jval)
+				return -1;
+			json_object_set_new(*jresp, key, jval);
+		}
+		c = sr_skip_space(sr);
+		if (c == '}')
+			return streamed;
+		if (c != ',')
+			return -1;
+		c = sr_skip_space(sr);
+	}
+}
+
+/* With binary framing there is nothing to gain from streaming, so the
+ * frame is read whole and a string result taken from it.
+ */
+static int frame_response(struct stream_reader *sr, json_t **jresp)
+{
+	json_error_t jerr;
+	json_t *result;
+
+	*jresp = frame_loadf(sr->fp, &jerr);
+	sr->pos = jerr.position;
+	if (!*jresp)
+		return -1;
+
+	result = json_object_get(*jresp, "result");
+	if (!json_is_string(result))
+		return 0;
+	sr_result(sr, json_string_value(result), json_string_length(result));
+	return 1;
+}
+
+/* The common part of recv_reply_to_fd and recv_reply_parsed, for the
+ * response to req.
+ */
+static int recv_reply_stream(struct configd_conn *conn,
+			     const struct request *req,
+			     struct stream_reader *sr, struct response *resp)
+{
+	json_t *jresp = NULL;
+	const char *body;
+	size_t len;
+	int ret = -1;
+
+	memset(&resp->result, 0, sizeof(resp->result));
+	sr->fp = conn->fp;
+
+	flockfile(conn->fp);
+	if (frame_enabled(conn))
+		ret = frame_response(sr, &jresp);
+	else
+		ret = sr_response(sr, &jresp);
+	funlockfile(conn->fp);
+
+	stats_response_received(conn, response_id(jresp),
+				ret < 0 ? 0 : sr->pos);
+	CFG_PROBE(libvyatta_config, response_receive,
+		  req->fn, req->id, ret < 0 ? 0 : sr->pos);
+
+	if (ret < 0) {
+		msg_err("%s: malformed configd response\n", __func__);
+	} else if (ret > 0) {
+		resp->type = STRING;
+		ret = check_reply_id(jresp, req->id, resp);
+	} else if ((ret = memfd_take_result(conn, jresp, &body, &len)) > 0) {
+		sr_result(sr, body, len);
+		memfd_release(body, len);
+		resp->type = STRING;
+		ret = check_reply_id(jresp, req->id, resp);
+	} else if (ret == 0) {
+		ret = parse_reply(jresp, req->id, resp);
+	}
 	json_decref(jresp);
 	return ret;
 }
 
+/*
+ * As recv_reply, but a string result is written to fd rather than
+ * returned; resp is then of type STRING with a NULL str_val. Output that
+ * has been written is not taken back if the response turns out to be
+ * bad. A failure writing to fd leaves errno in *write_errno, the rest of
+ * the response is still read so that the connection remains usable.
+ */
+static int recv_reply_to_fd(struct configd_conn *conn,
+			    const struct request *req, int fd,
+			    struct response *resp, int *write_errno)
+{
+	struct stream_reader *sr;
+	int ret;
+
+	if (!conn || !resp) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	sr = calloc(1, sizeof(*sr));
+	if (!sr)
+		return -1;
+	sr->fd = fd;
+	ret = recv_reply_stream(conn, req, sr, resp);
+	*write_errno = sr->write_errno;
+	free(sr);
+	return ret;
+}
+
+/*
+ * As recv_reply, but a string result is parsed as JSON into *parsed
+ * rather than returned; resp is then of type STRING with a NULL str_val,
+ * and *parsed is NULL if the result was not JSON.
+ */
+static int recv_reply_parsed(struct configd_conn *conn,
+			     const struct request *req,
+			     struct response *resp, json_t **parsed)
+{
+	struct stream_reader *sr;
+	int ret;
+
+	if (!conn || !resp) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	sr = calloc(1, sizeof(*sr));
+	if (!sr)
+		return -1;
+	sr->fd = -1;
+	ret = recv_reply_stream(conn, req, sr, resp);
+	*parsed = sr->parsed;
+	if (ret < 0) {
+		json_decref(*parsed);
+		*parsed = NULL;
+	}
+	free(sr);
+	return ret;
+}
+
+/* As recv_reply_to_fd for the response to req. On a shared connection
+ * the result is read into memory and written out from there.
+ */
+static int await_reply_to_fd(struct configd_conn *conn,
+			     const struct request *req, int fd,
+			     struct response *resp, int *write_errno)
+{
+	const char *p;
+	size_t len;
+	ssize_t n;
+
+	if (!mux_enabled(conn))
+		return recv_reply_to_fd(conn, req, fd, resp, write_errno);
+
+	if (await_reply(conn, req, resp) < 0)
+		return -1;
+	if (resp->type != STRING)
+		return 0;
+
+	p = resp->result.str_val;
+	len = strlen(p);
+	while (len && !*write_errno) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno != EINTR)
+				*write_errno = errno;
+			continue;
+		}
+		p += n;
+		len -= n;
+	}
+	free(resp->result.str_val);
+	resp->result.str_val = NULL;
+	return 0;
+}
+
+/* As recv_reply_parsed for the response to req. On a shared connection
+ * the result is read into memory and parsed from there.
+ */
+static int await_reply_parsed(struct configd_conn *conn,
+			      const struct request *req,
+			      struct response *resp, json_t **parsed)
+{
+	json_error_t jerr;
+
+	*parsed = NULL;
+	if (!mux_enabled(conn))
+		return recv_reply_parsed(conn, req, resp, parsed);
+
+	if (await_reply(conn, req, resp) < 0)
+		return -1;
+	if (resp->type != STRING)
+		return 0;
+
+	*parsed = json_loads(resp->result.str_val, JSON_DECODE_ANY, &jerr);
+	if (!*parsed)
+		msg_err("%s: %s\n", __func__, jerr.text);
+	free(resp->result.str_val);
+	resp->result.str_val = NULL;
+	return 0;
+}
+
 // handle_rpc_error
 //
 // Handle returned error, which may be a simple string, or a map containing
@@ -627,7 +1379,7 @@ int get_int(struct configd_conn *conn, struct request *req, struct configd_error
 		return -1;
 	}
 
-	if (recv_response(conn, &resp) == -1) {
+	if (await_reply(conn, req, &resp) == -1) {
 		if (!error)
 			msg_err("Error receiving configd int response\n");
 		error_setf(error, "Error receiving response");
@@ -652,6 +1404,136 @@ error:
 	return -1;
 }
 
+/*
+ * Sends the n requests without waiting for each response in turn, for
+ * those that return no more than success or an error. The error of each
+ * request that fails is gathered into error, and a copy of its text left
+ * in errors[i] when errors is non NULL. Returns the number that failed, or
+ * -1 if the connection failed, when those not yet answered are failed too.
+ */
+int get_pipelined(struct configd_conn *conn, struct request *reqs, size_t n,
+		  char **errors, struct configd_error *error)
+{
+	struct configd_error one;
+	struct response resp;
+	const char *lost = NULL;
+	size_t sent = 0, done;
+	int failed = 0;
+
+	if (!conn || !reqs) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	for (done = 0; done < n; done++) {
+		while (sent < n && sent - done < PIPELINE_DEPTH) {
+			if (send_request(conn, &reqs[sent]) == -1) {
+				lost = "Error sending request";
+				break;
+			}
+			sent++;
+		}
+		if (lost)
+			break;
+
+		error_init(&one, error ? error->source : NULL);
+		if (await_reply(conn, &reqs[done], &resp) == -1) {
+			lost = "Error receiving response";
+			response_free(&resp);
+			break;
+		}
+		switch (resp.type) {
+		case ERROR:
+			handle_rpc_error(&one, &resp);
+			break;
+		case MGMTERROR:
+			error_set_from_mgmt_error_list(&one, &resp.result.mgmt_errs,
+						       reqs[done].fn);
+			break;
+		default:
+			break;
+		}
+		response_free(&resp);
+
+		if (one.text) {
+			failed++;
+			if (errors)
+				errors[done] = local_strdup(one.text);
+			error_merge(error, &one);
+		}
+		configd_error_free(&one);
+	}
+	if (!lost)
+		return failed;
+
+	if (!error)
+		msg_err("%s: %s\n", __func__, lost);
+	error_init(&one, NULL);
+	error_setf(&one, "%s\n", lost);
+	error_merge(error, &one);
+	configd_error_free(&one);
+	for (; done < n; done++)
+		if (errors)
+			errors[done] = local_strdup(lost);
+	/* send_request() consumed the args of the one that failed */
+	if (sent < n)
+		sent++;
+	for (; sent < n; sent++)
+		json_decref(reqs[sent].args);
+	return -1;
+}
+
+/*
+ * As get_pipelined, for no more than PIPELINE_DEPTH requests that are
+ * answered together: all n are sent before any response is read, and the
+ * responses are left in resps for the caller to free with response_free.
+ * Returns 0, or -1 with error set and no responses if the connection
+ * failed.
+ */
+int get_responses(struct configd_conn *conn, struct request *reqs, size_t n,
+		  struct response *resps, struct configd_error *error)
+{
+	const char *lost = NULL;
+	size_t sent, done;
+
+	if (!conn || !reqs || !resps) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (n > PIPELINE_DEPTH) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (sent = 0; sent < n; sent++) {
+		if (send_request(conn, &reqs[sent]) == -1) {
+			lost = "Error sending request";
+			break;
+		}
+	}
+	for (done = 0; !lost && done < n; done++) {
+		resps[done].type = INT;
+		if (await_reply(conn, &reqs[done], &resps[done]) == -1) {
+			lost = "Error receiving response";
+			response_free(&resps[done]);
+			break;
+		}
+	}
+	if (!lost)
+		return 0;
+
+	if (!error)
+		msg_err("%s: %s\n", __func__, lost);
+	error_setf(error, "%s\n", lost);
+	while (done > 0)
+		response_free(&resps[--done]);
+	if (sent < n)
+		sent++;
+	for (; sent < n; sent++)
+		json_decref(reqs[sent].args);
+	return -1;
+}
+
 char *get_str(struct configd_conn *conn, struct request *req, struct configd_error *error)
 {
 	struct response resp;
@@ -668,7 +1550,7 @@ char *get_str(struct configd_conn *conn, struct request *req, struct configd_err
 		return NULL;
 	}
 
-	if (recv_response(conn, &resp) == -1) {
+	if (await_reply(conn, req, &resp) == -1) {
 		if (!error)
 			msg_err("Error receiving configd string response\n");
 		error_setf(error, "Error receiving response");
@@ -693,6 +1575,150 @@ error:
 	return NULL;
 }
 
+int get_str_to_fd(struct configd_conn *conn, struct request *req, int fd,
+		  struct configd_error *error)
+{
+	struct response resp;
+	int write_errno = 0;
+
+	if (!conn || !req) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (send_request(conn, req) == -1) {
+		if (!error)
+			msg_err("Error sending configd string request\n");
+		error_setf(error, "Error sending request");
+		return -1;
+	}
+
+	if (await_reply_to_fd(conn, req, fd, &resp, &write_errno) == -1) {
+		if (!error)
+			msg_err("Error receiving configd string response\n");
+		error_setf(error, "Error receiving response");
+		goto error;
+	}
+
+	switch (resp.type) {
+	case STRING:
+		if (write_errno) {
+			error_setf(error, "Error writing response: %s",
+				   strerror(write_errno));
+			errno = write_errno;
+			return -1;
+		}
+		return 0;
+	case ERROR:
+		handle_rpc_error(error, &resp);
+		break;
+	case MGMTERROR:
+		error_set_from_mgmt_error_list(error, &resp.result.mgmt_errs, req->fn);
+		break;
+	default:
+		break;
+
+	}
+error:
+	response_free(&resp);
+	return -1;
+}
+
+json_t *get_json(struct configd_conn *conn, struct request *req,
+		 struct configd_error *error)
+{
+	struct response resp;
+	json_t *parsed = NULL;
+
+	if (!conn || !req) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+	if (send_request(conn, req) == -1) {
+		if (!error)
+			msg_err("Error sending configd string request\n");
+		error_setf(error, "Error sending request");
+		return NULL;
+	}
+
+	if (await_reply_parsed(conn, req, &resp, &parsed) == -1) {
+		if (!error)
+			msg_err("Error receiving configd string response\n");
+		error_setf(error, "Error receiving response");
+		goto error;
+	}
+
+	switch (resp.type) {
+	case STRING:
+		if (parsed)
+			return parsed;
+		error_setf(error, "Response is not valid JSON");
+		break;
+	case ERROR:
+		handle_rpc_error(error, &resp);
+		break;
+	case MGMTERROR:
+		error_set_from_mgmt_error_list(error, &resp.result.mgmt_errs, req->fn);
+		break;
+	default:
+		break;
+
+	}
+error:
+	json_decref(parsed);
+	response_free(&resp);
+	return NULL;
+}
+
+/*
+ * As get_json for up to PIPELINE_DEPTH requests answered together, see
+ * get_responses. Returns 0 with each out[i] set, or -1 with none set if
+ * any request fails.
+ */
+int get_json_responses(struct configd_conn *conn, struct request *reqs,
+		       size_t n, json_t **out, struct configd_error *error)
+{
+	struct response resps[PIPELINE_DEPTH];
+	json_error_t jerr;
+	int result = 0;
+	size_t i;
+
+	if (get_responses(conn, reqs, n, resps, error) < 0)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		out[i] = NULL;
+		switch (resps[i].type) {
+		case STRING:
+			out[i] = json_loads(resps[i].result.str_val,
+					    JSON_DECODE_ANY, &jerr);
+			if (!out[i])
+				error_setf(error, "Response is not valid JSON");
+			break;
+		case ERROR:
+			handle_rpc_error(error, &resps[i]);
+			break;
+		case MGMTERROR:
+			error_set_from_mgmt_error_list(
+				error, &resps[i].result.mgmt_errs, reqs[i].fn);
+			break;
+		default:
+			break;
+		}
+		if (!out[i])
+			result = -1;
+		response_free(&resps[i]);
+	}
+	if (result < 0) {
+		for (i = 0; i < n; i++) {
+			json_decref(out[i]);
+			out[i] = NULL;
+		}
+	}
+	return result;
+}
+
 struct vector *get_vector(struct configd_conn *conn, struct request *req, struct configd_error *error)
 {
 	struct response resp;
@@ -709,7 +1735,7 @@ struct vector *get_vector(struct configd_conn *conn, struct request *req, struct
 		return NULL;
 	}
 
-	if (recv_response(conn, &resp) == -1) {
+	if (await_reply(conn, req, &resp) == -1) {
 		if (!error)
 			msg_err("Error receiving configd vector response\n");
 		error_setf(error, "Error receiving response");
@@ -750,7 +1776,7 @@ struct map *get_map(struct configd_conn *conn, struct request *req, struct confi
 		return NULL;
 	}
 
-	if (recv_response(conn, &resp) == -1) {
+	if (await_reply(conn, req, &resp) == -1) {
 		if (!error)
 			msg_err("Error receiving configd map response\n");
 		error_setf(error, "Error receiving response");
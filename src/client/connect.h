@@ -46,6 +46,95 @@ void configd_close_connection(struct configd_conn *);
  */
 int configd_set_session_id(struct configd_conn *, const char *);
 
+/**
+ * configd_conn_memfd_enable asks for string parameters and results of 64KiB
+ * or more to be passed in sealed memfds alongside the messages on this
+ * connection, rather than escaped into the JSON. This saves encoding,
+ * parsing and copying very large configurations. It only takes effect if
+ * configd supports it, and must be called while no requests are awaiting
+ * responses. The return values are 1:enabled, 0:not supported by
+ * configd, -1:error.
+ */
+int configd_conn_memfd_enable(struct configd_conn *);
+
+/**
+ * configd_conn_cbor_enable switches the connection from text JSON to
+ * length prefixed CBOR messages, if configd supports that. This happens
+ * automatically in configd_open_connection when VYATTA_CONFIG_CBOR is set
+ * in the environment. The return values are 1:enabled, 0:not supported by
+ * configd, -1:error.
+ */
+int configd_conn_cbor_enable(struct configd_conn *);
+
+/**
+ * configd_conn_mux_enable lets several threads use the connection, and
+ * its session, at the same time. Each thread's requests go out as they
+ * are made and each caller waits only for its own response, whichever
+ * thread happens to read it. Changing the session id, turning on the
+ * optional transports above and closing the connection must still be
+ * done while no other thread is using it.
+ * Returns 0:ok, -1:error.
+ */
+int configd_conn_mux_enable(struct configd_conn *);
+
+#define CONFIGD_STATS_BUCKETS 32
+
+/* Client side counters for one RPC method on one connection. Latencies
+ * run from sending the request to having parsed the response.
+ */
+struct configd_method_stats {
+	char *method;
+	unsigned long calls;
+	unsigned long long bytes_sent;
+	unsigned long long bytes_received;
+	unsigned long long total_us;
+	unsigned long long max_us;
+	/* hist[0] counts calls taking under 1us, hist[i] those taking
+	 * from 2^(i-1) up to 2^i us. The last bucket also holds anything
+	 * slower.
+	 */
+	unsigned long hist[CONFIGD_STATS_BUCKETS];
+};
+
+struct configd_conn_stats {
+	size_t num_methods;
+	struct configd_method_stats *methods;
+};
+
+/**
+ * configd_conn_stats_enable starts collecting per method statistics for a
+ * connection. Each response is matched to its request by id, so requests
+ * may be pipelined or made by several threads at once. When more than 64
+ * requests are awaiting responses, some of their latencies are dropped.
+ * Collection starts automatically in configd_open_connection when
+ * VYATTA_CONFIG_STATS is set in the environment, in which case the
+ * statistics are also written out by configd_close_connection: appended
+ * to the file named by VYATTA_CONFIG_STATS if it is an absolute path,
+ * otherwise to stderr. Returns 0:ok, -1:error.
+ */
+int configd_conn_stats_enable(struct configd_conn *);
+
+/**
+ * configd_conn_stats returns the statistics collected so far, or NULL if
+ * they are not enabled for this connection. The result is only valid
+ * until the next request on the connection or until it is closed.
+ */
+const struct configd_conn_stats *configd_conn_stats(struct configd_conn *);
+
+/**
+ * configd_conn_stats_dump writes a table of the statistics for the
+ * connection to fp, busiest method first.
+ */
+void configd_conn_stats_dump(struct configd_conn *, FILE *);
+
+/**
+ * configd_conn_stats_trace writes a line to fp for each request once its
+ * response has been read: a JSON object with the pid, method, request id,
+ * bytes sent and received and the latency in microseconds. NULL stops the
+ * trace. Statistics must already be enabled. Returns 0:ok, -1:error.
+ */
+int configd_conn_stats_trace(struct configd_conn *, FILE *);
+
 #ifdef __cplusplus
 }
 #endif
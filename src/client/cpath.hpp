@@ -10,41 +10,126 @@
 
 #ifndef CPATH_HPP_
 #define CPATH_HPP_
+#include <cstdlib>
+#include <cstring>
+#include <new>
 #include <string>
-#include <vector>
 #include <uriparser/Uri.h>
 
+#include "path.h"
+
 /*
- *  URI_MULT is defined by the uriparser documenation to need to be 6 when expanding breaks
- *  http://uriparser.sourceforge.net/doc/html/Uri_8h.html#a0d501e7c2a6abe76b729ea72e123dea8
+ * CpathBuf is a growable array of trivially copyable elements that keeps
+ * its first N elements inline. It only goes to the heap once a path
+ * outgrows the inline storage, and then grows geometrically.
  */
-#define URI_MULT 6
+template <typename T, size_t N>
+class CpathBuf
+{
+public:
+	CpathBuf() : _buf(_inline), _len(0), _cap(N) {};
+	CpathBuf(const CpathBuf &b) : _buf(_inline), _len(0), _cap(N) {
+		assign(b._buf, b._len);
+	};
+	~CpathBuf() {
+		if (_buf != _inline)
+			free(_buf);
+	};
 
+	CpathBuf& operator=(const CpathBuf &b) {
+		if (this != &b)
+			assign(b._buf, b._len);
+		return *this;
+	};
+
+	T *data() { return _buf; };
+	const T *data() const { return _buf; };
+	size_t size() const { return _len; };
+	T &operator[](size_t idx) { return _buf[idx]; };
+	const T &operator[](size_t idx) const { return _buf[idx]; };
+	T &back() { return _buf[_len - 1]; };
+	const T &back() const { return _buf[_len - 1]; };
+
+	void reserve(size_t cap) {
+		if (cap <= _cap)
+			return;
+		size_t ncap = _cap * 2;
+		if (ncap < cap)
+			ncap = cap;
+		T *nbuf = static_cast<T *>(malloc(ncap * sizeof(T)));
+		if (!nbuf)
+			throw std::bad_alloc();
+		memcpy(nbuf, _buf, _len * sizeof(T));
+		if (_buf != _inline)
+			free(_buf);
+		_buf = nbuf;
+		_cap = ncap;
+	};
+	/* shrink only; elements past len are discarded */
+	void truncate(size_t len) {
+		if (len < _len)
+			_len = len;
+	};
+	/* extend by n uninitialised elements and return the first of them */
+	T *extend(size_t n) {
+		reserve(_len + n);
+		T *p = _buf + _len;
+		_len += n;
+		return p;
+	};
+	void push_back(T v) {
+		*extend(1) = v;
+	};
+	void append(const T *src, size_t n) {
+		if (src >= _buf && src < _buf + _len) {
+			/* appending from ourselves; survive a reallocation */
+			size_t off = src - _buf;
+			reserve(_len + n);
+			src = _buf + off;
+		}
+		memcpy(extend(n), src, n * sizeof(T));
+	};
+	void assign(const T *src, size_t n) {
+		_len = 0;
+		reserve(n);
+		memcpy(_buf, src, n * sizeof(T));
+		_len = n;
+	};
+
+private:
+	T *_buf;
+	size_t _len;
+	size_t _cap;
+	T _inline[N];
+};
+
+/*
+ * Cpath is a configuration path held as a list of unescaped components.
+ *
+ * Component strings are packed back to back in a single buffer and the
+ * URL escaped "/a/b/c" form of the path is maintained incrementally as
+ * components are pushed and popped, so to_path_cstr() is free and
+ * to_path_string() is a single copy. Typical paths fit entirely in the
+ * inline storage described by CpathParams and never touch the heap.
+ */
 class Cpath
 {
 public:
-	Cpath()  : _data() {};
-	Cpath(const Cpath& p) : _data() {
-		operator=(p);
-	};
-	Cpath(const std::string &comps) : _data() {
-		size_t pos = 0;
-		std::string token;
-		std::string s = comps;
-		size_t startpos = s.find_first_not_of(" \t/");
-		if(startpos != std::string::npos)
-		{
-			s = s.substr(startpos);
-		}
-		while ((pos = s.find('/')) != std::string::npos) {
-			token = s.substr(0, pos);
-			push(url_unescape(token));
-			s.erase(0, pos + 1);
-		}
-		token = s.substr(0, pos);
-		push(url_unescape(token));
+	Cpath() {
+		init_root();
+	};
+	Cpath(const Cpath& p)
+		: _data(p._data), _escaped(p._escaped), _comps(p._comps) {};
+	Cpath(const std::string &comps) {
+		init_root();
+		parse(comps.c_str(), comps.length());
+	}
+	Cpath(const char *comps) {
+		init_root();
+		parse(comps, strlen(comps));
 	}
 	Cpath(const char *comps[], size_t num_comps) {
+		init_root();
 		for (size_t i = 0; i < num_comps; i++) {
 			push(comps[i]);
 		}
@@ -52,27 +137,35 @@ public:
 	~Cpath() {};
 
 	void push(const char *comp) {
-		_data.push_back(comp);
+		push(comp, strlen(comp));
 	};
 	void push(const std::string &comp) {
-		_data.push_back(comp.c_str());
+		push(comp.c_str(), strlen(comp.c_str()));
 	};
 	void push_unescape(const char *comp) {
-		_data.push_back(url_unescape(comp));
+		push_unescape(comp, strlen(comp));
 	};
 	void pop() {
-		_data.pop_back();
+		const Comp &c = _comps.back();
+		_data.truncate(c.data_off);
+		_escaped.truncate(c.esc_off);
+		_escaped.push_back('\0');
+		_comps.truncate(_comps.size() - 1);
 	};
 	void pop(std::string &last) {
-		last = _data.back();
-		_data.pop_back();
+		last = back();
+		pop();
 	};
 	void clear() {
-		_data.clear();
+		_data.truncate(0);
+		_comps.truncate(0);
+		init_root();
 	};
 
 	Cpath& operator=(const Cpath& p) {
 		_data = p._data;
+		_escaped = p._escaped;
+		_comps = p._comps;
 		return *this;
 	};
 
@@ -87,45 +180,46 @@ public:
 	};
 
 	bool operator==(const Cpath& rhs) const {
-		return (_data == rhs._data);
+		/* components are separator terminated so the buffers match
+		 * exactly when the component lists do.
+		 */
+		return (_comps.size() == rhs._comps.size()
+			&& _data.size() == rhs._data.size()
+			&& memcmp(_data.data(), rhs._data.data(), _data.size()) == 0);
 	};
 
 	const char *operator[](size_t idx) const {
-		return _data[idx].c_str();
+		return _data.data() + _comps[idx].data_off;
 	};
 
 	size_t size() const {
-		return _data.size();
+		return _comps.size();
 	};
 
 	const char *back() const {
-		return (size() > 0 ? _data.back().c_str() : NULL);
+		return (size() > 0 ? (*this)[size() - 1] : NULL);
 	};
 
 	std::string to_string() const {
-		std::string out;
-		for (size_t i = 0; i < size(); i++) {
-			if (i > 0) {
-				out += " ";
-			}
-			out += url_escape((*this)[i]);
+		std::string out(_escaped.data() + 1, _escaped.size() - 2);
+		for (size_t i = 0; i < out.length(); i++) {
+			if (out[i] == '/')
+				out[i] = ' ';
 		}
 		return out;
 	};
 
+	/* The escaped path, valid until the next modification */
+	const char *to_path_cstr() const {
+		return _escaped.data();
+	};
+
 	std::string to_path_string() const {
-		std::string out = "/";
-		for (size_t i = 0; i < size(); i++) {
-			if (i > 0) {
-				out += "/";
-			}
-			out += url_escape((*this)[i]);
-		}
-		return out;
+		return std::string(_escaped.data(), _escaped.size() - 1);
 	};
 
-	bool at_root() {
-		return _data.size() == 0;
+	bool at_root() const {
+		return _comps.size() == 0;
 	};
 
 private:
@@ -135,21 +229,76 @@ private:
 		static const size_t static_buf_len = 256;
 	};
 
-	std::vector<std::string> _data;
-	std::string url_escape(const char* s) const {
-		char *out = (char *)malloc(strlen(s) * URI_MULT);
-		uriEscapeA(s, out, URI_FALSE, URI_TRUE);
-		std::string outs = std::string(out);
-		free(out);
-		return outs;
-	}
-	std::string url_unescape(std::string s) const {
-		char *out = strdup(s.c_str());
-		uriUnescapeInPlaceA(out);
-		std::string outs = std::string(out);
-		free(out);
-		return outs;
-	}
+	struct Comp {
+		size_t data_off; /* start of the component in _data */
+		size_t esc_off;  /* start of its "/" in _escaped */
+	};
+
+	/* raw components, each followed by CpathParams::separator */
+	CpathBuf<char, CpathParams::static_buf_len> _data;
+	/* "/"-joined URL escaped path, including its terminating NUL */
+	CpathBuf<char, CpathParams::static_buf_len> _escaped;
+	CpathBuf<Comp, CpathParams::static_num_elems> _comps;
+
+	void init_root() {
+		_escaped.assign("/", 2);
+	};
+
+	/* Split on '/' after skipping any leading blanks and slashes,
+	 * unescaping each component. Empty components are kept.
+	 */
+	void parse(const char *s, size_t len) {
+		size_t start = 0;
+		while (start < len
+		       && (s[start] == ' ' || s[start] == '\t' || s[start] == '/'))
+			start++;
+		if (start == len)
+			start = 0;
+		for (;;) {
+			const char *p = s + start;
+			const char *slash = static_cast<const char *>(
+				memchr(p, '/', len - start));
+			if (!slash) {
+				push_unescape(p, len - start);
+				return;
+			}
+			push_unescape(p, slash - p);
+			start = slash - s + 1;
+		}
+	};
+
+	void push(const char *comp, size_t len) {
+		Comp c = { _data.size(), _escaped.size() - 1 };
+		_data.append(comp, len);
+		_data.push_back(CpathParams::separator);
+		_comps.push_back(c);
+		append_escaped(c);
+	};
+
+	void push_unescape(const char *comp, size_t len) {
+		Comp c = { _data.size(), _escaped.size() - 1 };
+		_data.append(comp, len);
+		_data.push_back(CpathParams::separator);
+		/* unescaping only ever shrinks, so do it in place */
+		char *start = _data.data() + c.data_off;
+		const char *end = uriUnescapeInPlaceA(start);
+		_data.truncate(end - _data.data() + 1);
+		_comps.push_back(c);
+		append_escaped(c);
+	};
+
+	void append_escaped(const Comp &c) {
+		const char *comp = _data.data() + c.data_off;
+		size_t len = _data.size() - c.data_off - 1;
+		_escaped.truncate(c.esc_off);
+		if (_comps.size() > 1)
+			_escaped.push_back('/');
+		/* escape straight into the tail of the buffer */
+		size_t elen = configd_path_escape_len(comp, len);
+		char *end = configd_path_escape(_escaped.extend(elen + 1),
+						comp, len);
+		*end = '\0';
+	};
 };
 
 #endif
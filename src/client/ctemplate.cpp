@@ -18,6 +18,7 @@
 #include "connect.h"
 #include "ctemplate.hpp"
 #include "node.h"
+#include "probes.h"
 #include "rpc.h"
 #include "template.h"
 
@@ -62,6 +63,7 @@ Ctemplate::~Ctemplate()
 bool Ctemplate::get()
 {
 	_def = configd_tmpl_get(_cstore, _path.c_str(), NULL);
+	CFG_PROBE(libvyatta_config, tmpl_get, _path.c_str(), (int)(_def != NULL));
 	if (!_def)
 		return NULL;
 
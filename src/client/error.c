@@ -444,6 +444,62 @@ int error_set_from_mgmt_error_list(
 	return retval;
 }
 
+// Append the errors in <from> to those in <into>, for the batched requests
+// that report all of their failures together.  The texts are kept one after
+// the other and the mgmt_errors are moved into a single list, leaving <from>
+// with none.  Return 0 (success) / -1 (fail)
+int error_merge(struct configd_error *into, struct configd_error *from)
+{
+	struct configd_mgmt_error **me_list;
+	int num;
+
+	if (into == NULL || from == NULL) {
+		return -1;
+	}
+
+	if (from->text != NULL) {
+		if (into->text == NULL) {
+			into->text = from->text;
+		} else {
+			// mgmt_error texts need not end with a newline
+			size_t have = strlen(into->text);
+			const char *sep =
+				(have && into->text[have - 1] != '\n') ? "\n" : "";
+			int len = have + strlen(sep) + strlen(from->text) + 1;
+			char *text = malloc(len);
+			if (text == NULL) {
+				return -1;
+			}
+			snprintf(text, len, "%s%s%s", into->text, sep, from->text);
+			free(into->text);
+			free(from->text);
+			into->text = text;
+		}
+		from->text = NULL;
+	}
+
+	num = into->mgmt_errs.num_entries + from->mgmt_errs.num_entries;
+	if (from->mgmt_errs.num_entries > 0) {
+		me_list = realloc(into->mgmt_errs.me_list,
+				  num * sizeof(*me_list));
+		if (me_list == NULL) {
+			return -1;
+		}
+		memcpy(me_list + into->mgmt_errs.num_entries,
+		       from->mgmt_errs.me_list,
+		       from->mgmt_errs.num_entries * sizeof(*me_list));
+		into->mgmt_errs.me_list = me_list;
+		into->mgmt_errs.num_entries = num;
+		free(from->mgmt_errs.me_list);
+		from->mgmt_errs.me_list = NULL;
+		from->mgmt_errs.num_entries = 0;
+	}
+	if (from->is_mgmt_error) {
+		into->is_mgmt_error = 1;
+	}
+	return 0;
+}
+
 // This allows CppUTest to track memory allocation, and thus to check for
 // memory leaks.  Standard strdup doesn't have the null check on 's' but it
 // doesn't hurt.
@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Optional binary framing. Once configd has advertised FRAME_FEATURE and
+ * accepted a SetFraming request, every later message in either direction
+ * is a 4 byte big endian length followed by that many bytes of CBOR
+ * (RFC 8949). Only the part of CBOR that maps onto JSON is used: integers,
+ * doubles, text strings, arrays, maps with text keys, true, false and
+ * null, all of definite length.
+ *
+ * Neither side has any escaping to do, strings are copied rather than
+ * scanned, and the reader knows how much to read before it starts
+ * decoding instead of finding the end of the message as it parses.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vyatta-util/map.h>
+
+#include "connect.h"
+#include "internal.h"
+
+#define FRAME_ENV "VYATTA_CONFIG_CBOR"
+#define FRAME_FEATURE "cbor-framing"
+#define FRAME_CBOR "cbor"
+#define FRAME_HDR_LEN 4
+#define FRAME_MAX_DEPTH 2048	/* as jansson's parser */
+
+enum {
+	CBOR_UINT = 0,
+	CBOR_NEGINT = 1,
+	CBOR_BYTES = 2,
+	CBOR_TEXT = 3,
+	CBOR_ARRAY = 4,
+	CBOR_MAP = 5,
+	CBOR_TAG = 6,
+	CBOR_SIMPLE = 7,
+};
+
+enum {
+	CBOR_FALSE = 20,
+	CBOR_TRUE = 21,
+	CBOR_NULL = 22,
+	CBOR_FLOAT = 26,
+	CBOR_DOUBLE = 27,
+};
+
+/*
+ * Connections using the framing, kept on the side as struct configd_conn
+ * is allocated by callers.
+ */
+struct frame_conn {
+	struct frame_conn *next;
+	const struct configd_conn *conn;
+};
+
+static struct frame_conn *frame_list;
+static int frame_count;
+static pthread_mutex_t frame_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct frame_conn *frame_find(const struct configd_conn *conn)
+{
+	struct frame_conn *fc;
+
+	for (fc = frame_list; fc; fc = fc->next) {
+		if (fc->conn == conn)
+			return fc;
+	}
+	return NULL;
+}
+
+int frame_enabled(const struct configd_conn *conn)
+{
+	int found;
+
+	if (__atomic_load_n(&frame_count, __ATOMIC_RELAXED) == 0)
+		return 0;
+
+	pthread_mutex_lock(&frame_lock);
+	found = frame_find(conn) != NULL;
+	pthread_mutex_unlock(&frame_lock);
+	return found;
+}
+
+int configd_conn_cbor_enable(struct configd_conn *conn)
+{
+	struct request req = { .fn = "GetFeatures" };
+	struct frame_conn *fc;
+	struct map *features;
+	int supported;
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (frame_enabled(conn))
+		return 1;
+
+	req.args = json_pack("[]");
+	if (!req.args)
+		return -1;
+	features = get_map(conn, &req, NULL);
+	if (!features)
+		return -1;
+	supported = map_get(features, FRAME_FEATURE) != NULL;
+	map_free(features);
+	if (!supported)
+		return 0;
+
+	fc = calloc(1, sizeof(*fc));
+	if (!fc)
+		return -1;
+	fc->conn = conn;
+
+	/* The reply to this is the last message in JSON */
+	req.fn = "SetFraming";
+	req.args = json_pack("[s]", FRAME_CBOR);
+	if (!req.args || get_int(conn, &req, NULL) != 1) {
+		free(fc);
+		return -1;
+	}
+
+	pthread_mutex_lock(&frame_lock);
+	fc->next = frame_list;
+	frame_list = fc;
+	__atomic_add_fetch(&frame_count, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&frame_lock);
+	return 1;
+}
+
+void frame_open(struct configd_conn *conn)
+{
+	const char *env = getenv(FRAME_ENV);
+
+	/* Without support in configd this stays with JSON */
+	if (env && *env)
+		configd_conn_cbor_enable(conn);
+}
+
+void frame_close(struct configd_conn *conn)
+{
+	struct frame_conn **pfc, *fc;
+
+	if (__atomic_load_n(&frame_count, __ATOMIC_RELAXED) == 0)
+		return;
+
+	pthread_mutex_lock(&frame_lock);
+	for (pfc = &frame_list; *pfc; pfc = &(*pfc)->next) {
+		if ((*pfc)->conn == conn)
+			break;
+	}
+	fc = *pfc;
+	if (fc) {
+		*pfc = fc->next;
+		__atomic_sub_fetch(&frame_count, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&frame_lock);
+	free(fc);
+}
+
+struct frame_buf {
+	char *data;
+	size_t len;
+	size_t alloc;
+};
+
+static int fb_reserve(struct frame_buf *fb, size_t n)
+{
+	size_t alloc = fb->alloc ? fb->alloc : 256;
+	char *data;
+
+	if (fb->len + n <= fb->alloc)
+		return 0;
+	while (alloc < fb->len + n)
+		alloc *= 2;
+	data = realloc(fb->data, alloc);
+	if (!data)
+		return -1;
+	fb->data = data;
+	fb->alloc = alloc;
+	return 0;
+}
+
+static int fb_bytes(struct frame_buf *fb, const void *p, size_t len)
+{
+	if (fb_reserve(fb, len) < 0)
+		return -1;
+	memcpy(fb->data + fb->len, p, len);
+	fb->len += len;
+	return 0;
+}
+
+/* The initial byte of an item and its argument, in the shortest form */
+static int fb_head(struct frame_buf *fb, unsigned int major, uint64_t val)
+{
+	unsigned char head[9];
+	int i, n;
+
+	if (val < 24) {
+		head[0] = major << 5 | val;
+		return fb_bytes(fb, head, 1);
+	}
+	if (val <= UINT8_MAX) {
+		head[0] = major << 5 | 24;
+		n = 1;
+	} else if (val <= UINT16_MAX) {
+		head[0] = major << 5 | 25;
+		n = 2;
+	} else if (val <= UINT32_MAX) {
+		head[0] = major << 5 | 26;
+		n = 4;
+	} else {
+		head[0] = major << 5 | 27;
+		n = 8;
+	}
+	for (i = 0; i < n; i++)
+		head[n - i] = val >> (8 * i);
+	return fb_bytes(fb, head, n + 1);
+}
+
+static int fb_item(struct frame_buf *fb, const json_t *jval)
+{
+	const char *key;
+	json_int_t ival;
+	json_t *jelem;
+	uint64_t bits;
+	double real;
+	size_t i;
+
+	switch (json_typeof(jval)) {
+	case JSON_OBJECT:
+		if (fb_head(fb, CBOR_MAP, json_object_size(jval)) < 0)
+			return -1;
+		json_object_foreach((json_t *)jval, key, jelem) {
+			if (fb_head(fb, CBOR_TEXT, strlen(key)) < 0
+			    || fb_bytes(fb, key, strlen(key)) < 0
+			    || fb_item(fb, jelem) < 0)
+				return -1;
+		}
+		return 0;
+	case JSON_ARRAY:
+		if (fb_head(fb, CBOR_ARRAY, json_array_size(jval)) < 0)
+			return -1;
+		json_array_foreach(jval, i, jelem) {
+			if (fb_item(fb, jelem) < 0)
+				return -1;
+		}
+		return 0;
+	case JSON_STRING:
+		if (fb_head(fb, CBOR_TEXT, json_string_length(jval)) < 0)
+			return -1;
+		return fb_bytes(fb, json_string_value(jval),
+				json_string_length(jval));
+	case JSON_INTEGER:
+		ival = json_integer_value(jval);
+		if (ival >= 0)
+			return fb_head(fb, CBOR_UINT, ival);
+		return fb_head(fb, CBOR_NEGINT, -(ival + 1));
+	case JSON_REAL:
+		/* always as a double, which is all jansson holds */
+		real = json_real_value(jval);
+		memcpy(&bits, &real, sizeof(bits));
+		if (fb_bytes(fb, "\xfb", 1) < 0)
+			return -1;
+		for (i = 0; i < 8; i++) {
+			unsigned char c = bits >> (56 - 8 * i);
+
+			if (fb_bytes(fb, &c, 1) < 0)
+				return -1;
+		}
+		return 0;
+	case JSON_TRUE:
+		return fb_head(fb, CBOR_SIMPLE, CBOR_TRUE);
+	case JSON_FALSE:
+		return fb_head(fb, CBOR_SIMPLE, CBOR_FALSE);
+	case JSON_NULL:
+		return fb_head(fb, CBOR_SIMPLE, CBOR_NULL);
+	}
+	return -1;
+}
+
+char *frame_dumps(const json_t *jval, size_t *len)
+{
+	struct frame_buf fb = { NULL, FRAME_HDR_LEN, 0 };
+	size_t body;
+	int i;
+
+	if (fb_reserve(&fb, 0) < 0 || fb_item(&fb, jval) < 0)
+		goto error;
+
+	body = fb.len - FRAME_HDR_LEN;
+	if (body > UINT32_MAX)
+		goto error;
+	for (i = 0; i < FRAME_HDR_LEN; i++)
+		fb.data[i] = body >> (8 * (FRAME_HDR_LEN - 1 - i));
+	*len = fb.len;
+	return fb.data;
+
+error:
+	free(fb.data);
+	return NULL;
+}
+
+struct frame_in {
+	const unsigned char *p;
+	const unsigned char *end;
+};
+
+static int fi_head(struct frame_in *in, unsigned int *major,
+		   unsigned int *info, uint64_t *val)
+{
+	size_t n;
+
+	if (in->p == in->end)
+		return -1;
+	*major = *in->p >> 5;
+	*info = *in->p++ & 0x1f;
+	if (*info < 24) {
+		*val = *info;
+		return 0;
+	}
+	/* reserved values, and indefinite lengths which aren't used */
+	if (*info > 27)
+		return -1;
+
+	n = 1 << (*info - 24);
+	if ((size_t)(in->end - in->p) < n)
+		return -1;
+	for (*val = 0; n; n--)
+		*val = *val << 8 | *in->p++;
+	return 0;
+}
+
+static json_t *fi_real(unsigned int info, uint64_t bits)
+{
+	uint32_t fbits;
+	double real;
+	float freal;
+
+	if (info == CBOR_DOUBLE) {
+		memcpy(&real, &bits, sizeof(real));
+		return json_real(real);
+	}
+	fbits = bits;
+	memcpy(&freal, &fbits, sizeof(freal));
+	return json_real(freal);
+}
+
+static json_t *fi_item(struct frame_in *in, int depth);
+
+static json_t *fi_map(struct frame_in *in, uint64_t count, int depth)
+{
+	json_t *jobj, *jval;
+	unsigned int major, info;
+	uint64_t len;
+	char kbuf[64], *key;
+
+	jobj = json_object();
+	if (!jobj)
+		return NULL;
+
+	while (count--) {
+		if (fi_head(in, &major, &info, &len) < 0 || major != CBOR_TEXT
+		    || len > (size_t)(in->end - in->p)
+		    || memchr(in->p, '\0', len))
+			goto error;
+		key = len < sizeof(kbuf) ? kbuf : malloc(len + 1);
+		if (!key)
+			goto error;
+		memcpy(key, in->p, len);
+		key[len] = '\0';
+		in->p += len;
+
+		jval = fi_item(in, depth);
+		if (!jval || json_object_set_new(jobj, key, jval) < 0) {
+			if (key != kbuf)
+				free(key);
+			goto error;
+		}
+		if (key != kbuf)
+			free(key);
+	}
+	return jobj;
+
+error:
+	json_decref(jobj);
+	return NULL;
+}
+
+static json_t *fi_item(struct frame_in *in, int depth)
+{
+	unsigned int major, info;
+	json_t *jval, *jelem;
+	uint64_t val;
+
+	if (depth > FRAME_MAX_DEPTH || fi_head(in, &major, &info, &val) < 0)
+		return NULL;
+
+	switch (major) {
+	case CBOR_UINT:
+		if (val > INT64_MAX)
+			return NULL;
+		return json_integer(val);
+	case CBOR_NEGINT:
+		if (val > INT64_MAX)
+			return NULL;
+		return json_integer(-(json_int_t)val - 1);
+	case CBOR_TEXT:
+		if (val > (size_t)(in->end - in->p))
+			return NULL;
+		/* checks the text is valid UTF-8 */
+		jval = json_stringn((const char *)in->p, val);
+		in->p += val;
+		return jval;
+	case CBOR_ARRAY:
+		/* every element takes at least a byte */
+		if (val > (size_t)(in->end - in->p))
+			return NULL;
+		jval = json_array();
+		while (jval && val--) {
+			jelem = fi_item(in, depth + 1);
+			if (!jelem || json_array_append_new(jval, jelem) < 0) {
+				json_decref(jval);
+				return NULL;
+			}
+		}
+		return jval;
+	case CBOR_MAP:
+		if (val > (size_t)(in->end - in->p) / 2)
+			return NULL;
+		return fi_map(in, val, depth + 1);
+	case CBOR_SIMPLE:
+		switch (info) {
+		case CBOR_FALSE:
+			return json_false();
+		case CBOR_TRUE:
+			return json_true();
+		case CBOR_NULL:
+			return json_null();
+		case CBOR_FLOAT:
+		case CBOR_DOUBLE:
+			return fi_real(info, val);
+		}
+		return NULL;
+	}
+	/* byte strings and tags have no JSON equivalent */
+	return NULL;
+}
+
+json_t *frame_loads(const char *buf, size_t len)
+{
+	struct frame_in in = {
+		(const unsigned char *)buf, (const unsigned char *)buf + len
+	};
+	json_t *jval;
+
+	jval = fi_item(&in, 0);
+	if (jval && in.p != in.end) {
+		json_decref(jval);
+		return NULL;
+	}
+	return jval;
+}
+
+/* Decodes the message at the start of buf. Returns the number of bytes
+ * it took up, 0 if buf does not hold all of it yet, or -1 if it is
+ * malformed.
+ */
+ssize_t frame_next(const char *buf, size_t len, json_t **jval)
+{
+	size_t body;
+	int i;
+
+	if (len < FRAME_HDR_LEN)
+		return 0;
+	for (body = 0, i = 0; i < FRAME_HDR_LEN; i++)
+		body = body << 8 | (unsigned char)buf[i];
+	if (len - FRAME_HDR_LEN < body)
+		return 0;
+
+	*jval = frame_loads(buf + FRAME_HDR_LEN, body);
+	return *jval ? (ssize_t)(FRAME_HDR_LEN + body) : -1;
+}
+
+static json_t *frame_fail(json_error_t *error, const char *text)
+{
+	snprintf(error->text, sizeof(error->text), "%s", text);
+	return NULL;
+}
+
+json_t *frame_loadf(FILE *fp, json_error_t *error)
+{
+	unsigned char hdr[FRAME_HDR_LEN];
+	json_t *jval;
+	size_t len;
+	char *buf;
+	int i;
+
+	error->position = 0;
+	error->text[0] = '\0';
+	if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr))
+		return frame_fail(error, "end of file");
+	for (len = 0, i = 0; i < FRAME_HDR_LEN; i++)
+		len = len << 8 | hdr[i];
+
+	buf = malloc(len ? len : 1);
+	if (!buf)
+		return frame_fail(error, "out of memory");
+	if (fread(buf, 1, len, fp) != len) {
+		free(buf);
+		return frame_fail(error, "truncated frame");
+	}
+	error->position = FRAME_HDR_LEN + len;
+
+	jval = frame_loads(buf, len);
+	free(buf);
+	if (!jval)
+		return frame_fail(error, "malformed frame");
+	return jval;
+}
@@ -11,6 +11,8 @@
 #define CONFIGD_INTERNAL_H_
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <sys/types.h>
 #include <jansson.h>
 
 #include "error.h"
@@ -27,6 +29,7 @@ struct vector;
 typedef struct request {
 	const char *fn;
 	json_t	*args;
+	unsigned int id;	/* set by send_request */
 } Request;
 
 struct response {
@@ -49,15 +52,74 @@ int error_set_from_mgmt_error_list(
 	struct configd_mgmt_err_list *mgmt_errs,
 	const char *function);
 int error_vsetf(struct configd_error *error, const char *msg, va_list ap);
+int error_merge(struct configd_error *into, struct configd_error *from);
 
 void response_free(struct response *);
-int send_request(struct configd_conn *, const struct request *);
+char *encode_request(struct configd_conn *, struct request *, int *fds, int *nfds, size_t *len);
+int send_request(struct configd_conn *, struct request *);
+int parse_reply(json_t *jresp, unsigned int id, struct response *);
 int recv_response(struct configd_conn *, struct response *);
+unsigned int response_id(const json_t *jresp);
 /* Helpers to get specific response types */
 char *get_str(struct configd_conn *, struct request *, struct configd_error *);
+int get_str_to_fd(struct configd_conn *, struct request *, int, struct configd_error *);
+/* A string result parsed as JSON, as it is read */
+json_t *get_json(struct configd_conn *, struct request *, struct configd_error *);
+/* TreeGet or TreeGetFull in a JSON encoding, for CfgClient::TreeGetParsed */
+json_t *tree_get_json(struct configd_conn *, int db, const char *path, const char *encoding, const char *fn, unsigned int flags, struct configd_error *);
+/* As tree_get_json with each of n flags, in one round trip, for ConfigSnapshot */
+int tree_get_json_many(struct configd_conn *, int db, const char *path, const char *encoding, const char *fn, const unsigned int *flags, size_t n, json_t **out, struct configd_error *);
 int get_int(struct configd_conn *, struct request *, struct configd_error *);
 struct vector *get_vector(struct configd_conn *, struct request *, struct configd_error *);
 struct map *get_map(struct configd_conn *, struct request *, struct configd_error *);
+/*
+ * Requests sent ahead of their responses by get_pipelined. Enough to hide
+ * the round trips, few enough that configd's responses to them fit in
+ * the socket buffers, so that it is never blocked writing while this side
+ * is blocked writing to it.
+ */
+#define PIPELINE_DEPTH 64
+/* Requests whose responses are read as later ones are sent, see connect.c */
+int get_pipelined(struct configd_conn *, struct request *, size_t n, char **errors, struct configd_error *);
+/* As get_pipelined, leaving the responses for the caller */
+int get_responses(struct configd_conn *, struct request *, size_t n, struct response *, struct configd_error *);
+/* As get_responses, each a string result parsed as JSON */
+int get_json_responses(struct configd_conn *, struct request *, size_t n, json_t **out, struct configd_error *);
+
+/* Per connection request statistics, see stats.c */
+void stats_open(struct configd_conn *);
+void stats_close(struct configd_conn *);
+void stats_request_sent(struct configd_conn *, const char *fn, unsigned int id, size_t len);
+void stats_response_received(struct configd_conn *, unsigned int id, size_t len);
+
+/* Optional transport for large bodies, see memfd.c */
+#define MEMFD_THRESHOLD (64 * 1024)
+#define MEMFD_MAX_FDS 8
+int memfd_prepare_request(struct configd_conn *, json_t *jreq, int *fds);
+ssize_t memfd_recv(struct configd_conn *, char *buf, size_t size);
+ssize_t memfd_send(int sock, const char *buf, size_t len, const int *fds, int nfds);
+void memfd_close(const int *fds, int nfds);
+int memfd_take_result(struct configd_conn *, json_t *jresp, const char **body, size_t *len);
+void memfd_release(const char *body, size_t len);
+
+/* Optional length prefixed CBOR framing, see frame.c */
+void frame_open(struct configd_conn *);
+void frame_close(struct configd_conn *);
+int frame_enabled(const struct configd_conn *);
+char *frame_dumps(const json_t *, size_t *len);
+json_t *frame_loads(const char *buf, size_t len);
+json_t *frame_loadf(FILE *, json_error_t *);
+ssize_t frame_next(const char *buf, size_t len, json_t **);
+
+/* Connections shared between threads, see mux.c */
+int mux_enabled(const struct configd_conn *);
+void mux_close(struct configd_conn *);
+ssize_t mux_send(struct configd_conn *, const char *buf, size_t len, const int *fds, int nfds);
+json_t *mux_await(struct configd_conn *, unsigned int id, json_t *(*read)(struct configd_conn *));
+
+/* Non-blocking requests, see async.c */
+int async_enabled(const struct configd_conn *);
+void async_close(struct configd_conn *);
 
 // 'local' versions of these allow CppUTest to track memory allocation and
 // thus check for memory leaks in the unit tests.
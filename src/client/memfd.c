@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Optional transport for large bodies. Once configd has advertised the
+ * MEMFD_FEATURE and the client has asked for it, string parameters and
+ * string results of MEMFD_THRESHOLD bytes or more travel in a sealed
+ * memfd passed with SCM_RIGHTS alongside the JSON message, rather than
+ * being escaped into it. In the JSON such a parameter is replaced by its
+ * length, and such a result comes back as a null "result" with its
+ * length in a "memfd" member:
+ *
+ *   -> {"method":"EditConfigXML","params":["1",...,1048576],"id":7,
+ *       "memfd":{"accept":65536,"params":[5]}}	+ fd
+ *   <- {"result":null,"memfd":4194304,"id":7}		+ fd
+ *
+ * "accept" is the smallest result the client wants to be sent this way
+ * and "params" lists the parameters that were, their descriptors being
+ * attached in the same order. A memfd must be sealed against shrinking
+ * and writing so that the receiver can map it safely.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE	/* memfd_create, F_ADD_SEALS */
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vyatta-util/map.h>
+
+#include "connect.h"
+#include "internal.h"
+#include "log.h"
+
+#define MEMFD_FEATURE "memfd-transport"
+#define MEMFD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+
+/*
+ * State for each connection with the transport enabled, on the side as
+ * struct configd_conn is allocated by callers. The stream created by
+ * memfd_stream_open owns it. Other connections keep the plain stream
+ * configd_open_connection gave them.
+ */
+struct memfd_conn {
+	struct memfd_conn *next;
+	const struct configd_conn *conn;
+	int fd;
+	int nfds;
+	int fds[MEMFD_MAX_FDS];	/* received and not yet claimed */
+};
+
+static struct memfd_conn *memfd_list;
+static int memfd_count;		/* connections in memfd_list */
+static pthread_mutex_t memfd_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct memfd_conn *memfd_find(const struct configd_conn *conn)
+{
+	struct memfd_conn *mc;
+
+	for (mc = memfd_list; mc; mc = mc->next) {
+		if (mc->conn == conn)
+			return mc;
+	}
+	return NULL;
+}
+
+static int memfd_enabled(void)
+{
+	return __atomic_load_n(&memfd_count, __ATOMIC_RELAXED) != 0;
+}
+
+/* Reads the connection, keeping any descriptors that come with the data */
+static ssize_t memfd_stream_read(void *cookie, char *buf, size_t size)
+{
+	struct memfd_conn *mc = cookie;
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * MEMFD_MAX_FDS)];
+		struct cmsghdr align;
+	} ctl;
+	struct iovec iov = { .iov_base = buf, .iov_len = size };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctl.buf,
+		.msg_controllen = sizeof(ctl.buf),
+	};
+	struct cmsghdr *cmsg;
+	ssize_t n;
+	int i, nfds, *fds;
+
+	do
+		n = recvmsg(mc->fd, &msg, MSG_CMSG_CLOEXEC);
+	while (n < 0 && errno == EINTR);
+	if (n <= 0)
+		return n;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET
+		    || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		fds = (int *)CMSG_DATA(cmsg);
+		nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		pthread_mutex_lock(&memfd_lock);
+		for (i = 0; i < nfds; i++) {
+			if (mc->nfds < MEMFD_MAX_FDS)
+				mc->fds[mc->nfds++] = fds[i];
+			else
+				close(fds[i]);
+		}
+		pthread_mutex_unlock(&memfd_lock);
+	}
+	return n;
+}
+
+/* As a read from the connection's stream, but without its buffering */
+ssize_t memfd_recv(struct configd_conn *conn, char *buf, size_t size)
+{
+	struct memfd_conn *mc = NULL;
+	ssize_t n;
+
+	if (memfd_enabled()) {
+		pthread_mutex_lock(&memfd_lock);
+		mc = memfd_find(conn);
+		pthread_mutex_unlock(&memfd_lock);
+	}
+	if (mc)
+		return memfd_stream_read(mc, buf, size);
+
+	do
+		n = read(conn->fd, buf, size);
+	while (n < 0 && errno == EINTR);
+	return n;
+}
+
+static int memfd_stream_close(void *cookie)
+{
+	struct memfd_conn **pmc, *mc = cookie;
+	int i;
+
+	pthread_mutex_lock(&memfd_lock);
+	for (pmc = &memfd_list; *pmc; pmc = &(*pmc)->next) {
+		if (*pmc == mc) {
+			*pmc = mc->next;
+			break;
+		}
+	}
+	__atomic_sub_fetch(&memfd_count, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&memfd_lock);
+
+	for (i = 0; i < mc->nfds; i++)
+		close(mc->fds[i]);
+	i = close(mc->fd);
+	free(mc);
+	return i;
+}
+
+/* A stream reading fd for conn that keeps the descriptors received */
+static FILE *memfd_stream_open(struct configd_conn *conn, int fd)
+{
+	cookie_io_functions_t io = {
+		.read = memfd_stream_read,
+		.close = memfd_stream_close,
+	};
+	struct memfd_conn *mc;
+	FILE *fp;
+
+	mc = calloc(1, sizeof(*mc));
+	if (!mc)
+		return NULL;
+	mc->conn = conn;
+	mc->fd = fd;
+
+	fp = fopencookie(mc, "r", io);
+	if (!fp) {
+		free(mc);
+		return NULL;
+	}
+	pthread_mutex_lock(&memfd_lock);
+	mc->next = memfd_list;
+	memfd_list = mc;
+	__atomic_add_fetch(&memfd_count, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&memfd_lock);
+	return fp;
+}
+
+int configd_conn_memfd_enable(struct configd_conn *conn)
+{
+	struct request req = { .fn = "GetFeatures" };
+	struct memfd_conn *mc;
+	struct map *features;
+	int supported, fd;
+	FILE *fp;
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	req.args = json_pack("[]");
+	if (!req.args)
+		return -1;
+	features = get_map(conn, &req, NULL);
+	if (!features)
+		return -1;
+	supported = map_get(features, MEMFD_FEATURE) != NULL;
+	map_free(features);
+	if (!supported)
+		return 0;
+
+	pthread_mutex_lock(&memfd_lock);
+	mc = memfd_find(conn);
+	pthread_mutex_unlock(&memfd_lock);
+	if (mc)
+		return 1;
+
+	/*
+	 * Descriptors come with the data, so switch to a stream that reads
+	 * with recvmsg. Closing the plain stream closes its descriptor, so
+	 * the new one reads a copy.
+	 */
+	fd = fcntl(conn->fd, F_DUPFD_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	fp = memfd_stream_open(conn, fd);
+	if (!fp) {
+		close(fd);
+		return -1;
+	}
+	fclose(conn->fp);
+	conn->fp = fp;
+	conn->fd = fd;
+	return 1;
+}
+
+static int memfd_from(const char *buf, size_t len)
+{
+	void *map;
+	int fd;
+
+	fd = memfd_create("configd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, len) < 0)
+		goto error;
+	map = mmap(NULL, len, PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto error;
+	memcpy(map, buf, len);
+	munmap(map, len);
+	if (fcntl(fd, F_ADD_SEALS, MEMFD_SEALS) < 0)
+		goto error;
+	return fd;
+
+error:
+	close(fd);
+	return -1;
+}
+
+int memfd_prepare_request(struct configd_conn *conn, json_t *jreq, int *fds)
+{
+	json_t *params, *jval, *jidx;
+	struct memfd_conn *mc;
+	int nfds = 0;
+	size_t i, len;
+
+	if (!memfd_enabled())
+		return 0;
+	pthread_mutex_lock(&memfd_lock);
+	mc = memfd_find(conn);
+	pthread_mutex_unlock(&memfd_lock);
+	if (!mc)
+		return 0;
+
+	jidx = json_array();
+	if (!jidx)
+		return -1;
+	params = json_object_get(jreq, "params");
+	json_array_foreach(params, i, jval) {
+		if (!json_is_string(jval) || nfds == MEMFD_MAX_FDS)
+			continue;
+		len = json_string_length(jval);
+		if (len < MEMFD_THRESHOLD)
+			continue;
+		fds[nfds] = memfd_from(json_string_value(jval), len);
+		if (fds[nfds] < 0)
+			goto error;
+		nfds++;
+		json_array_append_new(jidx, json_integer(i));
+		json_array_set_new(params, i, json_integer(len));
+	}
+	json_object_set_new(jreq, "memfd", json_pack("{s:i, s:o}",
+						     "accept", MEMFD_THRESHOLD,
+						     "params", jidx));
+	return nfds;
+
+error:
+	json_decref(jidx);
+	memfd_close(fds, nfds);
+	return -1;
+}
+
+ssize_t memfd_send(int sock, const char *buf, size_t len,
+		   const int *fds, int nfds)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * MEMFD_MAX_FDS)];
+		struct cmsghdr align;
+	} ctl;
+	struct iovec iov = { .iov_base = (void *)buf, .iov_len = len };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctl.buf,
+		.msg_controllen = CMSG_SPACE(sizeof(int) * nfds),
+	};
+	struct cmsghdr *cmsg;
+	ssize_t n, sent;
+
+	memset(&ctl, 0, sizeof(ctl));
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+
+	do
+		sent = sendmsg(sock, &msg, 0);
+	while (sent < 0 && errno == EINTR);
+	if (sent < 0)
+		return -1;
+
+	/* the descriptors have gone with the first part */
+	while ((size_t)sent < len) {
+		n = write(sock, buf + sent, len - sent);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		sent += n;
+	}
+	return sent;
+}
+
+void memfd_close(const int *fds, int nfds)
+{
+	int i;
+
+	for (i = 0; i < nfds; i++)
+		close(fds[i]);
+}
+
+int memfd_take_result(struct configd_conn *conn, json_t *jresp,
+		      const char **body, size_t *len)
+{
+	json_t *jlen = json_object_get(jresp, "memfd");
+	struct memfd_conn *mc;
+	struct stat st;
+	int fd = -1, seals;
+	void *map;
+
+	if (!json_is_integer(jlen))
+		return 0;
+
+	pthread_mutex_lock(&memfd_lock);
+	mc = memfd_find(conn);
+	if (mc && mc->nfds) {
+		fd = mc->fds[0];
+		memmove(mc->fds, mc->fds + 1, --mc->nfds * sizeof(int));
+	}
+	pthread_mutex_unlock(&memfd_lock);
+	if (fd < 0) {
+		msg_err("configd memfd response without a descriptor\n");
+		return -1;
+	}
+
+	seals = fcntl(fd, F_GET_SEALS);
+	if (json_integer_value(jlen) < 0 || seals < 0
+	    || (seals & (F_SEAL_SHRINK | F_SEAL_WRITE))
+			!= (F_SEAL_SHRINK | F_SEAL_WRITE)
+	    || fstat(fd, &st) < 0
+	    || st.st_size < json_integer_value(jlen)) {
+		msg_err("configd memfd response is not sealed or too short\n");
+		close(fd);
+		return -1;
+	}
+
+	*len = json_integer_value(jlen);
+	*body = "";
+	if (*len) {
+		map = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			close(fd);
+			return -1;
+		}
+		*body = map;
+	}
+	close(fd);
+	return 1;
+}
+
+void memfd_release(const char *body, size_t len)
+{
+	if (len)
+		munmap((void *)body, len);
+}
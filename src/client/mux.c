@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Sharing one connection between threads. Requests are written whole
+ * under a lock, each with its own id. There is no reader thread: a caller
+ * waiting for a response reads from the connection itself if no other
+ * thread is doing so, and keeps any responses that are not its own for
+ * the threads they belong to. A caller only waits for another thread
+ * while that thread is reading, and is woken as soon as its response has
+ * been read.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "connect.h"
+#include "internal.h"
+#include "log.h"
+
+struct mux_reply {
+	struct mux_reply *next;
+	unsigned int id;
+	json_t *jresp;
+};
+
+/* Kept on the side as struct configd_conn is allocated by callers */
+struct mux_conn {
+	struct mux_conn *next;
+	const struct configd_conn *conn;
+	pthread_mutex_t send_lock;
+	pthread_mutex_t lock;		/* protects the members below */
+	pthread_cond_t cond;
+	int reading;			/* a thread is reading responses */
+	int error;			/* errno once reading has failed */
+	struct mux_reply *replies;	/* read for other threads */
+};
+
+static struct mux_conn *mux_list;
+static int mux_count;
+static pthread_mutex_t mux_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct mux_conn *mux_find(const struct configd_conn *conn)
+{
+	struct mux_conn *mc;
+
+	if (__atomic_load_n(&mux_count, __ATOMIC_RELAXED) == 0)
+		return NULL;
+
+	pthread_mutex_lock(&mux_lock);
+	for (mc = mux_list; mc; mc = mc->next) {
+		if (mc->conn == conn)
+			break;
+	}
+	pthread_mutex_unlock(&mux_lock);
+	return mc;
+}
+
+int mux_enabled(const struct configd_conn *conn)
+{
+	return mux_find(conn) != NULL;
+}
+
+int configd_conn_mux_enable(struct configd_conn *conn)
+{
+	struct mux_conn *mc;
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (mux_enabled(conn))
+		return 0;
+
+	mc = calloc(1, sizeof(*mc));
+	if (!mc)
+		return -1;
+	mc->conn = conn;
+	pthread_mutex_init(&mc->send_lock, NULL);
+	pthread_mutex_init(&mc->lock, NULL);
+	pthread_cond_init(&mc->cond, NULL);
+
+	pthread_mutex_lock(&mux_lock);
+	mc->next = mux_list;
+	mux_list = mc;
+	__atomic_add_fetch(&mux_count, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&mux_lock);
+	return 0;
+}
+
+void mux_close(struct configd_conn *conn)
+{
+	struct mux_conn **pmc, *mc;
+	struct mux_reply *mr;
+
+	if (__atomic_load_n(&mux_count, __ATOMIC_RELAXED) == 0)
+		return;
+
+	pthread_mutex_lock(&mux_lock);
+	for (pmc = &mux_list; *pmc; pmc = &(*pmc)->next) {
+		if ((*pmc)->conn == conn)
+			break;
+	}
+	mc = *pmc;
+	if (mc) {
+		*pmc = mc->next;
+		__atomic_sub_fetch(&mux_count, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&mux_lock);
+
+	if (!mc)
+		return;
+	while ((mr = mc->replies)) {
+		mc->replies = mr->next;
+		json_decref(mr->jresp);
+		free(mr);
+	}
+	pthread_cond_destroy(&mc->cond);
+	pthread_mutex_destroy(&mc->lock);
+	pthread_mutex_destroy(&mc->send_lock);
+	free(mc);
+}
+
+ssize_t mux_send(struct configd_conn *conn, const char *buf, size_t len,
+		 const int *fds, int nfds)
+{
+	struct mux_conn *mc = mux_find(conn);
+	ssize_t n, sent = 0;
+
+	if (!mc) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Requests must not be interleaved, so a short write is finished
+	 * here rather than left to the caller.
+	 */
+	pthread_mutex_lock(&mc->send_lock);
+	if (nfds)
+		sent = memfd_send(conn->fd, buf, len, fds, nfds);
+	while (sent >= 0 && (size_t)sent < len) {
+		n = write(conn->fd, buf + sent, len - sent);
+		if (n < 0 && errno == EINTR)
+			continue;
+		sent = n < 0 ? n : sent + n;
+	}
+	pthread_mutex_unlock(&mc->send_lock);
+	return sent;
+}
+
+static json_t *mux_take(struct mux_conn *mc, unsigned int id)
+{
+	struct mux_reply **pmr, *mr;
+	json_t *jresp;
+
+	for (pmr = &mc->replies; *pmr; pmr = &(*pmr)->next) {
+		mr = *pmr;
+		if (mr->id == id) {
+			*pmr = mr->next;
+			jresp = mr->jresp;
+			free(mr);
+			return jresp;
+		}
+	}
+	return NULL;
+}
+
+json_t *mux_await(struct configd_conn *conn, unsigned int id,
+		  json_t *(*read)(struct configd_conn *))
+{
+	struct mux_conn *mc = mux_find(conn);
+	struct mux_reply *mr;
+	json_t *jresp, *jid;
+
+	if (!mc) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pthread_mutex_lock(&mc->lock);
+	while (!(jresp = mux_take(mc, id)) && !mc->error && mc->reading)
+		pthread_cond_wait(&mc->cond, &mc->lock);
+	if (jresp || mc->error) {
+		errno = mc->error;
+		pthread_mutex_unlock(&mc->lock);
+		return jresp;
+	}
+
+	mc->reading = 1;
+	for (;;) {
+		pthread_mutex_unlock(&mc->lock);
+		errno = 0;
+		jresp = read(conn);
+		pthread_mutex_lock(&mc->lock);
+
+		/* Nobody can rely on the connection after either of these */
+		if (!jresp) {
+			mc->error = errno ? errno : EIO;
+			break;
+		}
+		jid = json_object_get(jresp, "id");
+		if (!json_is_integer(jid)) {
+			msg_err("configd response id must be an integer\n");
+			mc->error = EPROTO;
+			json_decref(jresp);
+			jresp = NULL;
+			break;
+		}
+		if (json_integer_value(jid) == id)
+			break;
+
+		mr = malloc(sizeof(*mr));
+		if (!mr) {
+			mc->error = ENOMEM;
+			json_decref(jresp);
+			jresp = NULL;
+			break;
+		}
+		mr->id = json_integer_value(jid);
+		mr->jresp = jresp;
+		mr->next = mc->replies;
+		mc->replies = mr;
+		pthread_cond_broadcast(&mc->cond);
+	}
+	mc->reading = 0;
+	pthread_cond_broadcast(&mc->cond);
+	if (!jresp)
+		errno = mc->error;
+	pthread_mutex_unlock(&mc->lock);
+	return jresp;
+}
@@ -7,6 +7,9 @@
  * SPDX-License-Identifier: LGPL-2.1-only
 */
 
+#include <errno.h>
+#include <vyatta-util/vector.h>
+
 #include "completion_env.h"
 #include "connect.h"
 #include "error.h"
@@ -57,6 +60,53 @@ struct vector *configd_node_get(struct configd_conn *conn, int db, const char *c
 	return result;
 }
 
+int configd_node_get_many(struct configd_conn *conn, int db, const char **cpaths, size_t n, struct vector **out, struct configd_error *error)
+{
+	struct request reqs[PIPELINE_DEPTH];
+	struct response resps[PIPELINE_DEPTH];
+	size_t done, chunk, i;
+
+	if (!conn || (n && (!cpaths || !out))) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	error_init(error, __func__);
+	for (i = 0; i < n; i++)
+		out[i] = NULL;
+
+	for (done = 0; done < n; done += chunk) {
+		chunk = n - done < PIPELINE_DEPTH ? n - done : PIPELINE_DEPTH;
+		for (i = 0; i < chunk; i++) {
+			reqs[i].fn = "Get";
+			reqs[i].args = json_pack("[iss]", db, conn->session_id,
+						 cpaths[done + i]);
+			if (!reqs[i].args) {
+				while (i > 0)
+					json_decref(reqs[--i].args);
+				goto error;
+			}
+		}
+		if (get_responses(conn, reqs, chunk, resps, error) < 0)
+			goto error;
+		for (i = 0; i < chunk; i++) {
+			if (resps[i].type == VECTOR) {
+				out[done + i] = resps[i].result.v;
+				resps[i].type = INT;
+			}
+			response_free(&resps[i]);
+		}
+	}
+	return 0;
+
+error:
+	for (i = 0; i < done; i++) {
+		vector_free(out[i]);
+		out[i] = NULL;
+	}
+	return -1;
+}
+
 int configd_node_get_status(struct configd_conn *conn, int db, const char *cpath, struct configd_error *error)
 {
 	int result;
@@ -99,15 +149,21 @@ char *configd_node_get_comment(struct configd_conn *conn, int db, const char *cp
 	return result;
 }
 
+static int tree_get_request(struct configd_conn *conn, int db, const char *path, const char *encoding, const char *getFn, unsigned int flags, struct request *req)
+{
+	req->fn = getFn;
+	req->args = json_pack("[isss{sbsb}]", db, conn->session_id, path, encoding,
+			     "Defaults", !!(flags & CONFIGD_TREEGET_DEFAULTS),
+			     "Secrets", !!(flags & CONFIGD_TREEGET_SECRETS));
+	return req->args ? 0 : -1;
+}
+
 static char *configd_tree_get_fn_encoding(struct configd_conn *conn, int db, const char *path, const char *encoding, const char *getFn, unsigned int flags, struct configd_error *error)
 {
 	char *result;
-	struct request req = { .fn = getFn };
+	struct request req;
 
-	req.args = json_pack("[isss{sbsb}]", db, conn->session_id, path, encoding,
-			     "Defaults", !!(flags & CONFIGD_TREEGET_DEFAULTS),
-			     "Secrets", !!(flags & CONFIGD_TREEGET_SECRETS));
-	if (!req.args)
+	if (tree_get_request(conn, db, path, encoding, getFn, flags, &req) < 0)
 		return NULL;
 
 	error_init(error, __func__);
@@ -115,6 +171,17 @@ static char *configd_tree_get_fn_encoding(struct configd_conn *conn, int db, con
 	return result;
 }
 
+static int configd_tree_get_fn_encoding_to_fd(struct configd_conn *conn, int db, const char *path, const char *encoding, const char *getFn, unsigned int flags, int fd, struct configd_error *error)
+{
+	struct request req;
+
+	if (tree_get_request(conn, db, path, encoding, getFn, flags, &req) < 0)
+		return -1;
+
+	error_init(error, __func__);
+	return get_str_to_fd(conn, &req, fd, error);
+}
+
 char *configd_tree_get_encoding_flags(struct configd_conn *conn, int db, const char *path, const char *encoding, unsigned int flags, struct configd_error *error)
 {
 	return configd_tree_get_fn_encoding(conn, db, path, encoding, "TreeGet",
@@ -169,6 +236,56 @@ char *configd_tree_get_full_internal(struct configd_conn *conn, int db, const ch
 	return configd_tree_get_full_encoding(conn, db, path, "internal", error);
 }
 
+int configd_tree_get_encoding_flags_to_fd(struct configd_conn *conn, int db, const char *path, const char *encoding, unsigned int flags, int fd, struct configd_error *error)
+{
+	return configd_tree_get_fn_encoding_to_fd(conn, db, path, encoding, "TreeGet",
+						  flags & CONFIGD_TREEGET_ALL, fd, error);
+}
+
+int configd_tree_get_to_fd(struct configd_conn *conn, int db, const char *path, int fd, struct configd_error *error)
+{
+	return configd_tree_get_encoding_flags_to_fd(conn, db, path, "json",
+						     CONFIGD_TREEGET_ALL, fd, error);
+}
+
+int configd_tree_get_full_encoding_flags_to_fd(struct configd_conn *conn, int db, const char *path, const char *encoding, unsigned int flags, int fd, struct configd_error *error)
+{
+	return configd_tree_get_fn_encoding_to_fd(conn, db, path, encoding, "TreeGetFull",
+						  flags & CONFIGD_TREEGET_ALL, fd, error);
+}
+
+json_t *tree_get_json(struct configd_conn *conn, int db, const char *path, const char *encoding, const char *getFn, unsigned int flags, struct configd_error *error)
+{
+	struct request req;
+
+	if (tree_get_request(conn, db, path, encoding, getFn, flags & CONFIGD_TREEGET_ALL, &req) < 0)
+		return NULL;
+
+	error_init(error, __func__);
+	return get_json(conn, &req, error);
+}
+
+int tree_get_json_many(struct configd_conn *conn, int db, const char *path, const char *encoding, const char *getFn, const unsigned int *flags, size_t n, json_t **out, struct configd_error *error)
+{
+	struct request reqs[PIPELINE_DEPTH];
+	size_t i;
+
+	if (n > PIPELINE_DEPTH) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		if (tree_get_request(conn, db, path, encoding, getFn, flags[i] & CONFIGD_TREEGET_ALL, &reqs[i]) < 0) {
+			while (i > 0)
+				json_decref(reqs[--i].args);
+			return -1;
+		}
+	}
+
+	error_init(error, __func__);
+	return get_json_responses(conn, reqs, n, out, error);
+}
+
 char *configd_node_get_complete_env(struct configd_conn *conn, const char *cpath, struct configd_error *error)
 {
 	if (!conn || !cpath)
@@ -11,6 +11,8 @@
 #ifndef CONFIGD_NODE_H_
 #define CONFIGD_NODE_H_
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -47,6 +49,16 @@ int configd_node_is_default(struct configd_conn *, int DB, const char *path, str
  */
 struct vector *configd_node_get(struct configd_conn *, int DB, const char *path, struct configd_error *);
 
+/**
+ * configd_node_get_many is configd_node_get for each of n '/' separated
+ * paths, sending the requests in batches so that it takes a round trip per
+ * batch rather than one per path. out must have room for n pointers, each
+ * of which is set to the vector for its path, or to NULL if the path has
+ * no value there. Returns 0, or -1 with every out[i] NULL and the error
+ * struct, if non NULL, filled out if the connection failed.
+ */
+int configd_node_get_many(struct configd_conn *, int DB, const char **paths, size_t n, struct vector **out, struct configd_error *);
+
 /**
  * configd_node_get_status takes a '/' separated path and a database. It returns
  * the whether the node was 'added', 'deleted', 'changed', or 'unchanged' in
@@ -157,6 +169,29 @@ char *configd_tree_get_full_xml(struct configd_conn *, int, const char *, struct
  */
 char *configd_tree_get_full_internal(struct configd_conn *, int, const char *, struct configd_error *);
 
+/**
+ * configd_tree_get_encoding_flags_to_fd is configd_tree_get_encoding_flags
+ * writing the encoded (sub)tree to the file descriptor as it is received,
+ * rather than returning it, so that large trees are never held in memory.
+ * The return values are 0:ok, -1:error. Output may already have been
+ * written when an error is returned. On error if the error struct pointer
+ * is non NULL the error will be filled out.
+ */
+int configd_tree_get_encoding_flags_to_fd(struct configd_conn *conn, int db, const char *path, const char *encoding, unsigned int flags, int fd, struct configd_error *error);
+
+/**
+ * configd_tree_get_to_fd is configd_tree_get writing the JSON encoded
+ * (sub)tree to the file descriptor, as configd_tree_get_encoding_flags_to_fd.
+ */
+int configd_tree_get_to_fd(struct configd_conn *, int, const char *, int, struct configd_error *);
+
+/**
+ * configd_tree_get_full_encoding_flags_to_fd is
+ * configd_tree_get_full_encoding_flags writing the encoded (sub)tree to the
+ * file descriptor, as configd_tree_get_encoding_flags_to_fd.
+ */
+int configd_tree_get_full_encoding_flags_to_fd(struct configd_conn *conn, int db, const char *path, const char *encoding, unsigned int flags, int fd, struct configd_error *error);
+
 /**
  * configd_node_get_complete_env returns environement variables used by the completion
  * scripts. The return values are 0:false, 1:true, -1:error. On error if the error struct
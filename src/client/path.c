@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+*/
+
+#include <string.h>
+
+#include "path.h"
+
+/*
+ * Paths are escaped on every client call, so rather than have uriEscapeA
+ * write into a worst case (6x) scratch buffer which then gets copied, the
+ * output size is computed up front and components are written straight
+ * into their final location. Runs of characters that need no escaping,
+ * which is almost all of any real path, are copied as a block.
+ */
+
+static const char hex[] = "0123456789ABCDEF";
+static const char crlf[] = "%0D%0A";
+
+static int is_unreserved(unsigned char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+		|| (c >= '0' && c <= '9')
+		|| c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+size_t configd_path_escape_len(const char *comp, size_t len)
+{
+	size_t out = len;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		unsigned char c = comp[i];
+
+		if (is_unreserved(c))
+			continue;
+		if (c == '\r') {
+			/* "\r" and "\r\n" both become "%0D%0A" */
+			out += 5;
+			if (i + 1 < len && comp[i + 1] == '\n') {
+				out--;
+				i++;
+			}
+		} else if (c == '\n') {
+			out += 5;
+		} else {
+			out += 2;
+		}
+	}
+	return out;
+}
+
+char *configd_path_escape(char *out, const char *comp, size_t len)
+{
+	size_t i = 0;
+
+	while (i < len) {
+		size_t run = i;
+		unsigned char c;
+
+		while (run < len && is_unreserved(comp[run]))
+			run++;
+		if (run > i) {
+			memcpy(out, comp + i, run - i);
+			out += run - i;
+			i = run;
+			if (i == len)
+				break;
+		}
+
+		c = comp[i++];
+		if (c == '\r' || c == '\n') {
+			memcpy(out, crlf, sizeof(crlf) - 1);
+			out += sizeof(crlf) - 1;
+			if (c == '\r' && i < len && comp[i] == '\n')
+				i++;
+		} else {
+			*out++ = '%';
+			*out++ = hex[c >> 4];
+			*out++ = hex[c & 0xf];
+		}
+	}
+	return out;
+}
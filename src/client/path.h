@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+*/
+
+#ifndef CONFIGD_PATH_H_
+#define CONFIGD_PATH_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * configd_path_escape_len returns the number of bytes that len bytes of
+ * comp occupy once URL escaped for use as a configd path component. No
+ * terminator is included. The encoding is the one produced by uriparser's
+ * uriEscapeA with line breaks normalised, so "/" within a component becomes
+ * "%2F".
+ */
+size_t configd_path_escape_len(const char *comp, size_t len);
+
+/**
+ * configd_path_escape writes the URL escaped form of len bytes of comp to
+ * out, which must have room for configd_path_escape_len() bytes. The output
+ * is not NUL terminated. Returns a pointer just past the last byte written.
+ */
+char *configd_path_escape(char *out, const char *comp, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,6 +23,15 @@
 //string2vec is internal to the C++ code
 %ignore string2vec;
 
+//Parsed trees are for C++ and Python, perl has tree_get_hash
+%ignore CfgTree;
+%ignore CfgClient::TreeGetParsed;
+%ignore CfgClient::TreeGetFullParsed;
+
+//Not yet mapped from perl arrays of paths
+%ignore CfgClient::SetMany;
+%ignore CfgClient::DeleteMany;
+
 %typemap(throws) CfgClientFatalException %{
 	std::string str = $1.what();
 	std::replace(str.begin(), str.end(), '\n', ' ');
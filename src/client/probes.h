@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Static tracepoints for bpftrace, perf and systemtap, e.g.
+ *
+ *   bpftrace -e 'usdt:/usr/lib/libvyatta-config.so.2:request_send
+ *       { @[str(arg0)] = count(); }'
+ *
+ * A probe is a single nop until something attaches to it. Without
+ * <sys/sdt.h> at build time they compile away entirely.
+ */
+
+#ifndef CONFIGD_PROBES_H_
+#define CONFIGD_PROBES_H_
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define CFG_PROBE(provider, name, ...) \
+	STAP_PROBEV(provider, name, __VA_ARGS__)
+#else
+#define CFG_PROBE(provider, name, ...) do { } while (0)
+#endif
+
+#endif
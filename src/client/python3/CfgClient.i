@@ -6,13 +6,20 @@
  *
  * SPDX-License-Identifier: LGPL-2.1-only
  */
-%module configd
+/*
+ * The wrappers release the GIL while calling into CfgClient, so other
+ * Python threads carry on while a call waits on configd. Arguments and
+ * results are converted with the GIL held, and it is taken back if the
+ * call throws.
+ */
+%module(threads="1") configd
 
 %rename("%(undercase)s", notregexmatch$name="CfgClient*") "";
 %rename("%s", regexmatch$name="^[A-Z_]+$") ""; //don't rename constants
 %rename("Client") CfgClient;
 %rename("FatalException") CfgClientFatalException;
 %rename("Exception") CfgClientException;
+%rename("_AsyncConn") CfgClientAsync;
 
 %feature("autodoc", "2");
 %typemap(doc) std::vector<std::string> const & path "$1_name: Space separated string or Sequence of strings representing the configuration path";
@@ -20,40 +27,27 @@
 %ignore string2vec;
 
 %typemap(in) std::vector<std::string> & (std::vector<std::string> vec) {
-	if (!PySequence_Check($input)) {
-		PyErr_SetString(PyExc_ValueError,"Expected a sequence");
+	if (!pypath_to_vec($input, vec))
+		return NULL;
+	$1 = &vec;
+}
+
+//A sequence of paths, each as accepted for a single path
+%typemap(in) std::vector<std::vector<std::string> > & (std::vector<std::vector<std::string> > vecs) {
+	if (!PySequence_Check($input) || PyUnicode_Check($input)) {
+		PyErr_SetString(PyExc_ValueError,"Expected a sequence of paths");
 		return NULL;
 	}
-	if (PyUnicode_Check($input)) {
-		PyObject *str_obj = PyUnicode_AsUTF8String($input);
-		std::string str = PyBytes_AsString(str_obj);
-		Py_DECREF(str_obj);
-		string2vec(str, vec);
-		$1 = &vec;
-	} else {
-		int len = PySequence_Length($input);
-		for (int i = 0; i < len; i++) {
-			PyObject *o = PySequence_GetItem($input, i);
-			if (PyUnicode_Check(o)) {
-				PyObject *str_obj = PyUnicode_AsUTF8String(o);
-				std::string str = PyBytes_AsString(str_obj);
-				Py_DECREF(str_obj);
-				vec.push_back(str);
-			} else {
-				o = PyObject_Str(o);
-				if (o != NULL && PyUnicode_Check(o)) {
-					PyObject *str_obj = PyUnicode_AsUTF8String(o);
-					std::string str = PyBytes_AsString(str_obj);
-					Py_DECREF(str_obj);
-					vec.push_back(str);
-				} else {
-					PyErr_SetString(PyExc_ValueError, "Cannot convert value to string in the argument list");
-					return NULL;
-				}
-			}
-		}
+	int len = PySequence_Length($input);
+	vecs.resize(len);
+	for (int i = 0; i < len; i++) {
+		PyObject *o = PySequence_GetItem($input, i);
+		bool ok = o != NULL && pypath_to_vec(o, vecs[i]);
+		Py_XDECREF(o);
+		if (!ok)
+			return NULL;
 	}
-	$1 = &vec;
+	$1 = &vecs;
 }
 
 %typemap(out) std::vector<std::string> {
@@ -96,12 +90,113 @@
 %{
 #define SWIG_FILE_WITH_INIT
 #include "../CfgClient.hpp"
+
+static bool pypath_to_vec(PyObject *input, std::vector<std::string> &vec)
+{
+	if (!PySequence_Check(input)) {
+		PyErr_SetString(PyExc_ValueError,"Expected a sequence");
+		return false;
+	}
+	if (PyUnicode_Check(input)) {
+		PyObject *str_obj = PyUnicode_AsUTF8String(input);
+		std::string str = PyBytes_AsString(str_obj);
+		Py_DECREF(str_obj);
+		string2vec(str, vec);
+		return true;
+	}
+	int len = PySequence_Length(input);
+	for (int i = 0; i < len; i++) {
+		PyObject *o = PySequence_GetItem(input, i);
+		if (PyUnicode_Check(o)) {
+			PyObject *str_obj = PyUnicode_AsUTF8String(o);
+			std::string str = PyBytes_AsString(str_obj);
+			Py_DECREF(str_obj);
+			vec.push_back(str);
+		} else {
+			o = PyObject_Str(o);
+			if (o != NULL && PyUnicode_Check(o)) {
+				PyObject *str_obj = PyUnicode_AsUTF8String(o);
+				std::string str = PyBytes_AsString(str_obj);
+				Py_DECREF(str_obj);
+				vec.push_back(str);
+			} else {
+				PyErr_SetString(PyExc_ValueError, "Cannot convert value to string in the argument list");
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static PyObject *cfgtree_to_python(const CfgTree &tree)
+{
+	PyObject *out = NULL;
+
+	switch (tree.GetType()) {
+	case CfgTree::BOOLEAN:
+		return PyBool_FromLong(tree.GetBool());
+	case CfgTree::INTEGER:
+		return PyLong_FromLongLong(tree.GetInt());
+	case CfgTree::REAL:
+		return PyFloat_FromDouble(tree.GetReal());
+	case CfgTree::STRING:
+		return PyUnicode_FromStringAndSize(tree.GetCString(),
+						   tree.GetStringLength());
+	case CfgTree::ARRAY:
+		out = PyList_New(tree.Size());
+		for (size_t i = 0; out && i < tree.Size(); i++) {
+			PyObject *val = cfgtree_to_python(tree.At(i));
+			if (val == NULL) {
+				Py_CLEAR(out);
+				break;
+			}
+			PyList_SET_ITEM(out, i, val);
+		}
+		return out;
+	case CfgTree::OBJECT: {
+		std::vector<std::string> names = tree.Names();
+		out = PyDict_New();
+		for (size_t i = 0; out && i < names.size(); i++) {
+			PyObject *val = cfgtree_to_python(tree.Get(names[i]));
+			if (val == NULL ||
+			    PyDict_SetItemString(out, names[i].c_str(), val) < 0)
+				Py_CLEAR(out);
+			Py_XDECREF(val);
+		}
+		return out;
+	}
+	default:
+		Py_RETURN_NONE;
+	}
+}
 %}
 
+//Parsed trees are returned as dicts and lists, as from json.loads
+%typemap(out) CfgTree {
+	$result = cfgtree_to_python($1);
+	if ($result == NULL)
+		SWIG_fail;
+}
+%ignore CfgTree;
+
 %include "std_string.i";
 
+/*
+ * Without the GIL nothing stops two threads using one Client at once, so
+ * Client() shares its connection between threads, as one Client used by
+ * several threads was safe while calls held the GIL. Client(False) makes
+ * the unshared connection of CfgClient().
+ */
+%ignore CfgClient::CfgClient;
+
 %include "../CfgClient.hpp"
 
+%extend CfgClient {
+	CfgClient(bool shared = true) throw(CfgClientFatalException) {
+		return new CfgClient(shared);
+	}
+}
+
 %extend CfgClientException {
 	std::string __repr__() {
 		return $self->what();
@@ -126,14 +221,10 @@
 	    return self.node_get(database, path)
 
 	def tree_get_dict(self, path, database=AUTO, encoding="json"):
-	    import json
-	    res = self.tree_get_encoding(database, path, encoding)
-	    return json.loads(res)
+	    return self.tree_get_parsed(database, path, encoding)
 
 	def tree_get_full_dict(self, path, database=AUTO, encoding="json"):
-	    import json
-	    res = self.tree_get_full_encoding(database, path, encoding)
-	    return json.loads(res)
+	    return self.tree_get_full_parsed(database, path, encoding)
 
 	def call_rpc_dict(self, ns, name, input):
 	    import json
@@ -142,3 +233,132 @@
 	    return json.loads(output)
 }
 }
+
+%pythoncode %{
+class AsyncClient(object):
+    """AsyncClient makes configd requests from an asyncio event loop.
+
+    Any number of requests may be outstanding on its one connection, each
+    call being a coroutine that completes when configd answers it. The
+    connection is watched by the loop rather than by a thread per call.
+    Failed requests raise Exception, as with Client, and FatalException
+    is raised for everything outstanding if the connection is lost.
+    """
+
+    AUTO = Client.AUTO
+    RUNNING = Client.RUNNING
+    CANDIDATE = Client.CANDIDATE
+
+    def __init__(self, session_id=None, loop=None):
+        import asyncio
+        self._loop = loop or asyncio.get_event_loop()
+        self._conn = _AsyncConn()
+        if session_id is not None:
+            self._conn.set_session_id(session_id)
+        self._fd = self._conn.fd()
+        self._waiting = {}
+        self._writing = False
+        self._loop.add_reader(self._fd, self._readable)
+
+    async def __aenter__(self):
+        return self
+
+    async def __aexit__(self, *exc):
+        self.close()
+
+    def close(self):
+        if self._conn is not None:
+            self._fail(FatalException("configd connection closed"))
+            self._conn = None
+
+    def _fail(self, exc):
+        self._loop.remove_reader(self._fd)
+        if self._writing:
+            self._loop.remove_writer(self._fd)
+            self._writing = False
+        waiting, self._waiting = self._waiting, {}
+        for fut in waiting.values():
+            if not fut.done():
+                fut.set_exception(exc)
+
+    def _writable(self):
+        try:
+            pending = self._conn.flush()
+        except FatalException as exc:
+            self._fail(exc)
+            return
+        if pending and not self._writing:
+            self._loop.add_writer(self._fd, self._writable)
+        elif self._writing and not pending:
+            self._loop.remove_writer(self._fd)
+        self._writing = pending
+
+    def _readable(self):
+        try:
+            self._conn.read()
+        except FatalException as exc:
+            self._deliver()
+            self._fail(exc)
+            return
+        self._deliver()
+
+    def _deliver(self):
+        while True:
+            request_id = self._conn.next_result()
+            if not request_id:
+                break
+            fut = self._waiting.pop(request_id, None)
+            if fut is None or fut.done():
+                continue
+            try:
+                fut.set_result(self._conn.result())
+            except Exception as exc:
+                fut.set_exception(exc)
+
+    def _start(self, request_id):
+        fut = self._loop.create_future()
+        self._waiting[request_id] = fut
+        if not self._writing:
+            self._writable()
+        return fut
+
+    def _check(self):
+        if self._conn is None:
+            raise FatalException("configd connection closed")
+
+    async def tree_get(self, database, path, encoding="json"):
+        self._check()
+        return await self._start(
+            self._conn.tree_get(database, path, encoding))
+
+    async def tree_get_dict(self, path, database=AUTO, encoding="json"):
+        import json
+        return json.loads(await self.tree_get(database, path, encoding))
+
+    async def node_get(self, database, path):
+        import json
+        self._check()
+        return json.loads(await self._start(
+            self._conn.node_get(database, path)))
+
+    async def set(self, path):
+        self._check()
+        return await self._start(self._conn.set(path))
+
+    async def delete(self, path):
+        self._check()
+        await self._start(self._conn.delete(path))
+        return ""
+
+    async def commit(self, comment=""):
+        self._check()
+        return await self._start(self._conn.commit(comment))
+
+    async def call_rpc(self, ns, name, input):
+        self._check()
+        return await self._start(self._conn.call_rpc(ns, name, input))
+
+    async def call_rpc_dict(self, ns, name, input):
+        import json
+        return json.loads(await self.call_rpc(ns, name, json.dumps(input)))
+%}
@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE	/* program_invocation_short_name */
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "connect.h"
+#include "internal.h"
+
+#define STATS_ENV "VYATTA_CONFIG_STATS"
+
+/*
+ * A request awaiting its response, in the slot for its id. Requests are
+ * pipelined no deeper than this, so a slot is seldom reused before its
+ * response has arrived.
+ */
+#define STATS_PENDING PIPELINE_DEPTH
+
+struct stats_pending {
+	unsigned int id;
+	int method;		/* index into the methods, or -1 */
+	size_t sent;
+	struct timespec start;
+};
+
+/*
+ * struct configd_conn is allocated by callers, so the statistics are kept
+ * in a list on the side rather than in the connection itself. There is
+ * seldom more than one entry, and when nothing has stats enabled the hooks
+ * below return before taking the lock.
+ */
+struct conn_stats {
+	struct conn_stats *next;
+	const struct configd_conn *conn;
+	struct configd_conn_stats pub;
+	size_t alloc;
+	int dump_on_close;
+	struct stats_pending pending[STATS_PENDING];
+	FILE *trace;
+};
+
+static void stats_forget_pending(struct conn_stats *cs)
+{
+	size_t i;
+
+	for (i = 0; i < STATS_PENDING; i++)
+		cs->pending[i].method = -1;
+}
+
+static struct conn_stats *stats_list;
+static int stats_count;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct conn_stats *stats_find(const struct configd_conn *conn)
+{
+	struct conn_stats *cs;
+
+	for (cs = stats_list; cs; cs = cs->next) {
+		if (cs->conn == conn)
+			return cs;
+	}
+	return NULL;
+}
+
+static int stats_enabled(void)
+{
+	return __atomic_load_n(&stats_count, __ATOMIC_RELAXED) != 0;
+}
+
+static struct configd_method_stats *
+stats_method(struct conn_stats *cs, const char *fn)
+{
+	struct configd_method_stats *ms;
+	size_t i, len;
+
+	for (i = 0; i < cs->pub.num_methods; i++) {
+		if (strcmp(cs->pub.methods[i].method, fn) == 0)
+			return &cs->pub.methods[i];
+	}
+
+	if (cs->pub.num_methods == cs->alloc) {
+		size_t alloc = cs->alloc ? cs->alloc * 2 : 16;
+
+		ms = realloc(cs->pub.methods, alloc * sizeof(*ms));
+		if (!ms)
+			return NULL;
+		cs->pub.methods = ms;
+		cs->alloc = alloc;
+	}
+	ms = &cs->pub.methods[cs->pub.num_methods];
+	memset(ms, 0, sizeof(*ms));
+	len = strlen(fn) + 1;
+	ms->method = malloc(len);
+	if (!ms->method)
+		return NULL;
+	memcpy(ms->method, fn, len);
+	cs->pub.num_methods++;
+	return ms;
+}
+
+static unsigned int stats_bucket(unsigned long long us)
+{
+	unsigned int b = 0;
+
+	while (us && b < CONFIGD_STATS_BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	return b;
+}
+
+static void stats_free(struct conn_stats *cs)
+{
+	size_t i;
+
+	for (i = 0; i < cs->pub.num_methods; i++)
+		free(cs->pub.methods[i].method);
+	free(cs->pub.methods);
+	free(cs);
+}
+
+int configd_conn_stats_enable(struct configd_conn *conn)
+{
+	struct conn_stats *cs;
+
+	if (!conn) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	pthread_mutex_lock(&stats_lock);
+	if (stats_find(conn)) {
+		pthread_mutex_unlock(&stats_lock);
+		return 0;
+	}
+	cs = calloc(1, sizeof(*cs));
+	if (!cs) {
+		pthread_mutex_unlock(&stats_lock);
+		return -1;
+	}
+	cs->conn = conn;
+	stats_forget_pending(cs);
+	cs->next = stats_list;
+	stats_list = cs;
+	__atomic_add_fetch(&stats_count, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&stats_lock);
+	return 0;
+}
+
+const struct configd_conn_stats *configd_conn_stats(struct configd_conn *conn)
+{
+	struct conn_stats *cs;
+
+	if (!stats_enabled())
+		return NULL;
+
+	pthread_mutex_lock(&stats_lock);
+	cs = stats_find(conn);
+	pthread_mutex_unlock(&stats_lock);
+	return cs ? &cs->pub : NULL;
+}
+
+int configd_conn_stats_trace(struct configd_conn *conn, FILE *fp)
+{
+	struct conn_stats *cs;
+
+	pthread_mutex_lock(&stats_lock);
+	cs = stats_find(conn);
+	if (cs)
+		cs->trace = fp;
+	pthread_mutex_unlock(&stats_lock);
+	if (!cs) {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+/* Upper bound of the bucket holding the given fraction of calls */
+static unsigned long long stats_percentile(const struct configd_method_stats *ms,
+					   double frac)
+{
+	unsigned long need = ms->calls * frac, seen = 0;
+	unsigned int b;
+
+	for (b = 0; b < CONFIGD_STATS_BUCKETS - 1; b++) {
+		seen += ms->hist[b];
+		if (seen > need)
+			break;
+	}
+	return 1ULL << b;
+}
+
+static int stats_cmp_total(const void *a, const void *b)
+{
+	const struct configd_method_stats *ma = a, *mb = b;
+
+	if (ma->total_us != mb->total_us)
+		return ma->total_us < mb->total_us ? 1 : -1;
+	return strcmp(ma->method, mb->method);
+}
+
+static void stats_write(struct conn_stats *cs, FILE *fp)
+{
+	const struct configd_method_stats *ms;
+	unsigned long calls = 0;
+	size_t i;
+
+	/* Sorting moves the methods the pending requests refer to */
+	stats_forget_pending(cs);
+	qsort(cs->pub.methods, cs->pub.num_methods, sizeof(*cs->pub.methods),
+	      stats_cmp_total);
+
+	for (i = 0; i < cs->pub.num_methods; i++)
+		calls += cs->pub.methods[i].calls;
+	fprintf(fp, "configd stats: %s pid %d session %s, %lu requests\n",
+		program_invocation_short_name, (int)getpid(),
+		cs->conn->session_id && *cs->conn->session_id
+			? cs->conn->session_id : "-", calls);
+	fprintf(fp, "%-24s %8s %10s %10s %10s %8s %8s %8s %8s\n",
+		"method", "calls", "sent B", "recv B", "total ms",
+		"mean us", "p50 us", "p99 us", "max us");
+	for (i = 0; i < cs->pub.num_methods; i++) {
+		ms = &cs->pub.methods[i];
+		if (!ms->calls)
+			continue;
+		fprintf(fp, "%-24s %8lu %10llu %10llu %10.1f %8llu %8llu %8llu %8llu\n",
+			ms->method, ms->calls, ms->bytes_sent,
+			ms->bytes_received, ms->total_us / 1000.0,
+			ms->total_us / ms->calls,
+			stats_percentile(ms, 0.5), stats_percentile(ms, 0.99),
+			ms->max_us);
+	}
+}
+
+void configd_conn_stats_dump(struct configd_conn *conn, FILE *fp)
+{
+	struct conn_stats *cs;
+
+	if (!stats_enabled())
+		return;
+
+	pthread_mutex_lock(&stats_lock);
+	cs = stats_find(conn);
+	if (cs)
+		stats_write(cs, fp);
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/* Several processes may share the one file, so write each table out in
+ * a single append.
+ */
+static void stats_dump_env(struct conn_stats *cs)
+{
+	const char *dest = getenv(STATS_ENV);
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *mfp, *fp;
+
+	if (!dest || dest[0] != '/') {
+		stats_write(cs, stderr);
+		return;
+	}
+
+	mfp = open_memstream(&buf, &len);
+	if (!mfp)
+		return;
+	stats_write(cs, mfp);
+	fclose(mfp);
+
+	fp = fopen(dest, "ae");
+	if (fp) {
+		fwrite(buf, 1, len, fp);
+		fclose(fp);
+	}
+	free(buf);
+}
+
+void stats_open(struct configd_conn *conn)
+{
+	const char *env = getenv(STATS_ENV);
+	struct conn_stats *cs;
+
+	if (!env || !*env || configd_conn_stats_enable(conn) < 0)
+		return;
+
+	pthread_mutex_lock(&stats_lock);
+	cs = stats_find(conn);
+	if (cs)
+		cs->dump_on_close = 1;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+void stats_close(struct configd_conn *conn)
+{
+	struct conn_stats **pcs, *cs;
+
+	if (!stats_enabled())
+		return;
+
+	pthread_mutex_lock(&stats_lock);
+	for (pcs = &stats_list; *pcs; pcs = &(*pcs)->next) {
+		if ((*pcs)->conn == conn)
+			break;
+	}
+	cs = *pcs;
+	if (cs) {
+		*pcs = cs->next;
+		__atomic_sub_fetch(&stats_count, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&stats_lock);
+
+	if (!cs)
+		return;
+	if (cs->dump_on_close && cs->pub.num_methods)
+		stats_dump_env(cs);
+	stats_free(cs);
+}
+
+void stats_request_sent(struct configd_conn *conn, const char *fn,
+			unsigned int id, size_t len)
+{
+	struct configd_method_stats *ms;
+	struct stats_pending *p;
+	struct conn_stats *cs;
+
+	if (!stats_enabled())
+		return;
+
+	pthread_mutex_lock(&stats_lock);
+	cs = stats_find(conn);
+	if (cs) {
+		p = &cs->pending[id % STATS_PENDING];
+		ms = stats_method(cs, fn);
+		if (ms) {
+			ms->calls++;
+			ms->bytes_sent += len;
+			p->id = id;
+			p->method = ms - cs->pub.methods;
+			p->sent = len;
+			clock_gettime(CLOCK_MONOTONIC, &p->start);
+		} else {
+			p->method = -1;
+		}
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+void stats_response_received(struct configd_conn *conn, unsigned int id,
+			     size_t len)
+{
+	struct configd_method_stats *ms;
+	struct stats_pending *p;
+	struct conn_stats *cs;
+	struct timespec now;
+	unsigned long long us;
+
+	if (!stats_enabled())
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pthread_mutex_lock(&stats_lock);
+	cs = stats_find(conn);
+	p = cs ? &cs->pending[id % STATS_PENDING] : NULL;
+	if (p && p->method >= 0 && p->id == id) {
+		ms = &cs->pub.methods[p->method];
+		us = (now.tv_sec - p->start.tv_sec) * 1000000ULL
+			+ now.tv_nsec / 1000 - p->start.tv_nsec / 1000;
+		ms->bytes_received += len;
+		ms->total_us += us;
+		if (us > ms->max_us)
+			ms->max_us = us;
+		ms->hist[stats_bucket(us)]++;
+		p->method = -1;
+		if (cs->trace)
+			fprintf(cs->trace, "{\"pid\":%d,\"method\":\"%s\","
+				"\"id\":%u,\"sent\":%zu,\"received\":%zu,"
+				"\"us\":%llu}\n",
+				(int)getpid(), ms->method, id, p->sent, len, us);
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
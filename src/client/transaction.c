@@ -92,33 +92,44 @@ error:
 }
 
 
-char *configd_show(struct configd_conn *conn, int db, const char *cpath,
-			   const char *cfg1, const char *cfg2, int flags,
-			   struct configd_error *error)
+static int show_request(struct configd_conn *conn, int db, const char *cpath,
+			const char *cfg1, const char *cfg2, int flags,
+			struct request *req)
 {
-	char *result;
-	struct request req = { .fn = "Show" };
+	req->fn = "Show";
 	if (flags & SHOWF_DEFAULTS) {
-		req.fn = "ShowDefaults";
+		req->fn = "ShowDefaults";
 	}
 	char *id = "";
 	int hide_secrets = flags & SHOWF_HIDE_SECRETS;
 
 	if (!cfg1 || !cfg2) {
 		errno = EFAULT;
-		return NULL;
+		return -1;
 	}
 
 	if (!cpath)
 		cpath = "";
 
 	// TODO: this will be changing to client side diff using tree_get
-	//req.args = json_pack("[sisssi]", conn->session_id, db, cpath, cfg1, cfg2, flags);
+	//req->args = json_pack("[sisssi]", conn->session_id, db, cpath, cfg1, cfg2, flags);
 	if (conn->session_id) {
 		id = conn->session_id;
 	}
-	req.args = json_pack("[issb]", db, id, cpath, hide_secrets);
-	if (!req.args)
+	req->args = json_pack("[issb]", db, id, cpath, hide_secrets);
+	if (!req->args)
+		return -1;
+	return 0;
+}
+
+char *configd_show(struct configd_conn *conn, int db, const char *cpath,
+			   const char *cfg1, const char *cfg2, int flags,
+			   struct configd_error *error)
+{
+	char *result;
+	struct request req;
+
+	if (show_request(conn, db, cpath, cfg1, cfg2, flags, &req) < 0)
 		return NULL;
 
 	error_init(error, __func__);
@@ -126,6 +137,19 @@ char *configd_show(struct configd_conn *conn, int db, const char *cpath,
 	return result;
 }
 
+int configd_show_to_fd(struct configd_conn *conn, int db, const char *cpath,
+		       const char *cfg1, const char *cfg2, int flags, int fd,
+		       struct configd_error *error)
+{
+	struct request req;
+
+	if (show_request(conn, db, cpath, cfg1, cfg2, flags, &req) < 0)
+		return -1;
+
+	error_init(error, __func__);
+	return get_str_to_fd(conn, &req, fd, error);
+}
+
 char *configd_set(struct configd_conn *conn, const char *cpath, struct configd_error *error)
 {
 	char *result;
@@ -140,6 +164,52 @@ char *configd_set(struct configd_conn *conn, const char *cpath, struct configd_e
 	return result;
 }
 
+static int configd_many(struct configd_conn *conn, const char *fn, const char **cpaths, size_t n, char **errors, struct configd_error *error)
+{
+	struct request *reqs;
+	size_t i;
+	int result;
+
+	if (!conn || (n && !cpaths)) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (errors)
+		memset(errors, 0, n * sizeof(*errors));
+	if (n == 0)
+		return 0;
+
+	reqs = calloc(n, sizeof(*reqs));
+	if (!reqs)
+		return -1;
+	for (i = 0; i < n; i++) {
+		reqs[i].fn = fn;
+		reqs[i].args = json_pack("[ss]", conn->session_id, cpaths[i]);
+		if (!reqs[i].args) {
+			while (i > 0)
+				json_decref(reqs[--i].args);
+			free(reqs);
+			return -1;
+		}
+	}
+
+	result = get_pipelined(conn, reqs, n, errors, error);
+	free(reqs);
+	return result;
+}
+
+int configd_set_many(struct configd_conn *conn, const char **cpaths, size_t n, char **errors, struct configd_error *error)
+{
+	error_init(error, __func__);
+	return configd_many(conn, "Set", cpaths, n, errors, error);
+}
+
+int configd_delete_many(struct configd_conn *conn, const char **cpaths, size_t n, char **errors, struct configd_error *error)
+{
+	error_init(error, __func__);
+	return configd_many(conn, "Delete", cpaths, n, errors, error);
+}
+
 char *configd_validate_path(struct configd_conn *conn, const char *cpath, struct configd_error *error)
 {
 	char *result;
@@ -362,6 +432,83 @@ int configd_merge(struct configd_conn *conn, const char *file, struct configd_er
 	return configd_load_internal(conn, file, error, "MergeReportWarnings");
 }
 
+enum { LM_MIGRATE, LM_LOAD, LM_CHANGED, LM_REQUESTS };
+
+/* Adds what a response to configd_load_migrate has to report to error */
+static void load_migrate_report(struct response *resp, const char *fn,
+				struct configd_error *error)
+{
+	struct configd_error one;
+
+	error_init(&one, error ? error->source : NULL);
+	switch (resp->type) {
+	case STRING:
+		if (resp->result.str_val[0] != '\0')
+			error_setf(&one, "%s", resp->result.str_val);
+		break;
+	case ERROR:
+		error_setf(&one, "%s\n", resp->result.str_val);
+		break;
+	case MGMTERROR:
+		error_set_from_mgmt_error_list(&one, &resp->result.mgmt_errs, fn);
+		break;
+	default:
+		break;
+	}
+	error_merge(error, &one);
+	configd_error_free(&one);
+}
+
+/*
+ * configd has no one request that migrates and loads a file, so the
+ * three requests are sent together and their responses read together,
+ * configd answering a connection's requests in the order they are sent.
+ * As with vyatta-load-config.pl before, a file that can't be migrated is
+ * still loaded.
+ */
+int configd_load_migrate(struct configd_conn *conn, const char *file,
+			 struct configd_error *error)
+{
+	struct request reqs[LM_REQUESTS] = {
+		[LM_MIGRATE] = { .fn = "MigrateConfigFile" },
+		[LM_LOAD] = { .fn = "LoadReportWarnings" },
+		[LM_CHANGED] = { .fn = "SessionChanged" },
+	};
+	struct response resps[LM_REQUESTS];
+	int result = -1;
+	int i;
+
+	if (!conn || !file) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	reqs[LM_MIGRATE].args = json_pack("[s]", file);
+	reqs[LM_LOAD].args = json_pack("[ss]", conn->session_id, file);
+	reqs[LM_CHANGED].args = json_pack("[s]", conn->session_id);
+	for (i = 0; i < LM_REQUESTS; i++) {
+		if (!reqs[i].args) {
+			for (i = 0; i < LM_REQUESTS; i++)
+				json_decref(reqs[i].args);
+			return -1;
+		}
+	}
+
+	error_init(error, __func__);
+	if (get_responses(conn, reqs, LM_REQUESTS, resps, error) < 0)
+		return -1;
+
+	for (i = 0; i < LM_REQUESTS; i++)
+		load_migrate_report(&resps[i], reqs[i].fn, error);
+	if (resps[LM_LOAD].type == INT && resps[LM_LOAD].result.int_val == 1
+	    && resps[LM_CHANGED].type == INT)
+		result = resps[LM_CHANGED].result.int_val == 1;
+
+	for (i = 0; i < LM_REQUESTS; i++)
+		response_free(&resps[i]);
+	return result;
+}
+
 char *configd_validate(struct configd_conn *conn, struct configd_error *error)
 {
 	char *result;
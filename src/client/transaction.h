@@ -24,6 +24,14 @@ struct configd_error;
  */
 char *configd_show(struct configd_conn *, int, const char *, const char *, const char *, int, struct configd_error *);
 
+/**
+ * configd_show_to_fd is configd_show writing the output to the file
+ * descriptor as it is received rather than returning it. The return values
+ * are 0:ok, -1:error. Output may already have been written when an error
+ * is returned.
+ */
+int configd_show_to_fd(struct configd_conn *, int, const char *, const char *, const char *, int, int, struct configd_error *);
+
 /**
  * configd_set takes a '/' separated path and attemptes to create it in the
  * candidate database. On error the pointer it returns is set to NULL and
@@ -31,6 +39,20 @@ char *configd_show(struct configd_conn *, int, const char *, const char *, const
  */
 char *configd_set(struct configd_conn *, const char *, struct configd_error *);
 
+/**
+ * configd_set_many is configd_set for each of n '/' separated paths, sending
+ * the requests without waiting for each response so that it takes about one
+ * round trip rather than n. Every path is tried, whether or not earlier ones
+ * fail. If errors is non NULL it must have room for n pointers, each of which
+ * is set to NULL for a path that is set or to the error for one that is not,
+ * to be freed by the caller. The errors of all failed paths are also gathered
+ * in the configd_error struct if it is non NULL: their texts one after the
+ * other and their mgmt_errors in one list. Returns the number of paths that
+ * failed, or -1 if the connection failed, in which case those it failed
+ * before have errors too.
+ */
+int configd_set_many(struct configd_conn *, const char **, size_t, char **, struct configd_error *);
+
 /**
  * configd_validate_path takes a '/' separated path and verifies the syntax of the path
  * On error the pointer it returns is set to NULL and if the configd_error struct is
@@ -45,6 +67,12 @@ char *configd_validate_path(struct configd_conn *, const char *, struct configd_
  */
 char *configd_delete(struct configd_conn *, const char *, struct configd_error *);
 
+/**
+ * configd_delete_many is configd_delete for each of n '/' separated paths,
+ * as configd_set_many.
+ */
+int configd_delete_many(struct configd_conn *, const char **, size_t, char **, struct configd_error *);
+
 /**
  * configd_rename takes 2 '/' separated paths and attemptes to rename the first
  * path to the second. On error the pointer it returns is set to NULL and if the
@@ -131,6 +159,15 @@ int configd_merge(struct configd_conn *, const char *, struct configd_error *);
  */
 int configd_load_report_warnings(struct configd_conn *, const char *, struct configd_error *);
 
+/**
+ * configd_load_migrate migrates the configuration file at a filesystem path
+ * to the current version and then loads it, as configd_load_report_warnings,
+ * in one round trip. It returns 1 if the load changed the session, 0 if it
+ * did not, and -1 on error. Any output from migration and any warnings are
+ * left in the configd_error struct, if non NULL, whatever the result.
+ */
+int configd_load_migrate(struct configd_conn *, const char *, struct configd_error *);
+
 
 /**
  * configd_validate preforms the validate operation on the candidate database. On
@@ -40,6 +40,8 @@
 #include "cli_val.h"
 #include "cli_parse.h"
 #include "cli_objects.h"
+#include "cli_spawn.h"
+#include "probes.h"
 
 int expand_string(const char *);
 
@@ -93,7 +95,7 @@ static int cli_val_len;
 static char *cli_val_ptr;
 
 static char *exe_string;
-static int exe_string_len;
+static size_t exe_string_len;
 static int node_cnt;
 static int free_node_cnt;
 static boolean in_validate_val;
@@ -1058,6 +1060,33 @@ static int eval_va(valstruct *res, vtw_node *node)
 	}
 }
 
+/**********************************************************
+ exe_string_append:
+   append len bytes of s to the first *used bytes of exe_string,
+   keeping room for a terminating NUL. The buffer grows
+   geometrically so appends are amortised constant time.
+***********************************************************/
+static int exe_string_append(size_t *used, const char *s, size_t len)
+{
+	size_t need = *used + len + 1;
+
+	if (need > exe_string_len) {
+		size_t new_len = exe_string_len ? exe_string_len : EXE_STRING_DELTA;
+		char *new_exe_string;
+
+		while (new_len < need)
+			new_len *= 2;
+		new_exe_string = my_realloc(exe_string, new_len, "expand_string");
+		if (!new_exe_string)
+			return -1;
+		exe_string = new_exe_string;
+		exe_string_len = new_len;
+	}
+	memcpy(exe_string + *used, s, len);
+	*used += len;
+	return 0;
+}
+
 /**********************************************************
  expand_string:
    expand string replacing var references with the appropriate
@@ -1067,124 +1096,80 @@ static int eval_va(valstruct *res, vtw_node *node)
 ***********************************************************/
 int expand_string(const char *stringp)
 {
-	const char *scanp;
-	char *resp = exe_string;
-	int left = exe_string_len;
-	int my_len;
-	int len;
-
-	scanp = stringp; /* save stringp for printf */
-
-	do {
-
-		if (left <= 1) {
-			char *new_exe_string;
-			my_len = resp - exe_string;
-			exe_string_len += EXE_STRING_DELTA;
-
-			new_exe_string = my_realloc(exe_string, exe_string_len, "expand_string 1");
-			if (!new_exe_string)
-			    return -1;
-			exe_string = new_exe_string;
-			left += EXE_STRING_DELTA;
-			resp = exe_string + my_len;
-			/* back in business */
+	const char *scanp = stringp;
+	const char *endp = stringp + strlen(stringp);
+	size_t used = 0;
+
+	while (scanp < endp) {
+		const char *refp;
+		const char *pathp;
+		const char *closep;
+		char *cp = NULL;
+		boolean my_cp = FALSE;
+
+		/* only "$VAR(" is significant, we don't check for '\''$' */
+		refp = memmem(scanp, endp - scanp,
+			      VAR_REF_MARKER, VAR_REF_MARKER_LEN);
+		if (!refp || endp - refp < VAR_REF_SELF_MARKER_LEN) {
+			/* no more references; anything shorter than
+			 * "$VAR(@)" cannot be one */
+			break;
 		}
-		if (*scanp != '$') {
-			/* we don't check for '\''$' any more.
-			 * only "$VAR(" is significant now */
-			*resp++ = *scanp++;
-			--left;
-		} else if (strlen(scanp) < (VAR_REF_MARKER_LEN + 1 + 1)) {
-			/* shorter than "$VAR(@)". cannot be a reference */
-			*resp++ = *scanp++;
-			--left;
-		} else if (strncmp(scanp, VAR_REF_MARKER, VAR_REF_MARKER_LEN) != 0) {
-			/* doesn't start with "$VAR(". not a reference */
-			*resp++ = *scanp++;
-			--left;
-		} else {
-			/* the first char is '$'
-			 * && remaining length is enough for a reference
-			 * && starts with marker.
-			 */
-			char *cp=NULL;
-			boolean my_cp=FALSE;
-
-			/* advance scanp to 'R'. */
-			scanp += 3;
-
-			if(scanp[2] == '@' && scanp[3] == ')') {
+		if (exe_string_append(&used, scanp, refp - scanp))
+			return -1;
 
-				cp = get_at_string();
-				my_cp = FALSE;
-				scanp += 4;
+		pathp = refp + VAR_REF_MARKER_LEN;
+		if (pathp[0] == '@' && pathp[1] == ')') {
+			cp = get_at_string();
+			closep = pathp + 1;
+		} else {
+			closep = memchr(pathp, ')', endp - pathp);
+			if (!closep) {
+				return -1;
+			}
+			if (closep == pathp) {
+				bye("Empty path");
+			}
 
-			} else {
-				char *endp;
+			if (var_ref_handle) {
+				/* handle is set => we are in cstore operation. */
+				vtw_type_e vtype;
+				char *vptr = NULL;
+				int ismulti = 0;
+				char *path = strndup(pathp, closep - pathp);
 
-				endp = strchr(scanp, ')');
-				if (!endp ) {
+				if (!path)
 					return -1;
+				if (cstore_get_var_ref(var_ref_handle,
+						       path, &vtype, &vptr,
+						       &ismulti,
+						       is_in_delete_action())
+				    && vptr) {
+					cp = vptr;
+					my_cp = TRUE;
 				}
-
-				scanp += 2;
-				/* path reference */
-				*endp = 0;
-				if (endp == scanp) {
-					bye("Empty path");
-				}
-
-				if (var_ref_handle) {
-					/* handle is set => we are in cstore operation. */
-					vtw_type_e vtype;
-					char *vptr = NULL;
-					int ismulti = 0;
-					if (cstore_get_var_ref(var_ref_handle,
-							       scanp, &vtype, &vptr,
-							       &ismulti,
-					                       is_in_delete_action())
-					     && vptr) {
-						cp = vptr;
-					}
-				}
-
-				if(!cp) {
-					cp="";
-				} else {
-					my_cp=TRUE;
-				}
-
-				*endp = ')';
-
-				scanp = strchr(scanp, ')') + 1;
-			}
-			len = strlen(cp);
-			while(len + 1 > left) { /* 1 for termination */
-				char *new_exe_string;
-				my_len = resp - exe_string;
-				exe_string_len += EXE_STRING_DELTA;
-				new_exe_string = my_realloc(exe_string, exe_string_len,
-				                            "expand_string 2");
-				if (!new_exe_string)
-				    return -1;
-				exe_string = new_exe_string;
-				left += EXE_STRING_DELTA;
-				resp = exe_string + my_len;
-				/* back in business */
+				free(path);
 			}
 
-			strcpy(resp, cp);
-			if(my_cp) {
-				free(cp);
+			if (!cp) {
+				cp = "";
 			}
-			resp += len;
-			left -= len;
 		}
 
-	} while(*scanp);
+		if (exe_string_append(&used, cp, strlen(cp))) {
+			if (my_cp)
+				free(cp);
+			return -1;
+		}
+		if (my_cp) {
+			free(cp);
+		}
+		scanp = closep + 1;
+	}
 
-	*resp = 0;
+	if (exe_string_append(&used, scanp, endp - scanp))
+		return -1;
+	exe_string[used] = 0;
 
 	return VTWERR_OK;
 }
@@ -1379,6 +1364,10 @@ system_out(char *cmd, const char *prepend_msg, boolean eloc)
 	int pfd[2];
 	int ret;
 	pid_t cpid;
+	posix_spawn_file_actions_t fa;
+	int status;
+	int waited = 0;
+	int prepend = 1;
 
 	if (!cmd || (ret = pipe(pfd)) != 0) {
 		return -1;
@@ -1402,192 +1391,184 @@ system_out(char *cmd, const char *prepend_msg, boolean eloc)
 	 *
 	 * the new process management mechanism below does not have this problem.
 	 */
-	if ((cpid = fork())) {
-		int status;
-		int waited = 0;
-		int prepend = 1;
-
-		close(pfd[1]);
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addclose(&fa, pfd[0]);
+	posix_spawn_file_actions_adddup2(&fa, pfd[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&fa, pfd[1], STDERR_FILENO);
+	posix_spawn_file_actions_addclose(&fa, pfd[1]);
+	ret = cli_cmd_spawn(&cpid, cmd, &fa);
+	posix_spawn_file_actions_destroy(&fa);
+	close(pfd[1]);
+
+	if (ret != 0) {
+		close(pfd[0]);
+		fprintf(stderr, "fork failed\n");
+		return -1;
+	}
+	CFG_PROBE(cliexec, spawn, cpid, cmd);
+
+	while (1) {
+		int sret;
+		fd_set readfds;
+		struct timeval timeout;
+		FD_ZERO(&readfds);
+		FD_SET(pfd[0], &readfds);
+		timeout.tv_sec = 0;
+		timeout.tv_usec = 100000;
+		sret = select(pfd[0] + 1, &readfds, NULL, NULL, &timeout);
+		if (sret == 1) {
+			/* ready for read */
+			char buf[128];
+			char *out = buf;
+			ssize_t count = read(pfd[0], buf, 128);
+			if (count <= 0) {
+				/* eof or error */
+				break;
+			}
 
-		if (cpid == -1) {
-			close(pfd[0]);
-			fprintf(stderr, "fork failed\n");
-			return -1;
-		}
+			/* XXX XXX XXX BEGIN emulating original "error" location handling */
 
-		while (1) {
-			int sret;
-			fd_set readfds;
-			struct timeval timeout;
-			FD_ZERO(&readfds);
-			FD_SET(pfd[0], &readfds);
-			timeout.tv_sec = 0;
-			timeout.tv_usec = 100000;
-			sret = select(pfd[0] + 1, &readfds, NULL, NULL, &timeout);
-			if (sret == 1) {
-				/* ready for read */
-				char buf[128];
-				char *out = buf;
-				ssize_t count = read(pfd[0], buf, 128);
-				if (count <= 0) {
-					/* eof or error */
-					break;
-				}
+			/* the following code segment is the "logic" for handling "error"
+			 * location in the original impl. (note that this code is preserved
+			 * here for demonstration purpose. this is not "commented-out"
+			 * code.)
+			 */
+			/***
+			if (first == TRUE) {
+			  if (strncmp(buf,errloc_buf,errloc_len) == 0) {
+			    if (format == FALSE) {
+			      fprintf(out_stream,"%s",buf+errloc_len);
+			    }
+			    else {
+			      fprintf(out_stream,"%s",buf);
+			    }
+			  } else {
+			    // currently set to format option for GUI client.
+			    if (prepend_msg != NULL) {
+			      if (format == FALSE) {
+			        fprintf(out_stream,"[%s]\n%s",prepend_msg,buf);
+			      } else {
+			        fprintf(out_stream,"%s[%s]\n%s",errloc_buf,prepend_msg,buf);
+			      }
+			    }
+			  }
+			} else {
+			  if (strncmp(buf,errloc_buf,errloc_len) == 0 && format == FALSE) {
+			    fprintf(out_stream,"%s",buf+errloc_len);
+			  } else {
+			    fprintf(out_stream,"%s",buf);
+			  }
+			}
+			***/
+			/* XXX analysis of above:
+			 * the main issue is that this seems to indicate that the "error"
+			 * location can actually be prepended in two different layers (the
+			 * layer here and the actual command output). the "logic" above
+			 * seems to be:
+			 *   (1) for first buffer read
+			 *     (A) if the lower layer has already prepended "errloc" string
+			 *       (a) if we DON'T want errloc string, then strip it from
+			 *           the lower-layer output.
+			 *       (b) if we DO want the string, let it pass through
+			 *     (B) if the lower layer did not prepend
+			 *       (a) if we DON'T want errloc, don't prepend it here
+			 *       (b) if we DO want the string, prepend it here
+			 *   (2) for any subsequent buffer reads
+			 *     (A) if lower layer prepended errloc AND we DON'T want errloc,
+			 *         strip it from output
+			 *     (B) otherwise (lower layer did not prepend OR
+			 *         we DO want errloc), let it pass through
+			 *
+			 * note that the handling of subsequent buffer reads makes no sense.
+			 * the reads can start at any offsets, so if we actually need to
+			 * strip out any errloc string at the start of any subsequent reads
+			 * from the command output, then something is very broken here.
+			 *
+			 * secondly, assuming (2) is in fact not needed, the main issue
+			 * in (1) is the fact that the errloc string can be prepended in two
+			 * different layers, resulting in the "logic" seen above. if the
+			 * eventual appearance (i.e., errloc or not) is completely determined
+			 * in this layer here, then such a "design" choice is weird.
+			 *
+			 * given the resource availability, at the moment, the only feasible
+			 * approach here is to emulate the original impl's behavior in terms
+			 * of "errloc".
+			 *
+			 * another (unrelated) issue is that the original impl assumes the
+			 * buffer reads do not contain any '\0' bytes since it uses
+			 * fprintf() to output the buffer. A '\0' byte will cause the rest
+			 * of the buffer to be truncated. the new impl does not have this
+			 * problem.
+			 *
+			 * the logic below emulates the case (1) in the original impl and
+			 * ignores case (2). if somehow case (2) is indeed necessary, we
+			 * should really take a good look at the reason and fix the
+			 * underlying problem. (heck, even (1) is fugly as hell, but
+			 * right now it's simply not feasible to look into it.)
+			 */
+			if (prepend && out_stream != NULL) {
+				prepend = 0;
 
-				/* XXX XXX XXX BEGIN emulating original "error" location handling */
-
-				/* the following code segment is the "logic" for handling "error"
-				 * location in the original impl. (note that this code is preserved
-				 * here for demonstration purpose. this is not "commented-out"
-				 * code.)
-				 */
-				/***
-				if (first == TRUE) {
-				  if (strncmp(buf,errloc_buf,errloc_len) == 0) {
-				    if (format == FALSE) {
-				      fprintf(out_stream,"%s",buf+errloc_len);
-				    }
-				    else {
-				      fprintf(out_stream,"%s",buf);
-				    }
-				  } else {
-				    // currently set to format option for GUI client.
-				    if (prepend_msg != NULL) {
-				      if (format == FALSE) {
-				        fprintf(out_stream,"[%s]\n%s",prepend_msg,buf);
-				      } else {
-				        fprintf(out_stream,"%s[%s]\n%s",errloc_buf,prepend_msg,buf);
-				      }
-				    }
-				  }
-				} else {
-				  if (strncmp(buf,errloc_buf,errloc_len) == 0 && format == FALSE) {
-				    fprintf(out_stream,"%s",buf+errloc_len);
-				  } else {
-				    fprintf(out_stream,"%s",buf);
-				  }
-				}
-				***/
-				/* XXX analysis of above:
-				 * the main issue is that this seems to indicate that the "error"
-				 * location can actually be prepended in two different layers (the
-				 * layer here and the actual command output). the "logic" above
-				 * seems to be:
-				 *   (1) for first buffer read
-				 *     (A) if the lower layer has already prepended "errloc" string
-				 *       (a) if we DON'T want errloc string, then strip it from
-				 *           the lower-layer output.
-				 *       (b) if we DO want the string, let it pass through
-				 *     (B) if the lower layer did not prepend
-				 *       (a) if we DON'T want errloc, don't prepend it here
-				 *       (b) if we DO want the string, prepend it here
-				 *   (2) for any subsequent buffer reads
-				 *     (A) if lower layer prepended errloc AND we DON'T want errloc,
-				 *         strip it from output
-				 *     (B) otherwise (lower layer did not prepend OR
-				 *         we DO want errloc), let it pass through
-				 *
-				 * note that the handling of subsequent buffer reads makes no sense.
-				 * the reads can start at any offsets, so if we actually need to
-				 * strip out any errloc string at the start of any subsequent reads
-				 * from the command output, then something is very broken here.
-				 *
-				 * secondly, assuming (2) is in fact not needed, the main issue
-				 * in (1) is the fact that the errloc string can be prepended in two
-				 * different layers, resulting in the "logic" seen above. if the
-				 * eventual appearance (i.e., errloc or not) is completely determined
-				 * in this layer here, then such a "design" choice is weird.
-				 *
-				 * given the resource availability, at the moment, the only feasible
-				 * approach here is to emulate the original impl's behavior in terms
-				 * of "errloc".
-				 *
-				 * another (unrelated) issue is that the original impl assumes the
-				 * buffer reads do not contain any '\0' bytes since it uses
-				 * fprintf() to output the buffer. A '\0' byte will cause the rest
-				 * of the buffer to be truncated. the new impl does not have this
-				 * problem.
-				 *
-				 * the logic below emulates the case (1) in the original impl and
-				 * ignores case (2). if somehow case (2) is indeed necessary, we
-				 * should really take a good look at the reason and fix the
-				 * underlying problem. (heck, even (1) is fugly as hell, but
-				 * right now it's simply not feasible to look into it.)
-				 */
-				if (prepend && out_stream != NULL) {
-					prepend = 0;
-
-					/* XXX follow original behavior */
+				/* XXX follow original behavior */
 #define errloc_str "_errloc_:"
 #define errloc_len 9
-					if (count > errloc_len
-					    && memcmp(buf, errloc_str, errloc_len) == 0) {
-						/* XXX lower-layer already prepended errloc, so strip it out if
-						 * we don't want errloc. AND in such cases we don't want the
-						 * prepend_msg either. (!?)
-						 *  It looks like the lower layer will print _errloc_:[prepend_msg]
-						 * see Vyatta::Config::outputError in perl.
-						 * This is why when stripping errloc we don't want prepend_msg.
-						 */
-						out = (eloc ? buf : (buf + errloc_len));
-						count = (eloc ? count : (count - errloc_len));
-					} else {
-						/* XXX lower-layer did not prepend errloc */
-						if (eloc) {
-							/* XXX prepend errloc since we want it */
-							fprintf(out_stream, "%s", errloc_str);
-						}
-						/* XXX and in such cases we DO want prepend_msg */
-						if (prepend_msg) {
-							fprintf(out_stream, "[%s]\n", prepend_msg);
-						}
+				if (count > errloc_len
+				    && memcmp(buf, errloc_str, errloc_len) == 0) {
+					/* XXX lower-layer already prepended errloc, so strip it out if
+					 * we don't want errloc. AND in such cases we don't want the
+					 * prepend_msg either. (!?)
+					 *  It looks like the lower layer will print _errloc_:[prepend_msg]
+					 * see Vyatta::Config::outputError in perl.
+					 * This is why when stripping errloc we don't want prepend_msg.
+					 */
+					out = (eloc ? buf : (buf + errloc_len));
+					count = (eloc ? count : (count - errloc_len));
+				} else {
+					/* XXX lower-layer did not prepend errloc */
+					if (eloc) {
+						/* XXX prepend errloc since we want it */
+						fprintf(out_stream, "%s", errloc_str);
 					}
+					/* XXX and in such cases we DO want prepend_msg */
+					if (prepend_msg) {
+						fprintf(out_stream, "[%s]\n", prepend_msg);
+					}
+				}
 #undef errloc_str
 #undef errloc_len
-				}
+			}
 
-				/* XXX XXX XXX END emulating original "error" location handling */
-				if (out_stream != NULL) {
-					if (fwrite(out, count, 1, out_stream) != 1) {
-						close(pfd[0]);
-						return -1;
-					}
-					fflush(out_stream);
-				}
-			} else if (sret == 0) {
-				/* timeout */
-				if (waitpid(cpid, &status, WNOHANG) == cpid) {
-					/* child done */
-					waited = 1;
-					break;
+			/* XXX XXX XXX END emulating original "error" location handling */
+			if (out_stream != NULL) {
+				if (fwrite(out, count, 1, out_stream) != 1) {
+					close(pfd[0]);
+					return -1;
 				}
-			} else {
-				/* error (-1) */
-				break;
+				fflush(out_stream);
 			}
-		}
-		if (!prepend && out_stream != NULL) {
-			fprintf(out_stream, "\n");
-		}
-		close(pfd[0]);
-		if (!waited) {
-			if (waitpid(cpid, &status, 0) != cpid) {
-				return -1;
+		} else if (sret == 0) {
+			/* timeout */
+			if (waitpid(cpid, &status, WNOHANG) == cpid) {
+				/* child done */
+				waited = 1;
+				break;
 			}
+		} else {
+			/* error (-1) */
+			break;
 		}
-		return (WIFEXITED(status) ? WEXITSTATUS(status) : 1);
-	} else {
-		/* child process */
-		close(pfd[0]);
-		if ((ret = dup2(pfd[1], STDOUT_FILENO) < 0)
-		    || (ret = dup2(pfd[1], STDERR_FILENO)) < 0) {
-			exit(1);
+	}
+	if (!prepend && out_stream != NULL) {
+		fprintf(out_stream, "\n");
+	}
+	close(pfd[0]);
+	if (!waited) {
+		if (waitpid(cpid, &status, 0) != cpid) {
+			return -1;
 		}
-		close(pfd[1]);
-		char *eargs[] = { "sh", "-c", cmd, NULL };
-		execv("/bin/sh", eargs);
-		return -1; /* should not get here */
 	}
+	CFG_PROBE(cliexec, spawn_exit, cpid, status);
+	return (WIFEXITED(status) ? WEXITSTATUS(status) : 1);
 }
 
 const char *get_exe_string(void)
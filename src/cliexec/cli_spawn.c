@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cli_spawn.h"
+
+extern char **environ;
+
+/* Characters that mean nothing to the shell outside of quotes. Anything
+ * else (quoting, expansion, redirection, globbing, comments, control
+ * operators, newlines) means the command is handed to /bin/sh.
+ */
+static int is_plain_char(char c)
+{
+	if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+	    || (c >= '0' && c <= '9'))
+		return 1;
+	switch (c) {
+	case '-': case '_': case '.': case '/': case ',':
+	case ':': case '+': case '=': case '@': case '%':
+		return 1;
+	}
+	return 0;
+}
+
+static int is_blank(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static int is_executable(const char *path)
+{
+	struct stat st;
+
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode)
+		&& access(path, X_OK) == 0;
+}
+
+/* Builtins and reserved words of /bin/sh (dash). Many builtins, such as
+ * echo, printf, kill, test, pwd, true and false, also exist in PATH but
+ * do not behave the same, so these are always left to the shell.
+ */
+static const char *const sh_builtins[] = {
+	"alias", "bg", "break", "case", "cd", "chdir", "command",
+	"continue", "do", "done", "echo", "elif", "else", "esac", "eval",
+	"exec", "exit", "export", "false", "fc", "fg", "fi", "for",
+	"getopts", "hash", "if", "in", "jobs", "kill", "local", "printf",
+	"pwd", "read", "readonly", "return", "set", "shift", "test",
+	"then", "times", "trap", "true", "type", "ulimit", "umask",
+	"unalias", "unset", "until", "wait", "while",
+};
+
+static int is_sh_builtin(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(sh_builtins) / sizeof(sh_builtins[0]); i++)
+		if (strcmp(name, sh_builtins[i]) == 0)
+			return 1;
+	return 0;
+}
+
+/* Look name up in PATH the way the shell would. Functions are never
+ * found here and builtins are never looked up, so those fall back to
+ * the shell.
+ */
+static char *find_in_path(const char *name)
+{
+	const char *path = getenv("PATH");
+	size_t nlen = strlen(name);
+
+	if (!path)
+		return NULL;
+
+	for (;;) {
+		const char *end = strchr(path, ':');
+		size_t dlen = end ? (size_t)(end - path) : strlen(path);
+		char *cand = malloc(dlen + nlen + 2);
+
+		if (!cand)
+			return NULL;
+		if (dlen == 0) {
+			memcpy(cand, name, nlen + 1);
+		} else {
+			memcpy(cand, path, dlen);
+			cand[dlen] = '/';
+			memcpy(cand + dlen + 1, name, nlen + 1);
+		}
+		if (is_executable(cand))
+			return cand;
+		free(cand);
+		if (!end)
+			return NULL;
+		path = end + 1;
+	}
+}
+
+int cli_cmd_parse(const char *cmd, struct cli_cmd *cc)
+{
+	const char *p;
+	size_t words = 0, len = 0;
+	char **argv;
+	char *buf;
+	int in_word = 0;
+
+	cc->path = NULL;
+	cc->argv = NULL;
+
+	for (p = cmd; *p; p++) {
+		if (is_blank(*p)) {
+			in_word = 0;
+			continue;
+		}
+		if (!is_plain_char(*p))
+			return -1;
+		if (!in_word) {
+			/* leading assignments are for the shell */
+			if (words == 0 && strcspn(p, "= \t") < strcspn(p, " \t"))
+				return -1;
+			in_word = 1;
+			words++;
+		}
+		len++;
+	}
+	if (words == 0)
+		return -1;
+
+	/* one block holding the vector followed by the words */
+	argv = malloc((words + 1) * sizeof(char *) + len + words);
+	if (!argv)
+		return -1;
+	buf = (char *)(argv + words + 1);
+	words = 0;
+	for (p = cmd; *p; ) {
+		size_t wlen;
+
+		if (is_blank(*p)) {
+			p++;
+			continue;
+		}
+		wlen = strcspn(p, " \t");
+		argv[words++] = memcpy(buf, p, wlen);
+		buf[wlen] = '\0';
+		buf += wlen + 1;
+		p += wlen;
+	}
+	argv[words] = NULL;
+
+	if (strchr(argv[0], '/'))
+		cc->path = strdup(argv[0]);
+	else if (!is_sh_builtin(argv[0]))
+		cc->path = find_in_path(argv[0]);
+	if (!cc->path) {
+		free(argv);
+		return -1;
+	}
+	cc->argv = argv;
+	return 0;
+}
+
+void cli_cmd_free(struct cli_cmd *cc)
+{
+	free(cc->path);
+	free(cc->argv);
+	cc->path = NULL;
+	cc->argv = NULL;
+}
+
+int cli_cmd_spawn(pid_t *pid, const char *cmd,
+		  const posix_spawn_file_actions_t *fa)
+{
+	struct cli_cmd cc;
+	char *sh_argv[] = { "sh", "-c", (char *)cmd, NULL };
+
+	if (cli_cmd_parse(cmd, &cc) == 0) {
+		int ret = posix_spawn(pid, cc.path, fa, NULL, cc.argv, environ);
+		cli_cmd_free(&cc);
+		if (ret == 0)
+			return 0;
+		/* let the shell report why it could not be run */
+	}
+	return posix_spawn(pid, "/bin/sh", fa, NULL, sh_argv, environ);
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ */
+#ifndef CLI_SPAWN_H
+#define CLI_SPAWN_H
+
+#include <spawn.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/* A command line that can be run without a shell */
+	struct cli_cmd {
+		char *path;	/* executable to run */
+		char **argv;	/* NULL terminated argument vector */
+	};
+
+	/* Split cmd into a cli_cmd if the shell would do nothing more
+	   than word split it and look the first word up in PATH. A
+	   first word that is a shell builtin or reserved word always
+	   needs the shell. Returns 0 on success, -1 if cmd needs /bin/sh. */
+	int cli_cmd_parse(const char *cmd, struct cli_cmd *cc);
+	void cli_cmd_free(struct cli_cmd *cc);
+
+	/* Start cmd directly if possible, otherwise via "/bin/sh -c".
+	   Returns 0 or a posix_spawn error number. */
+	int cli_cmd_spawn(pid_t *pid, const char *cmd,
+			  const posix_spawn_file_actions_t *fa);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLI_SPAWN_H */
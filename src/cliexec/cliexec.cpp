@@ -13,9 +13,13 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <map>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include <connect.h>
 #include <cpath.hpp>
@@ -23,6 +27,7 @@
 #include <log.h>
 #include "../cli_cstore.h"
 #include "cli_objects.h"
+#include "cli_spawn.h"
 #include "cpath.hpp"
 
 #ifdef __cplusplus
@@ -53,15 +58,35 @@ static const char NODE_PATH[] = "CONFIGD_PATH";
 static const char COMMIT_ACTION_ENV[] = "COMMIT_ACTION";
 
 static struct configd_conn conn;
+static bool connected;
 static int no_shell;
 
+/* Node type information taken from the configd template */
+struct node_type {
+	vtw_type_e type;
+	vtw_type_e type2;
+	bool tag;
+	bool multi;
+};
+
+/* Parsed definitions by file name and node types by path. A single run
+ * only ever looks up one of each, but batch mode keeps them across
+ * entries.
+ */
+static std::map<std::string, vtw_def> def_cache;
+static std::map<std::string, node_type> type_cache;
+
 static void connect(void)
 {
 	char *sid;
+
+	if (connected)
+		return;
 	if (configd_open_connection(&conn)) {
 		std::cerr << "Unable to connect to configd\n";
 		exit(EXIT_FAILURE);
 	}
+	connected = true;
 
 	sid = getenv(SID_ENV);
 	if (sid)
@@ -150,29 +175,65 @@ static int is_delete(vtw_act_type action)
 		|| action == delete_act;
 }
 
+static const vtw_def *get_def(const std::string &fname)
+{
+	auto it = def_cache.find(fname);
+	if (it != def_cache.end())
+		return &it->second;
+
+	vtw_def &def = def_cache[fname];
+	if (parse_def(&def, fname.c_str(), 0)) {
+		def_cache.erase(fname);
+		return NULL;
+	}
+	return &def;
+}
+
+static bool get_node_type(const std::string &cpath, node_type &nt)
+{
+	auto it = type_cache.find(cpath);
+	if (it != type_cache.end()) {
+		nt = it->second;
+		return true;
+	}
+
+	Cpath pcomps(cpath);
+	Ctemplate configd_def((struct configd_conn*)var_ref_handle, pcomps.to_path_cstr());
+	if (!configd_def.get())
+		return false;
+
+	nt.type = configd_def.getType(1);
+	nt.type2 = configd_def.getType(2);
+	nt.tag = configd_def.isTag();
+	nt.multi = configd_def.isMulti();
+	type_cache[cpath] = nt;
+	return true;
+}
+
 static int process_cli_script(const std::string &fname, const std::string &cpath)
 {
-	vtw_def def;
+	const vtw_def *pdef;
+	node_type nt;
 
 	connect();
-	if (parse_def(&def, fname.c_str(), 0)) {
+	pdef = get_def(fname);
+	if (!pdef) {
 		std::cerr << "Unable to parse node: " << fname << std::endl;
 		return EXIT_FAILURE;
 	}
 
-	Cpath pcomps(cpath);
-	Ctemplate configd_def((struct configd_conn*)var_ref_handle, pcomps.to_path_string().c_str());
-	if (!configd_def.get()) {
+	if (!get_node_type(cpath, nt)) {
 		std::cerr << "could not get template from configd";
 		return EXIT_FAILURE;
 	}
 
-	def.def_type = configd_def.getType(1);
-	def.def_type2 = configd_def.getType(2);
-	def.def_tag = configd_def.isTag() ? 1 : 0;
-	def.def_multi = configd_def.isMulti() ? 1 : 0;
-	def.tag = configd_def.isTag();
-	def.multi = configd_def.isMulti();
+	vtw_def def = *pdef;
+	def.def_type = nt.type;
+	def.def_type2 = nt.type2;
+	def.def_tag = nt.tag ? 1 : 0;
+	def.def_multi = nt.multi ? 1 : 0;
+	def.tag = nt.tag;
+	def.multi = nt.multi;
 
 	vtw_act_type act_type = get_action_type();
 	if (act_type == top_act) {
@@ -191,6 +252,8 @@ static int process_cli_script(const std::string &fname, const std::string &cpath
 	set_at_string(at_string);
 	set_cfg_path(cpath.c_str());
 	bool ret = execute_list(actions, &def, NULL);
+	set_at_string(NULL);
+	free(at_string);
 	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -212,6 +275,15 @@ static void process_string(const std::string &str, const std::string &cpath)
 	}
 	estr = get_exe_string();
 	free(at_string);
+
+	/* Most actions are a plain command line which the shell would
+	 * only split into words, so skip loading it for those. If the
+	 * exec fails the shell gets to run it and report why.
+	 */
+	struct cli_cmd cc;
+	if (cli_cmd_parse(estr, &cc) == 0)
+		execv(cc.path, cc.argv);
+
 	if (no_shell) {
 		std::string cmd("exec ");
 		cmd += estr;
@@ -248,10 +320,175 @@ static void process_cmd(const std::string &cmd, const std::string &cpath)
 	process_string(cmd, cpath);
 }
 
+/*
+ * Batch mode runs one entry per input line:
+ *
+ *	<CONFIGD_PATH> TAB <action> TAB <script> NL
+ *
+ * Each entry is run as if cliexec had been invoked for it alone, with
+ * CONFIGD_PATH and CONFIGD_EXT set accordingly. For each entry a frame
+ * holding its exit status and everything it wrote to stdout and stderr
+ * is written to stdout:
+ *
+ *	<entry> SP <status> SP <length> NL <output> NL
+ *
+ * Entries are numbered from 1 in input order, ignoring blank lines. If an
+ * entry causes cliexec to exit, its frame is still written but the batch
+ * ends there.
+ */
+struct batch_state {
+	pid_t pid;
+	FILE *out;		/* the original stdout */
+	int capture;		/* stdout and stderr of the current entry */
+	unsigned long entry;	/* current entry, 0 when between entries */
+};
+
+static struct batch_state batch;
+
+static void batch_begin_entry(void)
+{
+	if (ftruncate(batch.capture, 0) < 0 || lseek(batch.capture, 0, SEEK_SET) < 0) {
+		perror("batch capture");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void batch_end_entry(int status)
+{
+	char buf[4096];
+	off_t len, off = 0;
+	ssize_t n;
+
+	fflush(stdout);
+	fflush(stderr);
+	std::cout.flush();
+	std::cerr.flush();
+
+	len = lseek(batch.capture, 0, SEEK_END);
+	if (len < 0)
+		len = 0;
+	fprintf(batch.out, "%lu %d %lld\n", batch.entry, status, (long long)len);
+	while (off < len && (n = pread(batch.capture, buf, sizeof(buf), off)) > 0) {
+		fwrite(buf, 1, n, batch.out);
+		off += n;
+	}
+	/* keep the frame length honest if the capture shrank under us */
+	for (; off < len; off++)
+		fputc('\0', batch.out);
+	fputc('\n', batch.out);
+	fflush(batch.out);
+	batch.entry = 0;
+}
+
+static void batch_on_exit(int status, void *arg)
+{
+	(void)arg;
+	if (getpid() == batch.pid && batch.entry)
+		batch_end_entry(status);
+}
+
+static int run_batch_entry(const char *path, const char *action,
+			   const std::string &fname)
+{
+	pid_t pid;
+	int status;
+
+	setenv(NODE_PATH, path, 1);
+	setenv(ACTION_ENV, action, 1);
+
+	switch (get_script_type(program_invocation_short_name, fname.c_str())) {
+	case SCRIPT_EXPR:
+		return process_cli_script(fname, path);
+	case SCRIPT_OTHER:
+		fflush(NULL);
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return EXIT_FAILURE;
+		}
+		if (pid == 0)
+			process_sh_script(fname, path); /* does not return */
+		if (waitpid(pid, &status, 0) != pid)
+			return EXIT_FAILURE;
+		return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+	default:
+		std::cerr << "Unrecognized script " << fname << std::endl;
+		return EXIT_FAILURE;
+	}
+}
+
+static int process_batch(const std::string &fname)
+{
+	FILE *in;
+	FILE *capture;
+	int out;
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	unsigned long entries = 0;
+
+	in = (fname == "-") ? stdin : fopen(fname.c_str(), "re");
+	if (!in) {
+		perror(fname.c_str());
+		return EXIT_FAILURE;
+	}
+
+	/* Only the entry's stdout and stderr are for the scripts it runs,
+	 * so keep the batch's own descriptors out of them.
+	 */
+	fflush(stdout);
+	batch.pid = getpid();
+	out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	batch.out = out < 0 ? NULL : fdopen(out, "w");
+	capture = tmpfile();
+	if (!batch.out || !capture
+	    || fcntl(fileno(capture), F_SETFD, FD_CLOEXEC) < 0) {
+		perror("batch");
+		return EXIT_FAILURE;
+	}
+	batch.capture = fileno(capture);
+	if (dup2(batch.capture, STDOUT_FILENO) < 0
+	    || dup2(batch.capture, STDERR_FILENO) < 0) {
+		perror("dup2");
+		return EXIT_FAILURE;
+	}
+	on_exit(batch_on_exit, NULL);
+
+	while ((len = getline(&line, &cap, in)) != -1) {
+		char *path = line;
+		char *action, *script;
+		int status;
+
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len == 0)
+			continue;
+
+		batch_begin_entry();
+		batch.entry = ++entries;
+
+		action = strchr(path, '\t');
+		script = action ? strchr(action + 1, '\t') : NULL;
+		if (!script) {
+			std::cerr << "Malformed batch entry: " << line << std::endl;
+			status = EXIT_FAILURE;
+		} else {
+			*action++ = '\0';
+			*script++ = '\0';
+			status = run_batch_entry(path, action, script);
+		}
+		batch_end_entry(status);
+	}
+	free(line);
+	if (in != stdin)
+		fclose(in);
+	return EXIT_SUCCESS;
+}
+
 static void usage(int result)
 {
 	std::cout << "\nUsage: " << program_invocation_short_name
-		  << " [-h] [-d] [-c cmd | -s cmd | script]\n\n";
+		  << " [-h] [-d] [-b file | -c cmd | -s cmd | script]\n\n";
 	exit(result);
 }
 
@@ -263,16 +500,21 @@ int main(int argc, char *argv[])
 	std::string fname;
 	std::string cmd;
 	std::string cpath;
+	std::string batch_file;
 
 	set_in_commit(true);
 
-	while ((opt = ::getopt(argc, argv, ":c:ds:h")) != -1)
+	while ((opt = ::getopt(argc, argv, ":b:c:ds:h")) != -1)
 	{
 		switch (opt) {
 		case 'h':	      /* Help please */
 			usage(EXIT_SUCCESS);
 			break;
 
+		case 'b':	      /* Batch of entries */
+			batch_file = optarg;
+			break;
+
 		case 'c':	      /* Command */
 			cmd = optarg;
 			break;
@@ -296,6 +538,13 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	var_ref_handle = &conn;
+	out_stream = stdout;
+	err_stream = stderr;
+
+	if (batch_file.length())
+		exit(process_batch(batch_file));
+
 	// If we are not processing a command, make sure we have a
 	// script name to process.
 	if (!cmd.length()) {
@@ -312,9 +561,6 @@ int main(int argc, char *argv[])
 		usage(EXIT_FAILURE);
 	}
 	cpath = env;
-	var_ref_handle = &conn;
-	out_stream = stdout;
-	err_stream = stderr;
 
 	if (cmd.length())
 		process_cmd(cmd, cpath); /* does not return */
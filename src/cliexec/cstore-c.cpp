@@ -25,6 +25,7 @@
 #include "cpath.hpp"
 #include "cstore-varref.hpp"
 #include "cstore-c.h"
+#include <probes.h>
 
 /* get the value string that corresponds to specified variable ref string.
  *   ref_str: var ref string (e.g., "./cost/@").
@@ -50,7 +51,7 @@ cstore_get_var_ref(void *handle, const char *ref_str, vtw_type_e *type,
 	if (tmpl.isValue()) {
 		cpath.pop();
 	}
-	set_cfg_path(cpath.to_path_string().c_str());
+	set_cfg_path(cpath.to_path_cstr());
 
 	std::string vr(ref_str);
 	bool bFromActive(from_active);
@@ -59,14 +60,16 @@ cstore_get_var_ref(void *handle, const char *ref_str, vtw_type_e *type,
 	std::string value;
 	vtw_type_e t;
 	if (!vref.getValue(value, *ismulti, t)) {
-		set_cfg_path(orig_cfg_path.to_path_string().c_str());
+		CFG_PROBE(cliexec, varref, ref_str, (const char *)NULL);
+		set_cfg_path(orig_cfg_path.to_path_cstr());
 		return 0;
 	}
+	CFG_PROBE(cliexec, varref, ref_str, value.c_str());
 
 	*type = t;
 	/* follow original implementation. caller is supposed to free this. */
 	*val = strdup(value.c_str());
-	set_cfg_path(orig_cfg_path.to_path_string().c_str());
+	set_cfg_path(orig_cfg_path.to_path_cstr());
 	return !!*val;
 }
 
@@ -106,20 +109,20 @@ cstore_set_var_ref(void *handle, const char *ref_str, const char *value, int to_
 	Cpath orig_cfg_path(get_cfg_path());
 	Cpath cpath(orig_cfg_path);
 	cpath.pop();
-	set_cfg_path(cpath.to_path_string().c_str());
+	set_cfg_path(cpath.to_path_cstr());
 	std::string vr(ref_str);
 	VarRef vref(handle, ref_str, NULL, to_active);
 
 	if (!vref.getSetPath(cpath))
 		goto done;
 
-	type = configd_node_get_type(h, cpath.to_path_string().c_str(), NULL);
+	type = configd_node_get_type(h, cpath.to_path_cstr(), NULL);
 	if (type != NODE_TYPE_LEAF)
 		goto done;
 
 	cpath += value;
 	struct configd_error err;
-	result = configd_set(h, cpath.to_path_string().c_str(), &err);
+	result = configd_set(h, cpath.to_path_cstr(), &err);
 	ret = result != NULL;
 	if (result) {
 		puts(result);
@@ -129,6 +132,6 @@ cstore_set_var_ref(void *handle, const char *ref_str, const char *value, int to_
 		configd_error_free(&err);
 	}
 done:
-	set_cfg_path(orig_cfg_path.to_path_string().c_str());
+	set_cfg_path(orig_cfg_path.to_path_cstr());
 	return ret;
 }
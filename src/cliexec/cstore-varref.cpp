@@ -71,13 +71,13 @@ VarRef::VarRef(void *cstore, const std::string &ref_str, bool *ismulti, bool act
 }
 
 
-static int get_values(struct configd_conn *conn, const std::string &path, bool active, std::string &vals)
+static int get_values(struct configd_conn *conn, const char *path, bool active, std::string &vals)
 {
 	int db = active ? RUNNING : CANDIDATE;
 	const char *str = NULL;
 	int result = 1;
 
-	struct vector *v = configd_node_get(conn, db, path.c_str(), NULL);
+	struct vector *v = configd_node_get(conn, db, path, NULL);
 	if (!v)
 		return 0;
 
@@ -124,7 +124,7 @@ VarRef::process_ref(const Cpath &ref_comps,
 		rcomps.push(ref_comps[i]);
 	}
 
-	Ctemplate def(_cstore, pcomps.to_path_string().c_str());
+	Ctemplate def(_cstore, pcomps.to_path_cstr());
 	bool got_tmpl = (def.get() != 0);
 
 	bool handle_leaf = false;
@@ -173,7 +173,7 @@ VarRef::process_ref(const Cpath &ref_comps,
 		pcomps.pop();
 		if (pcomps.size() > 0) {
 			/* not at root yet */
-			Ctemplate parent_def(_cstore, pcomps.to_path_string().c_str());
+			Ctemplate parent_def(_cstore, pcomps.to_path_cstr());
 			if (!parent_def.get()) {
 				/* invalid tmpl path */
 				return;
@@ -199,7 +199,7 @@ VarRef::process_ref(const Cpath &ref_comps,
 				*ismulti = true;
 			}
 			int db = _active ? RUNNING : CANDIDATE;
-			struct vector *cnodes = configd_node_get(_cstore, db, pcomps.to_path_string().c_str(), NULL);
+			struct vector *cnodes = configd_node_get(_cstore, db, pcomps.to_path_cstr(), NULL);
 			if (!vector_count(cnodes)) {
 				vector_free(cnodes);
 				return;
@@ -222,7 +222,7 @@ VarRef::process_ref(const Cpath &ref_comps,
 				*ismulti = true;
 			}
 			int db = _active ? RUNNING : CANDIDATE;
-			struct vector *cnodes = configd_node_get(_cstore, db, pcomps.to_path_string().c_str(), NULL);
+			struct vector *cnodes = configd_node_get(_cstore, db, pcomps.to_path_cstr(), NULL);
 			if (!vector_count(cnodes)) {
 				vector_free(cnodes);
 				return;
@@ -264,7 +264,7 @@ VarRef::process_ref(const Cpath &ref_comps,
 				*ismulti = true;
 			}
 			std::string val;
-			if (!get_values(_cstore, pcomps.to_path_string(), _active, val)) {
+			if (!get_values(_cstore, pcomps.to_path_cstr(), _active, val)) {
 				return;
 			}
 			pcomps.push(val);
@@ -275,7 +275,7 @@ VarRef::process_ref(const Cpath &ref_comps,
 			/* single-value node */
 			std::string val;
 			vtw_type_e t = def.getType(1);
-			if (!get_values(_cstore, pcomps.to_path_string(), _active, val)) {
+			if (!get_values(_cstore, pcomps.to_path_cstr(), _active, val)) {
 				/* can't get value => treat it as non-existent (empty value
 				 * and type ERROR_TYPE)
 				 */
@@ -306,7 +306,7 @@ VarRef::getValue(std::string &value, bool multi, vtw_type_e &def_type)
 		}
 		if (_paths[i].second == ERROR_TYPE
 		    && (configd_node_exists(_cstore, _active ? RUNNING : CANDIDATE,
-					    _paths[i].first.to_path_string().c_str(),
+					    _paths[i].first.to_path_cstr(),
 					    NULL) != 1)) {
 			/* path doesn't exist => empty string */
 			added[""] = true;
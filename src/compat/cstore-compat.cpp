@@ -9,7 +9,6 @@
  */
 #include <string.h>
 #include <stdarg.h>
-#include <uriparser/Uri.h>
 
 #include <map>
 
@@ -21,6 +20,7 @@
 #include "connect.h"
 #include "error.h"
 #include "node.h"
+#include "path.h"
 #include "session.h"
 #include "template.h"
 #include "transaction.h"
@@ -34,12 +34,6 @@ __attribute__((nonnull(1)));
 extern "C" void* Perl_get_context(void)
 __attribute__((warn_unused_result));
 
-/* 
- *  URI_MULT is defined by the uriparser documenation to need to be 6 when expanding breaks
- *  http://uriparser.sourceforge.net/doc/html/Uri_8h.html#a0d501e7c2a6abe76b729ea72e123dea8 
- */
-#define URI_MULT 6
-
 using namespace cstore;
 
 struct configd_conn *Cstore::conn = NULL;
@@ -432,29 +426,26 @@ void Cstore::vecToStrVec(struct vector *v, StringVector &sv) {
 }
 
 char *Cstore::strVecToChar(StringVector &sv) {
-	std::string path = "/";
-	switch (sv.size()) {
-	case 0:
-		break;
-	case 1:
-		path = sv[0];
-		break;
-	default:
-		for (size_t i = 0; i < sv.size()-1; i++) {
-			char *cstr = (char *)malloc(sv[i].size() * URI_MULT);
-			if (!cstr) return NULL;
-			uriEscapeA(sv[i].c_str(), cstr, URI_FALSE, URI_TRUE);
-			path = path + std::string(cstr) + "/";
-			free(cstr);
-		}
-		char *cstr = (char *)malloc(sv[sv.size()-1].size() * URI_MULT);
-		if (!cstr) return NULL;
-		uriEscapeA(sv[sv.size()-1].c_str(), cstr, URI_FALSE, URI_TRUE);
-		path += std::string(cstr);
-		free(cstr);
+	/* a lone element is taken to be a complete path already */
+	if (sv.size() == 1) {
+		return strdup(sv[0].c_str());
 	}
-	
-	return strdup(path.c_str());
+
+	size_t len = 1;
+	for (size_t i = 0; i < sv.size(); i++) {
+		len += (i ? 1 : 0) + configd_path_escape_len(sv[i].data(), sv[i].size());
+	}
+
+	char *path = (char *)malloc(len + 1);
+	if (!path) return NULL;
+	char *p = path;
+	*p++ = '/';
+	for (size_t i = 0; i < sv.size(); i++) {
+		if (i) *p++ = '/';
+		p = configd_path_escape(p, sv[i].data(), sv[i].size());
+	}
+	*p = '\0';
+	return path;
 }
 
 bool Cstore::nodeIsChanged(StringVector &path) {
@@ -0,0 +1,483 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/* This program converts a configuration in config.boot form to the set
+ * statements that would create it, with the comment and deactivate
+ * statements that would restore its comments and deactivated nodes.
+ * Without a file it converts the running configuration, read from
+ * configd. It is what vyatta-config-gen-sets.pl and Vyatta::ConfigLoad
+ * run to parse a configuration.
+ *
+ * The file is read in one pass, keeping only the path to the current
+ * node, so the time taken is that of reading it and writing the output.
+ * The statements are kept until the whole file has been read, so that
+ * none are written from one that isn't well formed; the set statements
+ * come first, then the comment and deactivate statements.
+ *
+ * Options:
+ *   --comments     also write comment statements
+ *   --deactivate   also write deactivate statements
+ *   --root=PATH    only convert the node at PATH, a '/' separated list
+ *                  of node names as written in the file
+ *   --raw          write each statement as its kind and path components,
+ *                  each followed by a NUL, and then a NUL, for programs
+ *                  to read. Components are as in the file, unquoted, and
+ *                  comments are written for every node, empty if it has
+ *                  none.
+ *
+ * Exits 1 if there are no set statements, and 2 if the configuration
+ * can't be read or isn't well formed: a quote, comment or block left open
+ * at the end, or a '}' with no block to close.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "connect.h"
+#include "error.h"
+#include "rpc.h"
+#include "transaction.h"
+
+namespace {
+
+const char ACTIVE_CFG[] = "@ACTIVE";
+
+enum { EXIT_NO_SETS = 1, EXIT_ERROR = 2 };
+
+int op_raw = 0;
+int op_comments = 0;
+int op_deactivate = 0;
+std::vector<std::string> op_root;
+
+struct option options[] = {
+	{ "raw", no_argument, &op_raw, 1 },
+	{ "comments", no_argument, &op_comments, 1 },
+	{ "deactivate", no_argument, &op_deactivate, 1 },
+	{ "root", required_argument, NULL, 'r' },
+	{ NULL, 0, NULL, 0 }
+};
+
+typedef std::vector<std::string> Path;
+
+/*
+ * A node whose closing brace is still to come. Nodes are converted only
+ * at or below the root, and those above it only matched against it.
+ */
+struct Frame {
+	size_t depth;
+	const char *at;		/* where it was opened, for errors */
+	bool in;		/* on the way to the root, or below it */
+	bool disabled;
+	bool named;		/* has a named child */
+	Path path;		/* as written in statements */
+	std::string comment;	/* for the next named child */
+};
+
+const char *skip_space(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		p++;
+	return p;
+}
+
+std::string trim(const char *b, const char *e)
+{
+	while (b < e && (*b == ' ' || *b == '\t' || *b == '\r' || *b == '\n'))
+		b++;
+	while (e > b && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r' || e[-1] == '\n'))
+		e--;
+	return std::string(b, e - b);
+}
+
+/*
+ * split separates a node's name from its value, as "ethernet eth0".
+ */
+void split(const std::string &name, std::string &first, std::string &rest)
+{
+	size_t sp = name.find_first_of(" \t");
+
+	if (sp == std::string::npos) {
+		first = name;
+		rest.clear();
+		return;
+	}
+	first = name.substr(0, sp);
+	size_t v = name.find_first_not_of(" \t", sp);
+	rest = v == std::string::npos ? "" : name.substr(v);
+}
+
+/*
+ * quoted_by reports whether s is a single line in the quote character q.
+ */
+bool quoted_by(const std::string &s, char q)
+{
+	return s.size() >= 2 && s[0] == q && s[s.size() - 1] == q
+		&& s.find('\n') == std::string::npos;
+}
+
+/*
+ * single_quote quotes a path component for a set statement, any double
+ * quotes becoming single quotes, as Vyatta::ConfigLoad's applySingleQuote.
+ */
+std::string single_quote(const std::string &comp)
+{
+	std::string s = comp;
+	std::string out;
+
+	if (quoted_by(s, '\''))
+		s = s.substr(1, s.size() - 2);
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] == '\'')
+			out += "'\\''";
+		else
+			out += s[i];
+	}
+	if (quoted_by(out, '\''))
+		return out;
+	if (quoted_by(out, '"'))
+		return "'" + out.substr(1, out.size() - 2) + "'";
+	return "'" + out + "'";
+}
+
+class Converter
+{
+public:
+	Converter(FILE *out)
+		: _out(out), _name(NULL), _begin(NULL), _sets(0), _disableNext(false)
+	{
+		Frame top;
+
+		top.depth = 0;
+		top.at = NULL;
+		top.in = true;
+		top.disabled = false;
+		top.named = false;
+		_stack.push_back(top);
+	}
+
+	bool convert(const char *name, const char *p, const char *end);
+	unsigned long sets() const { return _sets; }
+
+private:
+	void open(const std::string &name, const char *at);
+	bool close();
+	bool fail(const char *at, const char *msg);
+	void leaf(const std::string &text);
+	void namedChild(const std::string &name);
+	bool emitting(const Frame &f) const {
+		return f.in && f.depth >= op_root.size();
+	}
+	bool within(const Frame &parent, const std::string &name) const {
+		size_t depth = parent.depth + 1;
+		return parent.in && (depth > op_root.size() || name == op_root[depth - 1]);
+	}
+
+	void setStatement(const Path &path);
+	void append(std::string &buf, const char *kind, const Path &path);
+
+	FILE *_out;
+	const char *_name;
+	const char *_begin;
+	std::vector<Frame> _stack;
+	std::string _setLines;
+	std::string _comments;
+	std::string _deactivates;
+	unsigned long _sets;
+	bool _disableNext;
+};
+
+void Converter::append(std::string &buf, const char *kind, const Path &path)
+{
+	buf += kind;
+	for (size_t i = 0; i < path.size(); i++) {
+		buf += op_raw ? '\0' : ' ';
+		buf += path[i];
+	}
+	buf += op_raw ? std::string(2, '\0') : std::string("\n");
+}
+
+/*
+ * A set statement has the last component quoted and the others bare, as
+ * vyatta-config-gen-sets.pl has always written them.
+ */
+void Converter::setStatement(const Path &path)
+{
+	std::string &buf = _setLines;
+
+	_sets++;
+	if (op_raw) {
+		append(buf, "set", path);
+		return;
+	}
+
+	buf += "set ";
+	for (size_t i = 0; i + 1 < path.size(); i++) {
+		std::string q = single_quote(path[i]);
+		for (size_t j = 0; j < q.size(); j++)
+			if (q[j] != '\'')
+				buf += q[j];
+		if (i + 2 < path.size())
+			buf += ' ';
+	}
+	buf += ' ';
+	buf += single_quote(path.back());
+	buf += '\n';
+}
+
+/*
+ * A comment applies to the next named child of the node it is in.
+ */
+void Converter::namedChild(const std::string &name)
+{
+	Frame &parent = _stack.back();
+
+	parent.named = true;
+	if (op_comments && emitting(parent) && (op_raw || !parent.comment.empty())) {
+		Path path = parent.path;
+		path.push_back(name);
+		path.push_back("\"" + parent.comment + "\"");
+		append(_comments, "comment", path);
+	}
+	parent.comment.clear();
+}
+
+void Converter::open(const std::string &name, const char *at)
+{
+	Frame f;
+
+	namedChild(name);
+
+	const Frame &parent = _stack.back();
+	f.depth = parent.depth + 1;
+	f.at = at;
+	f.in = within(parent, name);
+	f.disabled = _disableNext;
+	f.named = false;
+	if (f.in) {
+		f.path = parent.path;
+		if (f.depth < op_root.size()) {
+			f.path.push_back(name);
+		} else {
+			std::string first, rest;
+			split(name, first, rest);
+			f.path.push_back(first);
+			if (!rest.empty())
+				f.path.push_back(rest);
+		}
+	}
+	_stack.push_back(f);
+}
+
+bool Converter::close()
+{
+	if (_stack.size() < 2)
+		return false;
+
+	const Frame &f = _stack.back();
+	if (emitting(f)) {
+		if (!f.named)
+			setStatement(f.path);
+		if (f.disabled && op_deactivate)
+			append(_deactivates, "deactivate", f.path);
+	}
+	_stack.pop_back();
+	return true;
+}
+
+/*
+ * fail reports an error at a position in the input, by its line.
+ */
+bool Converter::fail(const char *at, const char *msg)
+{
+	unsigned long line = 1 + std::count(_begin, at, '\n');
+
+	fprintf(stderr, "%s:%lu: %s\n", _name, line, msg);
+	return false;
+}
+
+/*
+ * A leaf is its name and value, or only its name.
+ */
+void Converter::leaf(const std::string &text)
+{
+	std::string name, value;
+
+	split(text, name, value);
+	namedChild(name);
+
+	const Frame &parent = _stack.back();
+	if (!within(parent, name) || parent.depth + 1 < op_root.size())
+		return;
+
+	Path path = parent.path;
+	path.push_back(name);
+	if (_disableNext && op_deactivate)
+		append(_deactivates, "deactivate", path);
+	if (!value.empty())
+		path.push_back(value);
+	setStatement(path);
+}
+
+bool Converter::convert(const char *name, const char *p, const char *end)
+{
+	_name = name;
+	_begin = p;
+	while ((p = skip_space(p, end)) < end) {
+		if (end - p >= 2 && p[0] == '/' && p[1] == '*') {
+			const char *e = (const char *)memmem(p + 2, end - p - 2, "*/", 2);
+			if (!e)
+				return fail(p, "unterminated comment");
+			_stack.back().comment = trim(p + 2, e);
+			p = e + 2;
+			continue;
+		}
+		if (*p == '}') {
+			if (!close())
+				return fail(p, "unexpected '}'");
+			p++;
+			continue;
+		}
+		if (*p == '!') {
+			_disableNext = true;
+			p++;
+			continue;
+		}
+
+		/* A statement ends at a newline or brace not in quotes */
+		const char *s = p;
+		bool quoted = false;
+		for (; p < end; p++) {
+			if (quoted) {
+				if (*p == '\\' && p + 1 < end)
+					p++;
+				else if (*p == '"')
+					quoted = false;
+			} else if (*p == '"') {
+				quoted = true;
+			} else if (*p == '\n' || *p == '{' || *p == '}') {
+				break;
+			}
+		}
+
+		if (quoted)
+			return fail(s, "unterminated quote");
+
+		std::string text = trim(s, p);
+		if (p < end && *p == '{') {
+			open(text, p);
+			p++;
+		} else if (!text.empty()) {
+			leaf(text);
+		}
+		_disableNext = false;
+	}
+
+	if (_stack.size() > 1)
+		return fail(_stack.back().at, "'{' not closed");
+	fwrite(_setLines.data(), 1, _setLines.size(), _out);
+	fwrite(_comments.data(), 1, _comments.size(), _out);
+	fwrite(_deactivates.data(), 1, _deactivates.size(), _out);
+	return true;
+}
+
+void split_root(const char *arg)
+{
+	const char *p = arg;
+
+	op_root.clear();
+	while (*p) {
+		const char *e = strchrnul(p, '/');
+		if (e > p)
+			op_root.push_back(std::string(p, e - p));
+		p = *e ? e + 1 : e;
+	}
+}
+
+char *running_config()
+{
+	struct configd_conn conn;
+	struct configd_error err = { 0 };
+	char *cfg;
+
+	if (configd_open_connection(&conn) < 0) {
+		fprintf(stderr, "Unable to connect to configd\n");
+		exit(EXIT_ERROR);
+	}
+	cfg = configd_show(&conn, RUNNING, "", ACTIVE_CFG, ACTIVE_CFG, 0, &err);
+	if (!cfg) {
+		fprintf(stderr, "%s\n", err.text ? err.text : "Unable to read configuration");
+		configd_error_free(&err);
+		exit(EXIT_ERROR);
+	}
+	configd_close_connection(&conn);
+	return cfg;
+}
+
+}
+
+int
+main(int argc, char **argv)
+{
+	static char outbuf[1 << 16];
+	Converter conv(stdout);
+	bool ok = true;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "", options, NULL)) != -1) {
+		switch (c) {
+		case 0:
+			break;
+		case 'r':
+			split_root(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [--raw] [--comments] [--deactivate] "
+				"[--root=PATH] [file]\n", argv[0]);
+			return EXIT_ERROR;
+		}
+	}
+	setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+
+	if (optind >= argc) {
+		char *cfg = running_config();
+		ok = conv.convert("running configuration", cfg, cfg + strlen(cfg));
+		free(cfg);
+	} else {
+		struct stat st;
+		int fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0 || fstat(fd, &st) < 0) {
+			fprintf(stderr, "Unable to read %s\n", argv[optind]);
+			return EXIT_ERROR;
+		}
+		if (st.st_size > 0) {
+			void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map == MAP_FAILED) {
+				fprintf(stderr, "Unable to read %s\n", argv[optind]);
+				return EXIT_ERROR;
+			}
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			ok = conv.convert(argv[optind], (const char *)map,
+					  (const char *)map + st.st_size);
+			munmap(map, st.st_size);
+		}
+		close(fd);
+	}
+
+	if (fflush(stdout) != 0 || !ok)
+		return EXIT_ERROR;
+	return conv.sets() ? EXIT_SUCCESS : EXIT_NO_SETS;
+}
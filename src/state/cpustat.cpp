@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "cpustat.h"
+
+/*
+ * The sample file is a header followed by a ring of samples, each the
+ * time it was taken and a CpuTimes per CPU. The sampler brackets each
+ * write with increments of seq, so a reader that sees seq odd or changed
+ * reads again. When the set of CPUs changes the file is replaced.
+ */
+
+#define CPUSTAT_MAGIC 0x43505553	/* "CPUS" */
+#define CPUSTAT_VERSION 1
+#define CPUSTAT_SLOTS 64		/* more than the longest window */
+#define CPUSTAT_RETRIES 100
+
+namespace {
+
+const char PROC_STAT[] = "/proc/stat";
+
+struct Header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ncpu;			/* CpuTimes in each sample */
+	uint32_t slots;
+	uint32_t interval_ms;
+	uint32_t pad;
+	uint64_t seq;
+	uint64_t count;			/* samples ever written */
+};
+
+struct Sample {
+	uint64_t time_ns;		/* CLOCK_MONOTONIC */
+	CpuTimes cpu[];
+};
+
+size_t sample_size(uint32_t ncpu)
+{
+	return sizeof(Sample) + ncpu * sizeof(CpuTimes);
+}
+
+size_t file_size(uint32_t ncpu, uint32_t slots)
+{
+	return sizeof(Header) + slots * sample_size(ncpu);
+}
+
+Sample *slot(Header *h, uint64_t n)
+{
+	return (Sample *)((char *)(h + 1)
+			  + (n % h->slots) * sample_size(h->ncpu));
+}
+
+uint64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * read_fd reads the whole of /proc/stat into buf, which is grown as needed
+ * and kept for the next read, as with many CPUs it can be large.
+ */
+bool read_fd(int fd, std::string &buf, std::vector<CpuTimes> &out)
+{
+	size_t len = 0;
+	ssize_t n;
+
+	for (;;) {
+		if (len == buf.size() - 1)
+			buf.resize(buf.size() * 2);
+		n = pread(fd, &buf[len], buf.size() - 1 - len, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return false;
+		if (n == 0)
+			break;
+		len += n;
+	}
+	if (len == 0)
+		return false;
+	buf[len] = '\0';
+	return cpustat_parse(buf.c_str(), out);
+}
+
+bool same_cpus(const Header *h, const Sample *s, const std::vector<CpuTimes> &cpus)
+{
+	if (h->ncpu != cpus.size())
+		return false;
+	for (size_t i = 0; i < cpus.size(); i++)
+		if (s->cpu[i].cpu != cpus[i].cpu)
+			return false;
+	return true;
+}
+
+/*
+ * create makes a new sample file for ncpu CPUs and moves it into place,
+ * so that readers never see it half written.
+ */
+Header *create(const char *file, uint32_t ncpu, unsigned int interval_ms)
+{
+	std::string tmp = std::string(file) + ".new";
+	size_t size = file_size(ncpu, CPUSTAT_SLOTS);
+	Header *h;
+	int fd;
+
+	fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		unlink(tmp.c_str());
+		return NULL;
+	}
+	h = (Header *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (h == MAP_FAILED) {
+		unlink(tmp.c_str());
+		return NULL;
+	}
+
+	h->magic = CPUSTAT_MAGIC;
+	h->version = CPUSTAT_VERSION;
+	h->ncpu = ncpu;
+	h->slots = CPUSTAT_SLOTS;
+	h->interval_ms = interval_ms;
+	if (rename(tmp.c_str(), file) < 0) {
+		munmap(h, size);
+		unlink(tmp.c_str());
+		return NULL;
+	}
+	return h;
+}
+
+uint64_t delta(uint64_t now, uint64_t then)
+{
+	/* iowait can go backwards */
+	return now > then ? now - then : 0;
+}
+
+}
+
+bool cpustat_parse(const char *text, std::vector<CpuTimes> &out)
+{
+	const char *line = text;
+
+	out.clear();
+	while (strncmp(line, "cpu", 3) == 0) {
+		CpuTimes c;
+		int len = 0;
+
+		memset(&c, 0, sizeof(c));
+		c.cpu = -1;
+		if (line[3] != ' ')
+			c.cpu = strtol(line + 3, NULL, 10);
+		line += strcspn(line, " ");
+		for (int i = 0; i < CPU_FIELDS; i++) {
+			if (sscanf(line, " %" SCNu64 "%n", &c.t[i], &len) != 1)
+				break;
+			line += len;
+		}
+		out.push_back(c);
+
+		line = strchr(line, '\n');
+		if (!line)
+			break;
+		line++;
+	}
+	return !out.empty();
+}
+
+bool cpustat_read(const char *file, std::vector<CpuTimes> &out)
+{
+	std::string buf(65536, '\0');
+	int fd = open(file, O_RDONLY | O_CLOEXEC);
+	bool ok;
+
+	if (fd < 0)
+		return false;
+	ok = read_fd(fd, buf, out);
+	close(fd);
+	return ok;
+}
+
+int cpustat_sampler(const char *file, unsigned int interval_ms)
+{
+	std::string buf(65536, '\0');
+	std::vector<CpuTimes> cpus;
+	struct timespec next;
+	Header *h = NULL;
+	int fd;
+
+	fd = open(PROC_STAT, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (;;) {
+		if (!read_fd(fd, buf, cpus))
+			break;
+		if (!h || !same_cpus(h, slot(h, h->count ? h->count - 1 : 0), cpus)) {
+			if (h)
+				munmap(h, file_size(h->ncpu, h->slots));
+			h = create(file, cpus.size(), interval_ms);
+			if (!h)
+				break;
+		}
+
+		Sample *s = slot(h, h->count);
+		__atomic_store_n(&h->seq, h->seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		s->time_ns = now_ns();
+		memcpy(s->cpu, cpus.data(), cpus.size() * sizeof(CpuTimes));
+		h->count++;
+		__atomic_store_n(&h->seq, h->seq + 1, __ATOMIC_RELEASE);
+
+		next.tv_nsec += (interval_ms % 1000) * 1000000L;
+		next.tv_sec += interval_ms / 1000 + next.tv_nsec / 1000000000L;
+		next.tv_nsec %= 1000000000L;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+			;
+	}
+
+	close(fd);
+	if (h)
+		munmap(h, file_size(h->ncpu, h->slots));
+	return -1;
+}
+
+bool cpustat_windows(const char *file, const unsigned int *windows, size_t n,
+		     std::vector<std::vector<CpuTimes> > &out)
+{
+	struct stat st;
+	Header *h;
+	bool ok = false;
+	int fd;
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Header)) {
+		close(fd);
+		return false;
+	}
+	h = (Header *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (h == MAP_FAILED)
+		return false;
+	if (h->magic != CPUSTAT_MAGIC || h->version != CPUSTAT_VERSION
+	    || h->interval_ms == 0 || h->slots < 2
+	    || (size_t)st.st_size < file_size(h->ncpu, h->slots)) {
+		munmap(h, st.st_size);
+		return false;
+	}
+
+	for (int tries = 0; !ok && tries < CPUSTAT_RETRIES; tries++) {
+		uint64_t seq = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		uint64_t count = h->count;
+		if (count < 2)
+			break;
+		const Sample *latest = slot(h, count - 1);
+		/* A sampler that has stopped leaves samples that aren't current */
+		if (now_ns() - latest->time_ns > 3ULL * h->interval_ms * 1000000ULL)
+			break;
+
+		out.assign(n, std::vector<CpuTimes>(latest->cpu, latest->cpu + h->ncpu));
+		for (size_t w = 0; w < n; w++) {
+			uint64_t back = windows[w] * 1000ULL / h->interval_ms;
+			if (back == 0)
+				back = 1;
+			if (back > count - 1)
+				back = count - 1;
+			if (back > h->slots - 1)
+				back = h->slots - 1;
+
+			const Sample *then = slot(h, count - 1 - back);
+			for (uint32_t c = 0; c < h->ncpu; c++)
+				for (int i = 0; i < CPU_FIELDS; i++)
+					out[w][c].t[i] = delta(out[w][c].t[i],
+							       then->cpu[c].t[i]);
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		ok = __atomic_load_n(&h->seq, __ATOMIC_RELAXED) == seq;
+	}
+
+	munmap(h, st.st_size);
+	return ok;
+}
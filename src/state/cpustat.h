@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef CPUSTAT_H_
+#define CPUSTAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+enum {
+	CPU_USER,
+	CPU_NICE,
+	CPU_SYS,
+	CPU_IDLE,
+	CPU_IOWAIT,
+	CPU_IRQ,
+	CPU_SOFT,
+	CPU_STEAL,
+	CPU_GUEST,
+	CPU_GNICE,
+	CPU_FIELDS
+};
+
+/**
+ * CpuTimes is a line of /proc/stat: the time in ticks a CPU, or all of
+ * them, has spent in each state.
+ */
+struct CpuTimes {
+	int32_t cpu;		/* the CPU number, -1 for all */
+	uint32_t pad;
+	uint64_t t[CPU_FIELDS];
+};
+
+/**
+ * cpustat_parse reads the CPU lines at the start of text, the contents of
+ * /proc/stat, into out. Fields missing from older kernels are left 0.
+ * Returns false if there are none.
+ */
+bool cpustat_parse(const char *text, std::vector<CpuTimes> &out);
+
+/**
+ * cpustat_read reads the CPU lines of file, /proc/stat or a copy of it,
+ * into out, the total first. Returns false if it can't be read.
+ */
+bool cpustat_read(const char *file, std::vector<CpuTimes> &out);
+
+/**
+ * cpustat_sampler reads /proc/stat every interval_ms milliseconds into a
+ * ring of samples in file, which is replaced, for cpustat_windows() to
+ * read. It returns only on error, with -1.
+ */
+int cpustat_sampler(const char *file, unsigned int interval_ms);
+
+/**
+ * cpustat_windows reads the samples in file written by a running
+ * cpustat_sampler. For each of the n windows, in seconds, out gets the
+ * time spent by each CPU over that window up to the latest sample, or
+ * over as much of it as has been sampled; a window of 0 is the latest
+ * interval. Returns false if there are no recent samples.
+ */
+bool cpustat_windows(const char *file, const unsigned int *windows, size_t n,
+		     std::vector<std::vector<CpuTimes> > &out);
+
+#endif
@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/* This program provides the configd:get-state handlers of
+ * vyatta-system-v1.yang, as one binary installed under the name of
+ * each handler:
+ *
+ *   vyatta-system-state-memory       /proc/meminfo
+ *   vyatta-system-state-platform     /etc/os-release
+ *   vyatta-system-state-uptime       /proc/uptime
+ *   vyatta-system-state-utilization  /proc/stat
+ *
+ * It may also be run as "vyatta-system-state <name>", with name one of
+ * memory, platform, uptime or utilization. The JSON written is that of
+ * the Perl scripts these replace, see test/system-state.
+ *
+ * Run as "vyatta-system-state sampler" it samples /proc/stat each second
+ * into CPUSTAT_FILE, for utilization to report recent rather than
+ * since-boot figures.
+ */
+
+#include <errno.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include <jansson.h>
+
+#include "cpustat.h"
+
+namespace {
+
+const char PROGRAM[] = "vyatta-system-state";
+
+const char PROC_MEMINFO[] = "/proc/meminfo";
+const char PROC_UPTIME[] = "/proc/uptime";
+const char OS_RELEASE[] = "/etc/os-release";
+const char PROC_STAT[] = "/proc/stat";
+const char CPUSTAT_FILE[] = "/run/vyatta-system-state/cpustat";
+
+/*
+ * The sampling interval, in milliseconds, and the windows read from the
+ * samples: the latest interval, then those averaged, in seconds
+ */
+const unsigned int SAMPLE_INTERVAL = 1000;
+const unsigned int WINDOWS[] = { 0, 10, 60 };
+
+struct MemField {
+	const char *name;	/* as in /proc/meminfo */
+	const char *group;	/* containing object, or NULL */
+	const char *leaf;
+};
+
+const MemField MEM_FIELDS[] = {
+	{ "MemTotal", NULL, "total-memory" },
+	{ "MemFree", NULL, "free-memory" },
+	{ "MemAvailable", NULL, "available-memory" },
+	{ "Buffers", NULL, "buffers" },
+	{ "Cached", NULL, "cached" },
+	{ "SwapCached", NULL, "swap-cached" },
+	{ "Active", NULL, "active" },
+	{ "Inactive", NULL, "inactive" },
+	{ "Active(file)", NULL, "active-file" },
+	{ "Inactive(file)", NULL, "inactive-file" },
+	{ "Unevictable", NULL, "unevictable" },
+	{ "Mlocked", NULL, "memory-locked" },
+	{ "SwapTotal", NULL, "swap-total" },
+	{ "SwapFree", NULL, "swap-free" },
+	{ "Dirty", NULL, "dirty" },
+	{ "Writeback", NULL, "writeback" },
+	{ "AnonPages", NULL, "anonymous-pages" },
+	{ "Mapped", NULL, "mapped" },
+	{ "Shmem", NULL, "shared-memory" },
+	{ "Slab", NULL, "slab" },
+	{ "SReclaimable", NULL, "slab-reclaimable" },
+	{ "SUnreclaim", NULL, "slab-non-reclaimable" },
+	{ "KernelStack", NULL, "kernel-stack" },
+	{ "PageTables", NULL, "page-tables" },
+	{ "NFS_Unstable", NULL, "nfs-unstable" },
+	{ "Bounce", NULL, "bounce" },
+	{ "WritebackTmp", NULL, "writeback-tmp" },
+	{ "CommitLimit", NULL, "commit-limit" },
+	{ "Committed_AS", NULL, "total-committed-memory" },
+	{ "VmallocTotal", NULL, "vmalloc-total" },
+	{ "VmallocUsed", NULL, "vmalloc-used" },
+	{ "VmallocChunk", NULL, "vmalloc-chunk" },
+	{ "Active(anon)", "anonymous", "active" },
+	{ "Inactive(anon)", "anonymous", "inactive" },
+	{ "AnonHugePages", "huge-pages", "anonymous" },
+	{ "ShmemHugePages", "huge-pages", "shared-memory" },
+	{ "HugePages_Total", "huge-pages", "total" },
+	{ "HugePages_Free", "huge-pages", "free" },
+	{ "HugePages_Rsvd", "huge-pages", "reserved" },
+	{ "HugePages_Surp", "huge-pages", "surplus" },
+	{ "Hugepagesize", "huge-pages", "size" },
+};
+
+/*
+ * The files reported on are read under $VYATTA_SYSTEM_STATE_ROOT if it is
+ * set, for the output to be checked against canned contents.
+ */
+std::string input(const char *file)
+{
+	const char *root = getenv("VYATTA_SYSTEM_STATE_ROOT");
+
+	return root ? root + std::string(file) : file;
+}
+
+FILE *open_or_die(const char *file)
+{
+	FILE *fp = fopen(input(file).c_str(), "r");
+
+	if (!fp) {
+		fprintf(stderr, "Could not read from %s\n", file);
+		exit(EXIT_FAILURE);
+	}
+	return fp;
+}
+
+json_t *object_member(json_t *obj, const char *key)
+{
+	json_t *member = json_object_get(obj, key);
+
+	if (!member) {
+		member = json_object();
+		json_object_set_new(obj, key, member);
+	}
+	return member;
+}
+
+/*
+ * Each line is "Name:  value[ kB]"; values given in kB are reported in
+ * bytes.
+ */
+json_t *memory()
+{
+	FILE *fp = open_or_die(PROC_MEMINFO);
+	json_t *out = json_object();
+	char line[256];
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *colon = strchr(line, ':');
+		char *unit;
+		uint64_t value;
+
+		if (!colon)
+			continue;
+		*colon = '\0';
+		value = strtoull(colon + 1, &unit, 10);
+		if (strncmp(unit + strspn(unit, " \t"), "kB", 2) == 0)
+			value *= 1024;
+
+		for (size_t i = 0; i < sizeof(MEM_FIELDS) / sizeof(MEM_FIELDS[0]); i++) {
+			const MemField &f = MEM_FIELDS[i];
+			if (strcmp(line, f.name) != 0)
+				continue;
+			json_object_set_new(f.group ? object_member(out, f.group) : out,
+					    f.leaf, json_integer(value));
+			break;
+		}
+	}
+	fclose(fp);
+	return out;
+}
+
+/*
+ * os-release is lines of KEY=value, where value may be quoted.
+ */
+std::string os_release_value(const std::string &text, const char *key, const std::string &dflt)
+{
+	std::string value = dflt;
+	size_t keylen = strlen(key);
+	size_t pos = 0;
+
+	while (pos < text.size()) {
+		size_t end = text.find('\n', pos);
+		if (end == std::string::npos)
+			end = text.size();
+
+		std::string line = text.substr(pos, end - pos);
+		size_t b = line.find_first_not_of(" \t");
+		size_t eq = line.find('=');
+		if (b != std::string::npos && eq != std::string::npos
+		    && line.compare(b, keylen, key) == 0
+		    && line.find_first_not_of(" \t", b + keylen) == eq) {
+			size_t vb = line.find_first_not_of(" \t", eq + 1);
+			size_t ve = line.find_last_not_of(" \t\r");
+			value = vb == std::string::npos || ve < vb
+				? "" : line.substr(vb, ve - vb + 1);
+		}
+		pos = end + 1;
+	}
+	return value;
+}
+
+std::string unquote(const std::string &value)
+{
+	size_t last = value.rfind('"');
+
+	if (value.empty() || value[0] != '"' || last == 0)
+		return value;
+	return value.substr(1, last - 1) + value.substr(last + 1);
+}
+
+json_t *platform()
+{
+	std::string version = "unknown", name = "unknown", release = "unknown";
+	FILE *fp = fopen(input(OS_RELEASE).c_str(), "r");
+	json_t *out = json_object();
+
+	if (fp) {
+		std::string text;
+		char buf[4096];
+		size_t n;
+
+		while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+			text.append(buf, n);
+		fclose(fp);
+
+		version = os_release_value(text, "BUILD_ID", version);
+		version = os_release_value(text, "VERSION_ID", version);
+		name = os_release_value(text, "NAME", name);
+		name = os_release_value(text, "PRETTY_NAME", name);
+		release = os_release_value(text, "VYATTA_PROJECT_ID", release);
+	}
+
+	json_object_set_new(out, "os-version", json_string(unquote(version).c_str()));
+	json_object_set_new(out, "os-name", json_string(unquote(name).c_str()));
+	json_object_set_new(out, "os-release", json_string(unquote(release).c_str()));
+	return out;
+}
+
+/*
+ * The uptime is the whole seconds of the first field, as a string.
+ */
+json_t *uptime()
+{
+	FILE *fp = open_or_die(PROC_UPTIME);
+	json_t *out = json_object();
+	char buf[64] = "";
+
+	if (!fgets(buf, sizeof(buf), fp))
+		buf[0] = '\0';
+	fclose(fp);
+	buf[strspn(buf, "0123456789")] = '\0';
+	json_object_set_new(out, "uptime", json_string(buf));
+	return out;
+}
+
+std::string percent(uint64_t part, uint64_t total)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%.2f", total ? part * 100.0 / total : 0.0);
+	return buf;
+}
+
+/*
+ * The share of the time given in each state, as mpstat reports it: user
+ * and nice exclude the guest time the kernel counts in them, and the
+ * whole is the sum of the other fields.
+ */
+void set_percentages(json_t *item, const CpuTimes &c)
+{
+	static const char *const leaves[CPU_FIELDS] = {
+		"user", "nice", "sys", "idle", "iowait",
+		"irq", "soft", "steal", "guest", "niced-guest",
+	};
+	uint64_t t[CPU_FIELDS];
+	uint64_t total = 0;
+
+	memcpy(t, c.t, sizeof(t));
+	t[CPU_USER] -= t[CPU_GUEST] < t[CPU_USER] ? t[CPU_GUEST] : t[CPU_USER];
+	t[CPU_NICE] -= t[CPU_GNICE] < t[CPU_NICE] ? t[CPU_GNICE] : t[CPU_NICE];
+	for (int i = 0; i < CPU_FIELDS; i++)
+		total += t[i];
+	for (int i = 0; i < CPU_FIELDS; i++)
+		json_object_set_new(item, leaves[i],
+				    json_string(percent(t[i], total).c_str()));
+}
+
+std::string cpu_name(int32_t cpu)
+{
+	return cpu < 0 ? "all" : std::to_string(cpu);
+}
+
+/*
+ * The utilization of each CPU, and of all of them. When the sampler is
+ * running it is that over the latest interval, with averages over the
+ * longer WINDOWS; otherwise it is since boot, as "mpstat -P ALL"
+ * reports it.
+ */
+json_t *utilization()
+{
+	std::vector<std::vector<CpuTimes> > windows;
+	std::vector<CpuTimes> cpus;
+	json_t *list = json_array();
+	json_t *out = json_object();
+	size_t nwindows = sizeof(WINDOWS) / sizeof(WINDOWS[0]);
+
+	if (cpustat_windows(input(CPUSTAT_FILE).c_str(), WINDOWS, nwindows, windows))
+		cpus = windows[0];
+	else if (!cpustat_read(input(PROC_STAT).c_str(), cpus)) {
+		fprintf(stderr, "Could not read from /proc/stat\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t c = 0; c < cpus.size(); c++) {
+		json_t *item = json_object();
+		json_object_set_new(item, "cpu", json_string(cpu_name(cpus[c].cpu).c_str()));
+		set_percentages(item, cpus[c]);
+
+		if (!windows.empty()) {
+			json_t *averages = json_array();
+			for (size_t w = 1; w < nwindows; w++) {
+				json_t *avg = json_object();
+				json_object_set_new(avg, "interval", json_integer(WINDOWS[w]));
+				set_percentages(avg, windows[w][c]);
+				json_array_append_new(averages, avg);
+			}
+			json_object_set_new(item, "average", averages);
+		}
+		json_array_append_new(list, item);
+	}
+	json_object_set_new(out, "utilization", list);
+	return out;
+}
+
+struct Provider {
+	const char *name;
+	json_t *(*fn)();
+};
+
+const Provider PROVIDERS[] = {
+	{ "memory", memory },
+	{ "platform", platform },
+	{ "uptime", uptime },
+	{ "utilization", utilization },
+};
+
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *name = basename(argv[0]);
+	size_t len = strlen(PROGRAM);
+
+	if (strncmp(name, PROGRAM, len) == 0 && name[len] == '-')
+		name += len + 1;
+	else if (argc > 1)
+		name = argv[1];
+
+	if (strcmp(name, "sampler") == 0) {
+		cpustat_sampler(CPUSTAT_FILE, SAMPLE_INTERVAL);
+		fprintf(stderr, "Could not sample /proc/stat to %s: %s\n",
+			CPUSTAT_FILE, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (size_t i = 0; i < sizeof(PROVIDERS) / sizeof(PROVIDERS[0]); i++) {
+		if (strcmp(name, PROVIDERS[i].name) != 0)
+			continue;
+		json_t *out = PROVIDERS[i].fn();
+		/* The scripts' key order was arbitrary, this is stable */
+		json_dumpf(out, stdout, JSON_COMPACT | JSON_SORT_KEYS);
+		json_decref(out);
+		return EXIT_SUCCESS;
+	}
+
+	fprintf(stderr, "usage: %s memory|platform|uptime|utilization|sampler\n", PROGRAM);
+	return EXIT_FAILURE;
+}
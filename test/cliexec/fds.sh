@@ -0,0 +1,2 @@
+#!/bin/sh
+ls /proc/self/fd
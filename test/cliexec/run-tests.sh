@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+#
+# SPDX-License-Identifier: GPL-2.0-only
+#
+# Checks cliexec batch mode against the scripts here: each entry gets a
+# frame with its status and output, and the scripts an entry runs see
+# only the descriptors cliexec was started with.
+
+CLIEXEC=${CLIEXEC:-../../src/cliexec/cliexec}
+srcdir=$(cd "$(dirname "$0")" && pwd)
+. "$srcdir/../lib.sh"
+tmpfile in
+tmpfile out
+tmpfile expected
+tmpfile fds
+
+# frame ENTRY STATUS OUTPUT
+frame() {
+	printf '%s %s %s\n%s\n' "$1" "$2" "$(printf '%s' "$3" | wc -c)" "$3"
+}
+
+# What a script run directly from here sees
+"$srcdir/fds.sh" > "$fds"
+
+printf '/system/host-name/r1\tcreate\t%s\n' "$srcdir/fds.sh" > "$in"
+printf '\n' >> "$in"
+printf '/system/host-name/r1\tupdate\t%s\n' "$srcdir/status.sh" >> "$in"
+printf 'malformed\n' >> "$in"
+printf '/system/host-name/r1\tdelete\t%s\n' "$srcdir/fds.sh" >> "$in"
+
+{
+	frame 1 0 "$(cat "$fds")
+"
+	frame 2 3 "out
+err
+"
+	frame 3 1 "Malformed batch entry: malformed
+"
+	frame 4 0 "$(cat "$fds")
+"
+} > "$expected"
+
+"$CLIEXEC" -b "$in" > "$out"
+status=$?
+[ $status -eq 0 ] || fail "batch: exit status $status"
+cmp -s "$out" "$expected" || fail "batch: output differs"
+
+"$CLIEXEC" -b - < "$in" > "$out"
+status=$?
+[ $status -eq 0 ] || fail "batch from stdin: exit status $status"
+cmp -s "$out" "$expected" || fail "batch from stdin: output differs"
+
+finish
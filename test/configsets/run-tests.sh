@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+#
+# SPDX-License-Identifier: GPL-2.0-only
+#
+# Checks vyatta-config-sets against the config files here: each NAME.boot
+# that converts gives the statements in the matching file, and each that
+# isn't well formed gives exit status 2, no statements and the error.
+
+CONFIG_SETS=${CONFIG_SETS:-../../src/configsets/vyatta-config-sets}
+srcdir=$(dirname "$0")
+. "$srcdir/../lib.sh"
+tmpfile out
+tmpfile err
+
+# converts NAME EXPECTED [option...]
+converts() {
+	name=$1
+	expected=$2
+	shift 2
+	"$CONFIG_SETS" "$@" "$srcdir/$name.boot" > "$out"
+	status=$?
+	[ $status -eq 0 ] || fail "$name: exit status $status"
+	cmp -s "$out" "$srcdir/$expected" || fail "$name: output differs from $expected"
+}
+
+# rejects NAME MESSAGE
+rejects() {
+	"$CONFIG_SETS" "$srcdir/$1.boot" > "$out" 2> "$err"
+	status=$?
+	[ $status -eq 2 ] || fail "$1: exit status $status, not 2"
+	[ -s "$out" ] && fail "$1: statements written"
+	grep -qF "$1.boot:$2" "$err" || fail "$1: no '$2' error"
+}
+
+converts basic basic.sets
+converts basic root.sets '--root=interfaces/dataplane dp0s3'
+converts quoting quoting.sets
+converts comments comments.sets --comments --deactivate
+converts comments comments.raw --raw --comments --deactivate
+
+"$CONFIG_SETS" "$srcdir/empty.boot" > "$out"
+status=$?
+[ $status -eq 1 ] || fail "empty: exit status $status, not 1"
+
+rejects truncated "2: '{' not closed"
+rejects unterminated-quote "2: unterminated quote"
+rejects unterminated-comment "4: unterminated comment"
+rejects unexpected-brace "3: unexpected '}'"
+
+finish
@@ -0,0 +1,27 @@
+#
+# Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+#
+# SPDX-License-Identifier: GPL-2.0-only
+#
+# Sourced by the run-tests.sh scripts, which report each failed check
+# with fail and end with finish, exiting 1 if any failed.
+
+failed=0
+tmpfiles=
+trap 'rm -f $tmpfiles' EXIT
+
+fail() {
+	echo "FAIL: $*"
+	failed=1
+}
+
+# tmpfile VAR: sets VAR to a new file, removed on exit
+tmpfile() {
+	_tmp=$(mktemp) || exit 1
+	tmpfiles="$tmpfiles $_tmp"
+	eval "$1=\$_tmp"
+}
+
+finish() {
+	exit $failed
+}
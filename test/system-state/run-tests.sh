@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+#
+# SPDX-License-Identifier: GPL-2.0-only
+#
+# Checks vyatta-system-state against the canned /proc and /etc contents
+# here: for each root, NAME.json is the JSON the Perl script it replaced
+# wrote for those contents, with the keys sorted. The utilization ones
+# are the since-boot figures mpstat printed, as there is no sampler file
+# under the roots.
+
+SYSTEM_STATE=${SYSTEM_STATE:-../../src/state/vyatta-system-state}
+srcdir=$(dirname "$0")
+. "$srcdir/../lib.sh"
+tmpfile out
+
+# reports ROOT NAME
+reports() {
+	VYATTA_SYSTEM_STATE_ROOT="$srcdir/$1" "$SYSTEM_STATE" "$2" > "$out"
+	status=$?
+	[ $status -eq 0 ] || fail "$1 $2: exit status $status"
+	cmp -s "$out" "$srcdir/$1/$2.json" || fail "$1 $2: output differs from $1/$2.json"
+}
+
+for root in current old; do
+	for name in memory platform uptime utilization; do
+		reports $root $name
+	done
+done
+
+# Without /proc to read it fails
+VYATTA_SYSTEM_STATE_ROOT=/nonexistent "$SYSTEM_STATE" uptime > "$out" 2>&1
+status=$?
+[ $status -eq 1 ] || fail "no /proc: exit status $status, not 1"
+
+finish